@@ -0,0 +1,676 @@
+#include "soa.h"
+#include "soa_concurrent.h"
+#include "soa_patch.h"
+#include "soa_snapshot.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <new>
+#include <thread>
+#include <vector>
+
+// Counts heap allocations so that benchmarks can report them next to timings.
+static std::atomic<std::size_t> allocation_count{0};
+
+void * operator new( std::size_t bytes )
+{
+    allocation_count.fetch_add( 1, std::memory_order_relaxed );
+    if ( void * p = std::malloc( bytes == 0 ? 1 : bytes ) )
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+#if defined( __GNUC__ ) && !defined( __clang__ )
+// Once inlined into callers, GCC pairs the free below with their new expressions and reports a mismatch.
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete( void * p ) noexcept
+{
+    std::free( p );
+}
+
+void operator delete( void * p, std::size_t ) noexcept
+{
+    ::operator delete( p );
+}
+
+namespace
+{
+    constexpr int repetitions = 20;
+
+    // Runs f repeatedly and prints the best time per element, in nanoseconds.
+    template <typename F>
+    void measure( const char * name, std::size_t elements, F f )
+    {
+        double best = 0.0;
+        for ( int r = 0; r < repetitions; ++r )
+        {
+            const auto start = std::chrono::steady_clock::now();
+            f();
+            const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            best = r == 0 ? elapsed.count() : std::min( best, elapsed.count() );
+        }
+        std::printf( "%-48s %8.3f ns/element\n", name, best / double( elements ) );
+    }
+
+    volatile double sink;
+
+    // Keeps the optimizer from dropping results.
+    template <typename T>
+    void consume( const T & value )
+    {
+        sink = double( value );
+    }
+
+    void expression_templates()
+    {
+        constexpr std::size_t size = 1 << 22;
+        soa::vector<float, float, float, float> v( size );
+        for ( std::size_t i = 0; i < size; ++i )
+        {
+            v.get<0>( i ) = float( i % 1000 );
+            v.get<1>( i ) = float( i % 7 );
+            v.get<2>( i ) = float( i % 13 );
+        }
+
+        std::printf( "\n# d = ( a * 2 + b ) * c - a / 3 + 1\n" );
+
+        measure( "temporary per operation", size, [&]() {
+            const auto a = v.column<0>();
+            const auto b = v.column<1>();
+            const auto c = v.column<2>();
+            std::vector<float> t1( size ), t2( size ), t3( size ), t4( size ), t5( size );
+            for ( std::size_t i = 0; i < size; ++i )
+            {
+                t1[ i ] = a[ i ] * 2.0f;
+            }
+            for ( std::size_t i = 0; i < size; ++i )
+            {
+                t2[ i ] = t1[ i ] + b[ i ];
+            }
+            for ( std::size_t i = 0; i < size; ++i )
+            {
+                t3[ i ] = t2[ i ] * c[ i ];
+            }
+            for ( std::size_t i = 0; i < size; ++i )
+            {
+                t4[ i ] = a[ i ] / 3.0f;
+            }
+            for ( std::size_t i = 0; i < size; ++i )
+            {
+                t5[ i ] = t3[ i ] - t4[ i ];
+            }
+            float * d = v.data<3>();
+            for ( std::size_t i = 0; i < size; ++i )
+            {
+                d[ i ] = t5[ i ] + 1.0f;
+            }
+            consume( d[ size / 2 ] );
+        } );
+
+        measure( "hand-written fused loop", size, [&]() {
+            const float * a = v.data<0>();
+            const float * b = v.data<1>();
+            const float * c = v.data<2>();
+            float * d = v.data<3>();
+            for ( std::size_t i = 0; i < size; ++i )
+            {
+                d[ i ] = ( a[ i ] * 2.0f + b[ i ] ) * c[ i ] - a[ i ] / 3.0f + 1.0f;
+            }
+            consume( d[ size / 2 ] );
+        } );
+
+        measure( "expression template", size, [&]() {
+            v.col<3>() = ( v.col<0>() * 2.0f + v.col<1>() ) * v.col<2>() - v.col<0>() / 3.0f + 1.0f;
+            consume( v.get<3>( size / 2 ) );
+        } );
+    }
+
+    struct particle
+    {
+        float x, y, z;
+    };
+
+    void aos_transposition()
+    {
+        // Small enough to stay in L2, where the conversion is bound by instruction count rather than bandwidth.
+        constexpr std::size_t size = 1 << 15;
+        std::vector<particle> particles( size );
+        for ( std::size_t i = 0; i < size; ++i )
+        {
+            particles[ i ] = {float( i ), float( i % 7 ), float( i % 13 )};
+        }
+        soa::vector<float, float, float> columns( size );
+
+        std::printf( "\n# struct { float x, y, z; } to three columns and back\n" );
+
+        measure( "scalar loop, aos to soa", size, [&]() {
+            float * x = columns.data<0>();
+            float * y = columns.data<1>();
+            float * z = columns.data<2>();
+            for ( std::size_t i = 0; i < size; ++i )
+            {
+                x[ i ] = particles[ i ].x;
+                y[ i ] = particles[ i ].y;
+                z[ i ] = particles[ i ].z;
+            }
+            consume( z[ size / 2 ] );
+        } );
+
+        measure( "soa::from_aos", size, [&]() {
+            soa::from_aos( particles, columns, &particle::x, &particle::y, &particle::z );
+            consume( columns.get<2>( size / 2 ) );
+        } );
+
+        measure( "scalar loop, soa to aos", size, [&]() {
+            const float * x = columns.data<0>();
+            const float * y = columns.data<1>();
+            const float * z = columns.data<2>();
+            for ( std::size_t i = 0; i < size; ++i )
+            {
+                particles[ i ] = {x[ i ], y[ i ], z[ i ]};
+            }
+            consume( particles[ size / 2 ].z );
+        } );
+
+        measure( "soa::to_aos", size, [&]() {
+            soa::to_aos( columns, particles, &particle::x, &particle::y, &particle::z );
+            consume( particles[ size / 2 ].z );
+        } );
+    }
+
+    void gather_scatter()
+    {
+        using table = soa::vector<double, double, double, float, float, float, std::int32_t, std::int32_t, std::int64_t,
+                                  std::int64_t>;
+        constexpr std::size_t rows = 1 << 22;
+        constexpr std::size_t size = 1 << 20;
+        table source( rows );
+        for ( std::size_t i = 0; i < rows; ++i )
+        {
+            source.get<0>( i ) = double( i );
+            source.get<9>( i ) = std::int64_t( i );
+        }
+        std::vector<std::uint32_t> indices( size );
+        std::uint64_t state = 1;
+        for ( auto & index : indices )
+        {
+            state = state * 6364136223846793005u + 1442695040888963407u;
+            index = std::uint32_t( ( state >> 33 ) % rows );
+        }
+        table target( size );
+
+        std::printf( "\n# gather 10 columns at 2^20 random rows of a 2^22 row table\n" );
+
+        measure( "row at a time, row proxies", size, [&]() {
+            for ( std::size_t i = 0; i < size; ++i )
+            {
+                target[ i ] = source[ indices[ i ] ];
+            }
+            consume( target.get<0>( size / 2 ) );
+        } );
+
+        measure( "row at a time, column pointers", size, [&]() {
+            for ( std::size_t i = 0; i < size; ++i )
+            {
+                const std::uint32_t row = indices[ i ];
+                soa::detail::for_each_index<table::column_count>( [&]( auto column ) {
+                    constexpr std::size_t I = decltype( column )::value;
+                    target.data<I>()[ i ] = source.data<I>()[ row ];
+                } );
+            }
+            consume( target.get<0>( size / 2 ) );
+        } );
+
+        measure( "soa::gather, column at a time", size, [&]() {
+            soa::gather( source, indices, target );
+            consume( target.get<0>( size / 2 ) );
+        } );
+
+        measure( "soa::scatter, column at a time", size, [&]() {
+            soa::scatter( target, indices, source );
+            consume( source.get<0>( rows / 2 ) );
+        } );
+    }
+    // Decodes many small batches, a few of them large, and reports time and heap allocations per batch.
+    void small_batches()
+    {
+        constexpr std::size_t batches = 1 << 14;
+        std::vector<std::uint32_t> sizes( batches );
+        std::uint32_t state = 12345;
+        for ( auto & size : sizes )
+        {
+            state = state * 1664525u + 1013904223u;
+            size = ( state >> 8 ) % 1024 == 0 ? 2000 + ( state >> 20 ) % 2000 : 1 + ( state >> 24 ) % 15;
+        }
+
+        std::printf( "\n# build %zu batches of mostly under 16 rows\n", batches );
+
+        auto run = [&]( const char * name, auto make_batch ) {
+            const std::size_t before = allocation_count.load();
+            measure( name, batches, [&]() {
+                double total = 0.0;
+                for ( const std::uint32_t size : sizes )
+                {
+                    auto batch = make_batch();
+                    for ( std::uint32_t i = 0; i < size; ++i )
+                    {
+                        batch.push_back( i, std::uint16_t( i & 7 ), double( i ) * 0.25 );
+                    }
+                    total += batch.template get<2>( batch.size() - 1 );
+                }
+                consume( total );
+            } );
+            std::printf( "%-48s %8.3f per batch\n",
+                         "  heap allocations",
+                         double( allocation_count.load() - before ) / double( repetitions * batches ) );
+        };
+
+        run( "soa::vector", []() { return soa::vector<std::uint32_t, std::uint16_t, double>(); } );
+        run( "soa::small_vector<16>", []() { return soa::small_vector<16, std::uint32_t, std::uint16_t, double>(); } );
+    }
+    // Adds the notional and volume of a contiguous segment to sums, with independent lanes that vectorize.
+    void accumulate_vwap( soa::span<const double> prices, soa::span<const double> volumes, double ( &sums )[ 2 ] )
+    {
+        constexpr std::size_t lanes = 8;
+        double notional[ lanes ] = {}, volume[ lanes ] = {};
+        const double * p = prices.data();
+        const double * v = volumes.data();
+        const double * const end = p + prices.size();
+        for ( ; end - p >= std::ptrdiff_t( lanes ); p += lanes, v += lanes )
+        {
+            for ( std::size_t lane = 0; lane < lanes; ++lane )
+            {
+                notional[ lane ] += p[ lane ] * v[ lane ];
+                volume[ lane ] += v[ lane ];
+            }
+        }
+        for ( ; p != end; ++p, ++v )
+        {
+            notional[ 0 ] += *p * *v;
+            volume[ 0 ] += *v;
+        }
+        for ( std::size_t lane = 0; lane < lanes; ++lane )
+        {
+            sums[ 0 ] += notional[ lane ];
+            sums[ 1 ] += volume[ lane ];
+        }
+    }
+
+    // Rolling VWAP over the last 4096 ticks, recomputed every 64 ticks.
+    void sliding_window()
+    {
+        constexpr std::size_t ticks = 1 << 20;
+        constexpr std::size_t window = 4096;
+        constexpr std::size_t stride = 64;
+        std::vector<double> prices( ticks ), volumes( ticks );
+        for ( std::size_t i = 0; i < ticks; ++i )
+        {
+            prices[ i ] = 100.0 + double( i % 997 ) * 0.01;
+            volumes[ i ] = double( 1 + i % 13 );
+        }
+
+        std::printf( "\n# rolling vwap over %zu ticks, recomputed every %zu ticks\n", window, stride );
+
+        measure( "std::deque of structs", ticks, [&]() {
+            struct tick
+            {
+                double price;
+                double volume;
+            };
+            std::deque<tick> ticks_in_window;
+            double total = 0.0;
+            for ( std::size_t i = 0; i < ticks; ++i )
+            {
+                if ( ticks_in_window.size() == window )
+                {
+                    ticks_in_window.pop_front();
+                }
+                ticks_in_window.push_back( {prices[ i ], volumes[ i ]} );
+                if ( i % stride == 0 )
+                {
+                    double notional = 0.0, volume = 0.0;
+                    for ( const tick & t : ticks_in_window )
+                    {
+                        notional += t.price * t.volume;
+                        volume += t.volume;
+                    }
+                    total += notional / volume;
+                }
+            }
+            consume( total );
+        } );
+
+        measure( "soa::ring, vectorized segment loops", ticks, [&]() {
+            soa::ring<double, double> ticks_in_window( window );
+            double total = 0.0;
+            for ( std::size_t i = 0; i < ticks; ++i )
+            {
+                ticks_in_window.push_back_overwrite( prices[ i ], volumes[ i ] );
+                if ( i % stride == 0 )
+                {
+                    const auto p = ticks_in_window.segments<0>();
+                    const auto v = ticks_in_window.segments<1>();
+                    double sums[ 2 ] = {0.0, 0.0};
+                    accumulate_vwap( p.first, v.first, sums );
+                    accumulate_vwap( p.second, v.second, sums );
+                    const double notional = sums[ 0 ], volume = sums[ 1 ];
+                    total += notional / volume;
+                }
+            }
+            consume( total );
+        } );
+    }
+    // Hands ticks from a producer thread to a consumer thread, row by row or in column batches.
+    void spsc_handoff()
+    {
+        constexpr std::size_t rows = 1 << 22;
+        constexpr std::size_t batch = 256;
+        using tick_queue = soa::spsc_queue<std::uint64_t, double, double>;
+        soa::vector<std::uint64_t, double, double> ticks( rows );
+        for ( std::size_t i = 0; i < rows; ++i )
+        {
+            ticks.get<0>( i ) = i;
+            ticks.get<1>( i ) = 100.0 + double( i % 997 ) * 0.01;
+            ticks.get<2>( i ) = double( 1 + i % 13 );
+        }
+
+        std::printf( "\n# hand %zu ticks from a producer to a consumer thread through a 4096 row queue\n", rows );
+
+        measure( "row at a time, one atomic store per row", rows, [&]() {
+            tick_queue queue( 4096 );
+            std::thread producer( [&]() {
+                for ( std::size_t i = 0; i < rows; ++i )
+                {
+                    while ( !queue.try_push( ticks.get<0>( i ), ticks.get<1>( i ), ticks.get<2>( i ) ) )
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            } );
+            double notional = 0.0;
+            std::uint64_t id = 0;
+            double price = 0.0, volume = 0.0;
+            for ( std::size_t i = 0; i < rows; ++i )
+            {
+                while ( !queue.try_pop( id, price, volume ) )
+                {
+                    std::this_thread::yield();
+                }
+                notional += price * volume;
+            }
+            producer.join();
+            consume( notional );
+        } );
+
+        measure( "256 row column batches", rows, [&]() {
+            tick_queue queue( 4096 );
+            std::thread producer( [&]() {
+                for ( std::size_t pushed = 0; pushed < rows; )
+                {
+                    const std::size_t count = queue.push( std::min( batch, rows - pushed ),
+                                                          ticks.data<0>() + pushed,
+                                                          ticks.data<1>() + pushed,
+                                                          ticks.data<2>() + pushed );
+                    if ( count == 0 )
+                    {
+                        std::this_thread::yield();
+                    }
+                    pushed += count;
+                }
+            } );
+            double notional = 0.0;
+            std::uint64_t ids[ batch ];
+            double prices[ batch ], volumes[ batch ];
+            for ( std::size_t popped = 0; popped < rows; )
+            {
+                const std::size_t count = queue.pop( batch, ids, prices, volumes );
+                if ( count == 0 )
+                {
+                    std::this_thread::yield();
+                }
+                for ( std::size_t i = 0; i < count; ++i )
+                {
+                    notional += prices[ i ] * volumes[ i ];
+                }
+                popped += count;
+            }
+            producer.join();
+            consume( notional );
+        } );
+    }
+    // Four threads produce rows in chunks, then the rows are used as one table.
+    void parallel_append()
+    {
+        constexpr std::size_t rows = 1 << 22;
+        constexpr unsigned threads = 4;
+        constexpr std::size_t chunk = 1024;
+        constexpr std::size_t per_thread = rows / threads;
+
+        std::printf( "\n# %u threads append %zu rows in %zu row chunks\n", threads, rows, chunk );
+
+        measure( "thread-local vectors, then concatenate", rows, [&]() {
+            std::vector<soa::vector<std::uint64_t, double, float>> parts( threads );
+            std::vector<std::thread> workers;
+            for ( unsigned t = 0; t < threads; ++t )
+            {
+                workers.emplace_back( [&parts, t]() {
+                    for ( std::size_t i = t * per_thread; i < ( t + 1 ) * per_thread; ++i )
+                    {
+                        parts[ t ].push_back( i, double( i ) * 0.5, float( i % 100 ) );
+                    }
+                } );
+            }
+            for ( std::thread & worker : workers )
+            {
+                worker.join();
+            }
+            soa::vector<std::uint64_t, double, float> table;
+            for ( const auto & part : parts )
+            {
+                table.append( part );
+            }
+            consume( table.get<1>( rows / 2 ) );
+        } );
+
+        measure( "soa::concurrent_appender", rows, [&]() {
+            soa::concurrent_appender<std::uint64_t, double, float> table;
+            std::vector<std::thread> workers;
+            for ( unsigned t = 0; t < threads; ++t )
+            {
+                workers.emplace_back( [&table, t]() {
+                    for ( std::size_t i = t * per_thread; i < ( t + 1 ) * per_thread; i += chunk )
+                    {
+                        const std::size_t first = table.reserve( chunk );
+                        for ( std::size_t j = 0; j < chunk; ++j )
+                        {
+                            table.write_row( first + j, i + j, double( i + j ) * 0.5, float( ( i + j ) % 100 ) );
+                        }
+                        table.publish( first, chunk );
+                    }
+                } );
+            }
+            for ( std::thread & worker : workers )
+            {
+                worker.join();
+            }
+            consume( table.get<1>( rows / 2 ) );
+        } );
+    }
+    template <std::size_t>
+    using double_column = double;
+
+    template <template <typename...> class Table, typename Sequence>
+    struct wide_table;
+
+    template <template <typename...> class Table, std::size_t... Is>
+    struct wide_table<Table, std::index_sequence<Is...>>
+    {
+        using type = Table<double_column<Is>...>;
+    };
+
+    // A writer updates 2 of 40 columns and publishes a consistent version after every update.
+    void snapshots()
+    {
+        constexpr std::size_t rows = 1 << 15;
+        constexpr std::size_t updates = 64;
+        using columns = std::make_index_sequence<40>;
+        using plain_table = wide_table<soa::vector, columns>::type;
+        using versioned_table = wide_table<soa::versioned_vector, columns>::type;
+
+        plain_table initial( rows );
+        for ( std::size_t i = 0; i < rows; ++i )
+        {
+            initial.get<0>( i ) = double( i );
+        }
+
+        std::printf( "\n# publish a version of a %zu row, 40 column table after each 2 column update\n", rows );
+
+        measure( "deep copy per version", updates, [&]() {
+            plain_table table = initial;
+            std::vector<plain_table> versions;
+            for ( std::size_t u = 0; u < updates; ++u )
+            {
+                table.get<3>( u ) += 1.0;
+                table.get<17>( u ) += 1.0;
+                versions.push_back( table );
+                if ( versions.size() > 2 )
+                {
+                    versions.erase( versions.begin() );
+                }
+            }
+            consume( versions.back().get<3>( 0 ) );
+        } );
+
+        measure( "copy-on-write snapshot per version", updates, [&]() {
+            versioned_table table( initial );
+            std::vector<decltype( table.snapshot() )> versions;
+            for ( std::size_t u = 0; u < updates; ++u )
+            {
+                table.set<3>( u, table.get<3>( u ) + 1.0 );
+                table.set<17>( u, table.get<17>( u ) + 1.0 );
+                versions.push_back( table.snapshot() );
+                if ( versions.size() > 2 )
+                {
+                    versions.erase( versions.begin() );
+                }
+            }
+            consume( versions.back().get<3>( 0 ) );
+        } );
+    }
+    // Finds the cells changed by 1000 random writes to a 2^20 row, 4 column table.
+    void change_tracking()
+    {
+        constexpr std::size_t rows = 1 << 20;
+        constexpr std::size_t writes = 1000;
+        using table = soa::vector<std::uint64_t, double, double, std::uint32_t>;
+        table initial( rows );
+        std::vector<std::uint32_t> targets( writes );
+        std::uint32_t state = 7;
+        for ( auto & target : targets )
+        {
+            state = state * 1664525u + 1013904223u;
+            target = state % rows;
+        }
+
+        std::printf( "\n# find the cells changed by %zu writes to a %zu row, 4 column table\n", writes, rows );
+
+        table current = initial;
+        table previous = initial;
+        double version = 0.0;
+        measure( "diff against the previous version", 1, [&]() {
+            version += 1.0;
+            for ( const std::uint32_t row : targets )
+            {
+                current.get<1>( row ) = version;
+            }
+            std::size_t changed = 0;
+            soa::detail::for_each_index<table::column_count>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                const auto * now = current.data<I>();
+                const auto * before = previous.data<I>();
+                for ( std::size_t i = 0; i < rows; ++i )
+                {
+                    changed += now[ i ] != before[ i ];
+                }
+                std::copy( now, now + rows, previous.data<I>() );
+            } );
+            consume( changed );
+        } );
+
+        soa::tracked_vector<std::uint64_t, double, double, std::uint32_t> tracked( initial );
+        measure( "dirty bitmaps", 1, [&]() {
+            version += 1.0;
+            for ( const std::uint32_t row : targets )
+            {
+                tracked.set<1>( row, version );
+            }
+            std::size_t changed = 0;
+            tracked.dirty_rows().for_each( [&changed]( std::size_t ) { ++changed; } );
+            tracked.checkpoint();
+            consume( changed );
+        } );
+    }
+    // Replicates a 2^20 row, 4 column table where 2% of the rows changed a price since the last second.
+    void patches()
+    {
+        constexpr std::size_t rows = 1 << 20;
+        using table = soa::vector<std::uint64_t, double, double, std::uint32_t>;
+        table before( rows );
+        for ( std::size_t i = 0; i < rows; ++i )
+        {
+            before.get<0>( i ) = i;
+            before.get<1>( i ) = 100.0 + double( i % 997 ) * 0.01;
+            before.get<2>( i ) = double( i % 13 );
+        }
+        table after = before;
+        std::uint32_t state = 3;
+        for ( std::size_t change = 0; change < rows / 50; ++change )
+        {
+            state = state * 1664525u + 1013904223u;
+            after.get<1>( state % rows ) += 0.01;
+        }
+
+        std::printf( "\n# replicate a %zu row, 4 column table after 2%% of its prices changed\n", rows );
+
+        std::vector<unsigned char> wire;
+        soa::write_patch( soa::diff( before, after ), wire );
+        std::printf( "%-48s %8zu KiB\n", "full table", rows * ( 8 + 8 + 8 + 4 ) / 1024 );
+        std::printf( "%-48s %8zu KiB\n", "patch", wire.size() / 1024 );
+
+        measure( "soa::diff + write_patch", rows, [&]() {
+            soa::write_patch( soa::diff( before, after ), wire );
+            consume( wire.size() );
+        } );
+
+        table replica = before;
+        measure( "read_patch + soa::apply", rows, [&]() {
+            const auto delta =
+                soa::read_patch<std::uint64_t, double, double, std::uint32_t>( wire.data(), wire.size() );
+            soa::apply( delta, replica );
+            consume( replica.get<1>( 0 ) );
+        } );
+    }
+}
+
+int main()
+{
+    expression_templates();
+    aos_transposition();
+    gather_scatter();
+    small_batches();
+    sliding_window();
+    spsc_handoff();
+    parallel_append();
+    snapshots();
+    change_tracking();
+    patches();
+
+    return 0;
+}
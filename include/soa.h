@@ -1,4 +1,4786 @@
 #ifndef SOA_H
 #define SOA_H
 
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined( __AVX2__ )
+#include <immintrin.h>
+#elif defined( __SSE2__ )
+#include <emmintrin.h>
+#endif
+
+namespace soa
+{
+    namespace detail
+    {
+        // Every column starts on a cache line so that SIMD loads never straddle two lines at the column head.
+        constexpr std::size_t column_alignment = 64;
+
+        inline void * allocate( std::size_t bytes )
+        {
+            if ( bytes == 0 )
+            {
+                return nullptr;
+            }
+            if ( bytes > std::numeric_limits<std::size_t>::max() - column_alignment )
+            {
+                throw std::length_error( "soa: column too large" );
+            }
+
+            // Over-allocate and stash the original pointer just before the aligned block.
+            auto * raw = static_cast<unsigned char *>( ::operator new( bytes + column_alignment ) );
+            auto address = reinterpret_cast<std::uintptr_t>( raw ) + sizeof( void * );
+            address = ( address + column_alignment - 1 ) & ~( std::uintptr_t( column_alignment ) - 1 );
+            auto * aligned = reinterpret_cast<void **>( address );
+            aligned[ -1 ] = raw;
+            return aligned;
+        }
+
+        inline void deallocate( void * p )
+        {
+            if ( p != nullptr )
+            {
+                ::operator delete( static_cast<void **>( p )[ -1 ] );
+            }
+        }
+
+        // Throws std::length_error when count elements do not fit in the address space.
+        template <typename T>
+        T * allocate_column( std::size_t count )
+        {
+            if ( count > ( std::numeric_limits<std::size_t>::max() - column_alignment ) / sizeof( T ) )
+            {
+                throw std::length_error( "soa: column too large" );
+            }
+            return static_cast<T *>( allocate( count * sizeof( T ) ) );
+        }
+
+        template <bool... Bs>
+        struct all_of : std::is_same<std::integer_sequence<bool, true, Bs...>, std::integer_sequence<bool, Bs..., true>>
+        {
+        };
+
+        template <typename F, std::size_t... Is>
+        void for_each_index( F && f, std::index_sequence<Is...> )
+        {
+            using swallow = int[];
+            (void)swallow{0, ( f( std::integral_constant<std::size_t, Is>{} ), 0 )...};
+        }
+
+        // Calls f( std::integral_constant<std::size_t, I>{} ) for I in [0, N), in order.
+        template <std::size_t N, typename F>
+        void for_each_index( F && f )
+        {
+            for_each_index( std::forward<F>( f ), std::make_index_sequence<N>{} );
+        }
+
+        template <typename Container, typename T>
+        using enable_if_contiguous = typename std::enable_if<std::is_convertible<
+            typename std::remove_pointer<decltype( std::declval<Container>().data() )>::type ( * )[],
+            T ( * )[]>::value>::type;
+    }
+
+    // Non-owning view over a contiguous column.
+    template <typename T>
+    class span
+    {
+    public:
+        using element_type = T;
+        using value_type = typename std::remove_cv<T>::type;
+        using size_type = std::size_t;
+        using iterator = T *;
+
+        span() = default;
+
+        span( T * data, size_type size )
+            : data_( data )
+            , size_( size )
+        {
+        }
+
+        // Views any contiguous container exposing data() and size(): spans, soa columns, std::vector.
+        template <typename Container, typename = detail::enable_if_contiguous<Container &, T>>
+        span( Container & container )
+            : data_( container.data() )
+            , size_( container.size() )
+        {
+        }
+
+        template <typename Container, typename = detail::enable_if_contiguous<const Container &, T>>
+        span( const Container & container )
+            : data_( container.data() )
+            , size_( container.size() )
+        {
+        }
+
+        T * data() const
+        {
+            return data_;
+        }
+
+        size_type size() const
+        {
+            return size_;
+        }
+
+        bool empty() const
+        {
+            return size_ == 0;
+        }
+
+        T & operator[]( size_type i ) const
+        {
+            assert( i < size_ );
+            return data_[ i ];
+        }
+
+        iterator begin() const
+        {
+            return data_;
+        }
+
+        iterator end() const
+        {
+            return data_ + size_;
+        }
+
+        span subspan( size_type offset, size_type count ) const
+        {
+            assert( offset + count <= size_ );
+            return span( data_ + offset, count );
+        }
+
+    private:
+        T * data_ = nullptr;
+        size_type size_ = 0;
+    };
+
+    // Random access iterator over the rows of a SoA container. Dereferencing yields the container's row proxy.
+    template <typename Container, typename Reference>
+    class row_iterator
+    {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = typename std::remove_const<Container>::type::value_type;
+        using difference_type = std::ptrdiff_t;
+        using reference = Reference;
+        using pointer = void;
+
+        row_iterator() = default;
+
+        row_iterator( Container * container, std::size_t index )
+            : container_( container )
+            , index_( static_cast<difference_type>( index ) )
+        {
+        }
+
+        reference operator*() const
+        {
+            return ( *container_ )[ static_cast<std::size_t>( index_ ) ];
+        }
+
+        reference operator[]( difference_type n ) const
+        {
+            return ( *container_ )[ static_cast<std::size_t>( index_ + n ) ];
+        }
+
+        std::size_t index() const
+        {
+            return static_cast<std::size_t>( index_ );
+        }
+
+        row_iterator & operator++()
+        {
+            ++index_;
+            return *this;
+        }
+
+        row_iterator operator++( int )
+        {
+            row_iterator result = *this;
+            ++index_;
+            return result;
+        }
+
+        row_iterator & operator--()
+        {
+            --index_;
+            return *this;
+        }
+
+        row_iterator operator--( int )
+        {
+            row_iterator result = *this;
+            --index_;
+            return result;
+        }
+
+        row_iterator & operator+=( difference_type n )
+        {
+            index_ += n;
+            return *this;
+        }
+
+        row_iterator & operator-=( difference_type n )
+        {
+            index_ -= n;
+            return *this;
+        }
+
+        friend row_iterator operator+( row_iterator it, difference_type n )
+        {
+            return it += n;
+        }
+
+        friend row_iterator operator+( difference_type n, row_iterator it )
+        {
+            return it += n;
+        }
+
+        friend row_iterator operator-( row_iterator it, difference_type n )
+        {
+            return it -= n;
+        }
+
+        friend difference_type operator-( const row_iterator & a, const row_iterator & b )
+        {
+            return a.index_ - b.index_;
+        }
+
+        friend bool operator==( const row_iterator & a, const row_iterator & b )
+        {
+            return a.index_ == b.index_;
+        }
+
+        friend bool operator!=( const row_iterator & a, const row_iterator & b )
+        {
+            return a.index_ != b.index_;
+        }
+
+        friend bool operator<( const row_iterator & a, const row_iterator & b )
+        {
+            return a.index_ < b.index_;
+        }
+
+        friend bool operator>( const row_iterator & a, const row_iterator & b )
+        {
+            return a.index_ > b.index_;
+        }
+
+        friend bool operator<=( const row_iterator & a, const row_iterator & b )
+        {
+            return a.index_ <= b.index_;
+        }
+
+        friend bool operator>=( const row_iterator & a, const row_iterator & b )
+        {
+            return a.index_ >= b.index_;
+        }
+
+    private:
+        Container * container_ = nullptr;
+        difference_type index_ = 0;
+    };
+
+    // Column expressions
+    //
+    // Element-wise arithmetic on columns builds an expression tree instead of temporaries; assigning it to a column
+    // evaluates the whole tree in a single loop that the compiler vectorizes:
+    //
+    //     v.col<2>() = v.col<0>() * 2.0f + v.col<1>();
+
+    // CRTP base of every expression node; Derived provides size() and operator[]( i ).
+    template <typename Derived>
+    struct expression
+    {
+        const Derived & self() const
+        {
+            return static_cast<const Derived &>( *this );
+        }
+    };
+
+    namespace detail
+    {
+        template <typename T>
+        struct scalar_expression : expression<scalar_expression<T>>
+        {
+            explicit scalar_expression( T v )
+                : value( v )
+            {
+            }
+
+            // Scalars broadcast to any length.
+            static constexpr std::size_t size()
+            {
+                return std::numeric_limits<std::size_t>::max();
+            }
+
+            T operator[]( std::size_t ) const
+            {
+                return value;
+            }
+
+            T value;
+        };
+
+        template <typename Op, typename L, typename R>
+        struct binary_expression : expression<binary_expression<Op, L, R>>
+        {
+            binary_expression( const L & l, const R & r )
+                : left( l )
+                , right( r )
+            {
+                assert( l.size() == r.size() || l.size() == scalar_expression<int>::size() ||
+                        r.size() == scalar_expression<int>::size() );
+            }
+
+            std::size_t size() const
+            {
+                return std::min( left.size(), right.size() );
+            }
+
+            auto operator[]( std::size_t i ) const
+                -> decltype( Op::apply( std::declval<const L &>()[ i ], std::declval<const R &>()[ i ] ) )
+            {
+                return Op::apply( left[ i ], right[ i ] );
+            }
+
+            L left;
+            R right;
+        };
+
+        template <typename E>
+        struct negate_expression : expression<negate_expression<E>>
+        {
+            explicit negate_expression( const E & e )
+                : operand( e )
+            {
+            }
+
+            std::size_t size() const
+            {
+                return operand.size();
+            }
+
+            auto operator[]( std::size_t i ) const -> decltype( -std::declval<const E &>()[ i ] )
+            {
+                return -operand[ i ];
+            }
+
+            E operand;
+        };
+
+        struct add_op
+        {
+            template <typename A, typename B>
+            static auto apply( A a, B b ) -> decltype( a + b )
+            {
+                return a + b;
+            }
+        };
+
+        struct subtract_op
+        {
+            template <typename A, typename B>
+            static auto apply( A a, B b ) -> decltype( a - b )
+            {
+                return a - b;
+            }
+        };
+
+        struct multiply_op
+        {
+            template <typename A, typename B>
+            static auto apply( A a, B b ) -> decltype( a * b )
+            {
+                return a * b;
+            }
+        };
+
+        struct divide_op
+        {
+            template <typename A, typename B>
+            static auto apply( A a, B b ) -> decltype( a / b )
+            {
+                return a / b;
+            }
+        };
+
+        // Wraps arithmetic scalars so they can appear on either side of an operator.
+        template <typename T, bool = std::is_arithmetic<T>::value>
+        struct as_expression
+        {
+            using type = T;
+
+            static const T & wrap( const expression<T> & e )
+            {
+                return e.self();
+            }
+        };
+
+        template <typename T>
+        struct as_expression<T, true>
+        {
+            using type = scalar_expression<T>;
+
+            static type wrap( T value )
+            {
+                return type( value );
+            }
+        };
+
+        template <typename T>
+        using is_expression = std::is_base_of<expression<T>, T>;
+
+        // Enabled when at least one side is an expression and the other is an expression or an arithmetic scalar.
+        template <typename L, typename R>
+        using enable_if_operands = typename std::enable_if<
+            ( is_expression<L>::value && ( is_expression<R>::value || std::is_arithmetic<R>::value ) ) ||
+            ( std::is_arithmetic<L>::value && is_expression<R>::value )>::type;
+
+        template <typename Op, typename L, typename R>
+        binary_expression<Op, typename as_expression<L>::type, typename as_expression<R>::type> make_binary(
+            const L & l,
+            const R & r )
+        {
+            return {as_expression<L>::wrap( l ), as_expression<R>::wrap( r )};
+        }
+    }
+
+    template <typename L, typename R, typename = detail::enable_if_operands<L, R>>
+    auto operator+( const L & l, const R & r ) -> decltype( detail::make_binary<detail::add_op>( l, r ) )
+    {
+        return detail::make_binary<detail::add_op>( l, r );
+    }
+
+    template <typename L, typename R, typename = detail::enable_if_operands<L, R>>
+    auto operator-( const L & l, const R & r ) -> decltype( detail::make_binary<detail::subtract_op>( l, r ) )
+    {
+        return detail::make_binary<detail::subtract_op>( l, r );
+    }
+
+    template <typename L, typename R, typename = detail::enable_if_operands<L, R>>
+    auto operator*( const L & l, const R & r ) -> decltype( detail::make_binary<detail::multiply_op>( l, r ) )
+    {
+        return detail::make_binary<detail::multiply_op>( l, r );
+    }
+
+    template <typename L, typename R, typename = detail::enable_if_operands<L, R>>
+    auto operator/( const L & l, const R & r ) -> decltype( detail::make_binary<detail::divide_op>( l, r ) )
+    {
+        return detail::make_binary<detail::divide_op>( l, r );
+    }
+
+    template <typename E>
+    detail::negate_expression<E> operator-( const expression<E> & e )
+    {
+        return detail::negate_expression<E>( e.self() );
+    }
+
+    // Column handle returned by vector::col(). Unlike span, assignment writes the elements: assigning an
+    // expression evaluates it into the column in one fused loop.
+    template <typename T>
+    class column_ref : public expression<column_ref<T>>
+    {
+    public:
+        column_ref( T * data, std::size_t size )
+            : data_( data )
+            , size_( size )
+        {
+        }
+
+        column_ref( const column_ref & ) = default;
+
+        std::size_t size() const
+        {
+            return size_;
+        }
+
+        T * data() const
+        {
+            return data_;
+        }
+
+        T & operator[]( std::size_t i ) const
+        {
+            return data_[ i ];
+        }
+
+        span<T> values() const
+        {
+            return {data_, size_};
+        }
+
+        column_ref & operator=( const column_ref & other )
+        {
+            return assign( other );
+        }
+
+        template <typename E>
+        column_ref & operator=( const expression<E> & e )
+        {
+            return assign( e.self() );
+        }
+
+        column_ref & operator=( const T & value )
+        {
+            std::fill( data_, data_ + size_, value );
+            return *this;
+        }
+
+        template <typename E>
+        column_ref & operator+=( const E & e )
+        {
+            return *this = *this + e;
+        }
+
+        template <typename E>
+        column_ref & operator-=( const E & e )
+        {
+            return *this = *this - e;
+        }
+
+        template <typename E>
+        column_ref & operator*=( const E & e )
+        {
+            return *this = *this * e;
+        }
+
+        template <typename E>
+        column_ref & operator/=( const E & e )
+        {
+            return *this = *this / e;
+        }
+
+    private:
+        template <typename E>
+        column_ref & assign( const E & e )
+        {
+            static_assert( !std::is_const<T>::value, "cannot assign to a column of a const container" );
+            assert( e.size() == size_ );
+            T * out = data_;
+            for ( std::size_t i = 0; i < size_; ++i )
+            {
+                out[ i ] = static_cast<T>( e[ i ] );
+            }
+            return *this;
+        }
+
+        T * data_;
+        std::size_t size_;
+    };
+
+    // Growable structure of arrays: one separately allocated, cache line aligned array per column.
+    //
+    //     soa::vector<int, float> v;
+    //     v.push_back( 1, 2.0f );
+    //     float * prices = v.data<1>();
+    //
+    // Column types must be trivially copyable; rows are moved around with memcpy.
+    template <typename... Ts>
+    class vector
+    {
+        static_assert( sizeof...( Ts ) > 0, "soa::vector needs at least one column" );
+        static_assert( detail::all_of<std::is_trivially_copyable<Ts>::value...>::value,
+                       "soa::vector columns must be trivially copyable" );
+
+    public:
+        using size_type = std::size_t;
+        using value_type = std::tuple<Ts...>;
+        using reference = std::tuple<Ts &...>;
+        using const_reference = std::tuple<const Ts &...>;
+        using iterator = row_iterator<vector, reference>;
+        using const_iterator = row_iterator<const vector, const_reference>;
+
+        template <std::size_t I>
+        using column_type = typename std::tuple_element<I, value_type>::type;
+
+        static constexpr std::size_t column_count = sizeof...( Ts );
+
+        vector() = default;
+
+        explicit vector( size_type size )
+        {
+            resize( size );
+        }
+
+        vector( const vector & other )
+        {
+            reserve( other.size_ );
+            size_ = other.size_;
+            detail::for_each_index<column_count>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                copy_n( other.template data<I>(), size_, this->template data<I>() );
+            } );
+        }
+
+        vector( vector && other ) noexcept
+        {
+            swap( other );
+        }
+
+        vector & operator=( const vector & other )
+        {
+            if ( this != &other )
+            {
+                vector copy( other );
+                swap( copy );
+            }
+            return *this;
+        }
+
+        vector & operator=( vector && other ) noexcept
+        {
+            vector moved( std::move( other ) );
+            swap( moved );
+            return *this;
+        }
+
+        ~vector()
+        {
+            release();
+        }
+
+        void swap( vector & other ) noexcept
+        {
+            std::swap( columns_, other.columns_ );
+            std::swap( size_, other.size_ );
+            std::swap( capacity_, other.capacity_ );
+        }
+
+        size_type size() const
+        {
+            return size_;
+        }
+
+        size_type capacity() const
+        {
+            return capacity_;
+        }
+
+        bool empty() const
+        {
+            return size_ == 0;
+        }
+
+        void reserve( size_type capacity )
+        {
+            if ( capacity > capacity_ )
+            {
+                reallocate( capacity );
+            }
+        }
+
+        void shrink_to_fit()
+        {
+            if ( size_ < capacity_ )
+            {
+                reallocate( size_ );
+            }
+        }
+
+        // New rows are value-initialized.
+        void resize( size_type size )
+        {
+            if ( size > capacity_ )
+            {
+                reallocate( std::max( size, grown_capacity() ) );
+            }
+            if ( size > size_ )
+            {
+                detail::for_each_index<column_count>( [&]( auto column ) {
+                    constexpr std::size_t I = decltype( column )::value;
+                    std::fill( this->template data<I>() + size_, this->template data<I>() + size, column_type<I>() );
+                } );
+            }
+            size_ = size;
+        }
+
+        void clear()
+        {
+            size_ = 0;
+        }
+
+        void push_back( const Ts &... values )
+        {
+            if ( size_ == capacity_ )
+            {
+                // The values may live in this container, so they go into the new columns before the old ones are
+                // freed.
+                const size_type capacity = grown_capacity();
+                std::tuple<Ts *...> columns = copy_columns( capacity );
+                assign_row( columns, size_, std::index_sequence_for<Ts...>{}, values... );
+                adopt( columns, capacity );
+            }
+            else
+            {
+                assign_row( columns_, size_, std::index_sequence_for<Ts...>{}, values... );
+            }
+            ++size_;
+        }
+
+        void push_back( const value_type & row )
+        {
+            push_back_tuple( row, std::index_sequence_for<Ts...>{} );
+        }
+
+        void pop_back()
+        {
+            assert( size_ > 0 );
+            --size_;
+        }
+
+        // Appends all rows of another container, column by column.
+        void append( const vector & other )
+        {
+            assert( this != &other );
+            reserve( size_ + other.size_ );
+            detail::for_each_index<column_count>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                copy_n( other.template data<I>(), other.size_, this->template data<I>() + size_ );
+            } );
+            size_ += other.size_;
+        }
+
+        template <std::size_t I>
+        column_type<I> * data()
+        {
+            return std::get<I>( columns_ );
+        }
+
+        template <std::size_t I>
+        const column_type<I> * data() const
+        {
+            return std::get<I>( columns_ );
+        }
+
+        template <std::size_t I>
+        span<column_type<I>> column()
+        {
+            return {data<I>(), size_};
+        }
+
+        template <std::size_t I>
+        span<const column_type<I>> column() const
+        {
+            return {data<I>(), size_};
+        }
+
+        // Column handle for element-wise arithmetic: v.col<2>() = v.col<0>() * 2.0f + v.col<1>().
+        template <std::size_t I>
+        column_ref<column_type<I>> col()
+        {
+            return {data<I>(), size_};
+        }
+
+        template <std::size_t I>
+        column_ref<const column_type<I>> col() const
+        {
+            return {data<I>(), size_};
+        }
+
+        template <std::size_t I>
+        column_type<I> & get( size_type i )
+        {
+            assert( i < size_ );
+            return data<I>()[ i ];
+        }
+
+        template <std::size_t I>
+        const column_type<I> & get( size_type i ) const
+        {
+            assert( i < size_ );
+            return data<I>()[ i ];
+        }
+
+        reference operator[]( size_type i )
+        {
+            assert( i < size_ );
+            return row( i, std::index_sequence_for<Ts...>{} );
+        }
+
+        const_reference operator[]( size_type i ) const
+        {
+            assert( i < size_ );
+            return row( i, std::index_sequence_for<Ts...>{} );
+        }
+
+        iterator begin()
+        {
+            return {this, 0};
+        }
+
+        iterator end()
+        {
+            return {this, size_};
+        }
+
+        const_iterator begin() const
+        {
+            return {this, 0};
+        }
+
+        const_iterator end() const
+        {
+            return {this, size_};
+        }
+
+        const_iterator cbegin() const
+        {
+            return begin();
+        }
+
+        const_iterator cend() const
+        {
+            return end();
+        }
+
+    private:
+        template <typename T>
+        static void copy_n( const T * src, size_type count, T * dst )
+        {
+            if ( count > 0 )
+            {
+                std::memcpy( dst, src, count * sizeof( T ) );
+            }
+        }
+
+        size_type grown_capacity() const
+        {
+            return std::max<size_type>( 16, capacity_ * 2 );
+        }
+
+        void reallocate( size_type capacity )
+        {
+            adopt( copy_columns( capacity ), capacity );
+        }
+
+        // Columns of the given capacity holding the current rows. If an allocation throws, the columns allocated
+        // so far are freed and the container is left unchanged.
+        std::tuple<Ts *...> copy_columns( size_type capacity ) const
+        {
+            std::tuple<Ts *...> columns{};
+            try
+            {
+                detail::for_each_index<column_count>( [&]( auto column ) {
+                    constexpr std::size_t I = decltype( column )::value;
+                    std::get<I>( columns ) = detail::allocate_column<column_type<I>>( capacity );
+                    copy_n( std::get<I>( columns_ ), size_, std::get<I>( columns ) );
+                } );
+            }
+            catch ( ... )
+            {
+                free_columns( columns );
+                throw;
+            }
+            return columns;
+        }
+
+        void adopt( const std::tuple<Ts *...> & columns, size_type capacity )
+        {
+            release();
+            columns_ = columns;
+            capacity_ = capacity;
+        }
+
+        static void free_columns( std::tuple<Ts *...> & columns )
+        {
+            detail::for_each_index<column_count>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                detail::deallocate( std::get<I>( columns ) );
+                std::get<I>( columns ) = nullptr;
+            } );
+        }
+
+        void release()
+        {
+            free_columns( columns_ );
+        }
+
+        template <std::size_t... Is>
+        static void assign_row(
+            const std::tuple<Ts *...> & columns, size_type i, std::index_sequence<Is...>, const Ts &... values )
+        {
+            using swallow = int[];
+            (void)swallow{0, ( std::get<Is>( columns )[ i ] = values, 0 )...};
+        }
+
+        template <std::size_t... Is>
+        void push_back_tuple( const value_type & row, std::index_sequence<Is...> )
+        {
+            push_back( std::get<Is>( row )... );
+        }
+
+        template <std::size_t... Is>
+        reference row( size_type i, std::index_sequence<Is...> )
+        {
+            return reference( std::get<Is>( columns_ )[ i ]... );
+        }
+
+        template <std::size_t... Is>
+        const_reference row( size_type i, std::index_sequence<Is...> ) const
+        {
+            return const_reference( std::get<Is>( columns_ )[ i ]... );
+        }
+
+        std::tuple<Ts *...> columns_{};
+        size_type size_ = 0;
+        size_type capacity_ = 0;
+    };
+
+    template <typename... Ts>
+    void swap( vector<Ts...> & a, vector<Ts...> & b ) noexcept
+    {
+        a.swap( b );
+    }
+
+    template <std::size_t I, typename Vector>
+    using column_type_t = typename std::remove_cv<
+        typename std::remove_pointer<decltype( std::declval<const Vector &>().template data<I>() )>::type>::type;
+
+    namespace detail
+    {
+        constexpr std::size_t align_offset( std::size_t offset, std::size_t alignment )
+        {
+            return ( offset + alignment - 1 ) / alignment * alignment;
+        }
+
+        // Byte offset of column `column` in the inline storage of N rows of Ts...: columns follow each other, each
+        // aligned for its type. The offset of column sizeof...( Ts ) is the size of the storage.
+        template <std::size_t N, typename... Ts>
+        constexpr std::size_t inline_column_offset( std::size_t column )
+        {
+            constexpr std::size_t sizes[] = {sizeof( Ts )...};
+            constexpr std::size_t alignments[] = {alignof( Ts )...};
+            std::size_t offset = 0;
+            for ( std::size_t i = 0; i < column; ++i )
+            {
+                offset = align_offset( offset + sizes[ i ] * N, i + 1 < sizeof...( Ts ) ? alignments[ i + 1 ] : 1 );
+            }
+            return offset;
+        }
+
+        template <typename... Ts>
+        constexpr std::size_t max_alignment()
+        {
+            constexpr std::size_t alignments[] = {alignof( Ts )...};
+            std::size_t result = 1;
+            for ( const std::size_t alignment : alignments )
+            {
+                result = alignment > result ? alignment : result;
+            }
+            return result;
+        }
+    }
+
+    // Structure of arrays with room for N rows stored inline: no heap allocation and no pointer to follow, the
+    // address of every column is a compile-time offset from the object. Fits on the stack or inside other objects,
+    // and is itself trivially copyable. Offers the row proxy and iteration interface of soa::vector; pushing past
+    // capacity is a precondition violation.
+    //
+    //     soa::static_vector<64, std::uint64_t, double> fills;
+    //     fills.push_back( order_id, price );
+    template <std::size_t N, typename... Ts>
+    class static_vector
+    {
+        static_assert( sizeof...( Ts ) > 0, "soa::static_vector needs at least one column" );
+        static_assert( N > 0, "soa::static_vector needs room for at least one row" );
+        static_assert( detail::all_of<std::is_trivially_copyable<Ts>::value...>::value,
+                       "soa::static_vector columns must be trivially copyable" );
+
+    public:
+        using size_type = std::size_t;
+        using value_type = std::tuple<Ts...>;
+        using reference = std::tuple<Ts &...>;
+        using const_reference = std::tuple<const Ts &...>;
+        using iterator = row_iterator<static_vector, reference>;
+        using const_iterator = row_iterator<const static_vector, const_reference>;
+
+        template <std::size_t I>
+        using column_type = typename std::tuple_element<I, value_type>::type;
+
+        static constexpr std::size_t column_count = sizeof...( Ts );
+
+        static_vector() = default;
+
+        explicit static_vector( size_type size )
+        {
+            resize( size );
+        }
+
+        size_type size() const
+        {
+            return size_;
+        }
+
+        static constexpr size_type capacity()
+        {
+            return N;
+        }
+
+        bool empty() const
+        {
+            return size_ == 0;
+        }
+
+        bool full() const
+        {
+            return size_ == N;
+        }
+
+        // New rows are value-initialized.
+        void resize( size_type size )
+        {
+            assert( size <= N );
+            if ( size > size_ )
+            {
+                detail::for_each_index<column_count>( [&]( auto column ) {
+                    constexpr std::size_t I = decltype( column )::value;
+                    std::fill( this->template data<I>() + size_, this->template data<I>() + size, column_type<I>() );
+                } );
+            }
+            size_ = size;
+        }
+
+        void clear()
+        {
+            size_ = 0;
+        }
+
+        void push_back( const Ts &... values )
+        {
+            assert( size_ < N );
+            assign_row( size_, std::index_sequence_for<Ts...>{}, values... );
+            ++size_;
+        }
+
+        void push_back( const value_type & row )
+        {
+            push_back_tuple( row, std::index_sequence_for<Ts...>{} );
+        }
+
+        void pop_back()
+        {
+            assert( size_ > 0 );
+            --size_;
+        }
+
+        template <std::size_t I>
+        column_type<I> * data()
+        {
+            return reinterpret_cast<column_type<I> *>( storage_ + offset<I>() );
+        }
+
+        template <std::size_t I>
+        const column_type<I> * data() const
+        {
+            return reinterpret_cast<const column_type<I> *>( storage_ + offset<I>() );
+        }
+
+        template <std::size_t I>
+        span<column_type<I>> column()
+        {
+            return {data<I>(), size_};
+        }
+
+        template <std::size_t I>
+        span<const column_type<I>> column() const
+        {
+            return {data<I>(), size_};
+        }
+
+        template <std::size_t I>
+        column_ref<column_type<I>> col()
+        {
+            return {data<I>(), size_};
+        }
+
+        template <std::size_t I>
+        column_ref<const column_type<I>> col() const
+        {
+            return {data<I>(), size_};
+        }
+
+        template <std::size_t I>
+        column_type<I> & get( size_type i )
+        {
+            assert( i < size_ );
+            return data<I>()[ i ];
+        }
+
+        template <std::size_t I>
+        const column_type<I> & get( size_type i ) const
+        {
+            assert( i < size_ );
+            return data<I>()[ i ];
+        }
+
+        reference operator[]( size_type i )
+        {
+            assert( i < size_ );
+            return row( i, std::index_sequence_for<Ts...>{} );
+        }
+
+        const_reference operator[]( size_type i ) const
+        {
+            assert( i < size_ );
+            return row( i, std::index_sequence_for<Ts...>{} );
+        }
+
+        iterator begin()
+        {
+            return {this, 0};
+        }
+
+        iterator end()
+        {
+            return {this, size_};
+        }
+
+        const_iterator begin() const
+        {
+            return {this, 0};
+        }
+
+        const_iterator end() const
+        {
+            return {this, size_};
+        }
+
+        const_iterator cbegin() const
+        {
+            return begin();
+        }
+
+        const_iterator cend() const
+        {
+            return end();
+        }
+
+    private:
+        template <std::size_t I>
+        static constexpr std::size_t offset()
+        {
+            return detail::inline_column_offset<N, Ts...>( I );
+        }
+
+        static constexpr std::size_t storage_bytes = detail::inline_column_offset<N, Ts...>( sizeof...( Ts ) );
+
+        template <std::size_t... Is>
+        void assign_row( size_type i, std::index_sequence<Is...>, const Ts &... values )
+        {
+            using swallow = int[];
+            (void)swallow{0, ( data<Is>()[ i ] = values, 0 )...};
+        }
+
+        template <std::size_t... Is>
+        void push_back_tuple( const value_type & row, std::index_sequence<Is...> )
+        {
+            push_back( std::get<Is>( row )... );
+        }
+
+        template <std::size_t... Is>
+        reference row( size_type i, std::index_sequence<Is...> )
+        {
+            return reference( data<Is>()[ i ]... );
+        }
+
+        template <std::size_t... Is>
+        const_reference row( size_type i, std::index_sequence<Is...> ) const
+        {
+            return const_reference( data<Is>()[ i ]... );
+        }
+
+        size_type size_ = 0;
+        alignas( detail::max_alignment<Ts...>() ) unsigned char storage_[ storage_bytes ];
+    };
+
+    // Growable structure of arrays that keeps its first N rows in inline storage and only allocates once it grows
+    // past N, moving every column to separately allocated, cache line aligned arrays as soa::vector does. Tables
+    // that usually stay small are built without touching the heap while large ones still work. Same interface as
+    // soa::vector; is_inline() tells which storage is in use. Moving an inline container copies its rows.
+    //
+    //     soa::small_vector<16, std::uint32_t, double> batch;
+    //     batch.push_back( field, value ); // no allocation until the 17th row
+    template <std::size_t N, typename... Ts>
+    class small_vector
+    {
+        static_assert( sizeof...( Ts ) > 0, "soa::small_vector needs at least one column" );
+        static_assert( N > 0, "soa::small_vector needs room for at least one inline row" );
+        static_assert( detail::all_of<std::is_trivially_copyable<Ts>::value...>::value,
+                       "soa::small_vector columns must be trivially copyable" );
+
+    public:
+        using size_type = std::size_t;
+        using value_type = std::tuple<Ts...>;
+        using reference = std::tuple<Ts &...>;
+        using const_reference = std::tuple<const Ts &...>;
+        using iterator = row_iterator<small_vector, reference>;
+        using const_iterator = row_iterator<const small_vector, const_reference>;
+
+        template <std::size_t I>
+        using column_type = typename std::tuple_element<I, value_type>::type;
+
+        static constexpr std::size_t column_count = sizeof...( Ts );
+
+        small_vector() noexcept
+        {
+            point_inline();
+        }
+
+        explicit small_vector( size_type size )
+            : small_vector()
+        {
+            resize( size );
+        }
+
+        small_vector( const small_vector & other )
+            : small_vector()
+        {
+            assign( other );
+        }
+
+        small_vector( small_vector && other ) noexcept
+            : small_vector()
+        {
+            take( other );
+        }
+
+        small_vector & operator=( const small_vector & other )
+        {
+            if ( this != &other )
+            {
+                size_ = 0;
+                assign( other );
+            }
+            return *this;
+        }
+
+        small_vector & operator=( small_vector && other ) noexcept
+        {
+            if ( this != &other )
+            {
+                release();
+                point_inline();
+                take( other );
+            }
+            return *this;
+        }
+
+        ~small_vector()
+        {
+            release();
+        }
+
+        size_type size() const
+        {
+            return size_;
+        }
+
+        size_type capacity() const
+        {
+            return capacity_;
+        }
+
+        static constexpr size_type inline_capacity()
+        {
+            return N;
+        }
+
+        bool empty() const
+        {
+            return size_ == 0;
+        }
+
+        // True while the rows live in the inline storage, i.e. the container has never grown past N rows or has
+        // been shrunk back into it.
+        bool is_inline() const
+        {
+            return capacity_ == N;
+        }
+
+        void reserve( size_type capacity )
+        {
+            if ( capacity > capacity_ )
+            {
+                reallocate( capacity );
+            }
+        }
+
+        // Moves the rows back inline when they fit.
+        void shrink_to_fit()
+        {
+            if ( size_ < capacity_ && !is_inline() )
+            {
+                reallocate( size_ );
+            }
+        }
+
+        // New rows are value-initialized.
+        void resize( size_type size )
+        {
+            if ( size > capacity_ )
+            {
+                reallocate( std::max( size, grown_capacity() ) );
+            }
+            if ( size > size_ )
+            {
+                detail::for_each_index<column_count>( [&]( auto column ) {
+                    constexpr std::size_t I = decltype( column )::value;
+                    std::fill( this->template data<I>() + size_, this->template data<I>() + size, column_type<I>() );
+                } );
+            }
+            size_ = size;
+        }
+
+        // Keeps the current storage, heap or inline.
+        void clear()
+        {
+            size_ = 0;
+        }
+
+        void push_back( const Ts &... values )
+        {
+            if ( size_ == capacity_ )
+            {
+                // Growing always moves to the heap. The values may live in this container, so they go into the new
+                // columns before the old ones are freed.
+                const size_type capacity = grown_capacity();
+                std::tuple<Ts *...> columns = copy_columns( capacity );
+                assign_row( columns, size_, std::index_sequence_for<Ts...>{}, values... );
+                adopt( columns, capacity );
+            }
+            else
+            {
+                assign_row( columns_, size_, std::index_sequence_for<Ts...>{}, values... );
+            }
+            ++size_;
+        }
+
+        void push_back( const value_type & row )
+        {
+            push_back_tuple( row, std::index_sequence_for<Ts...>{} );
+        }
+
+        void pop_back()
+        {
+            assert( size_ > 0 );
+            --size_;
+        }
+
+        // Appends all rows of another container, column by column.
+        void append( const small_vector & other )
+        {
+            assert( this != &other );
+            reserve( size_ + other.size_ );
+            detail::for_each_index<column_count>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                copy_n( other.template data<I>(), other.size_, this->template data<I>() + size_ );
+            } );
+            size_ += other.size_;
+        }
+
+        template <std::size_t I>
+        column_type<I> * data()
+        {
+            return std::get<I>( columns_ );
+        }
+
+        template <std::size_t I>
+        const column_type<I> * data() const
+        {
+            return std::get<I>( columns_ );
+        }
+
+        template <std::size_t I>
+        span<column_type<I>> column()
+        {
+            return {data<I>(), size_};
+        }
+
+        template <std::size_t I>
+        span<const column_type<I>> column() const
+        {
+            return {data<I>(), size_};
+        }
+
+        template <std::size_t I>
+        column_ref<column_type<I>> col()
+        {
+            return {data<I>(), size_};
+        }
+
+        template <std::size_t I>
+        column_ref<const column_type<I>> col() const
+        {
+            return {data<I>(), size_};
+        }
+
+        template <std::size_t I>
+        column_type<I> & get( size_type i )
+        {
+            assert( i < size_ );
+            return data<I>()[ i ];
+        }
+
+        template <std::size_t I>
+        const column_type<I> & get( size_type i ) const
+        {
+            assert( i < size_ );
+            return data<I>()[ i ];
+        }
+
+        reference operator[]( size_type i )
+        {
+            assert( i < size_ );
+            return row( i, std::index_sequence_for<Ts...>{} );
+        }
+
+        const_reference operator[]( size_type i ) const
+        {
+            assert( i < size_ );
+            return row( i, std::index_sequence_for<Ts...>{} );
+        }
+
+        iterator begin()
+        {
+            return {this, 0};
+        }
+
+        iterator end()
+        {
+            return {this, size_};
+        }
+
+        const_iterator begin() const
+        {
+            return {this, 0};
+        }
+
+        const_iterator end() const
+        {
+            return {this, size_};
+        }
+
+        const_iterator cbegin() const
+        {
+            return begin();
+        }
+
+        const_iterator cend() const
+        {
+            return end();
+        }
+
+    private:
+        template <typename T>
+        static void copy_n( const T * src, size_type count, T * dst )
+        {
+            if ( count > 0 )
+            {
+                std::memcpy( dst, src, count * sizeof( T ) );
+            }
+        }
+
+        size_type grown_capacity() const
+        {
+            return std::max<size_type>( 16, capacity_ * 2 );
+        }
+
+        void point_inline()
+        {
+            detail::for_each_index<column_count>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                std::get<I>( columns_ ) = reinterpret_cast<column_type<I> *>(
+                    storage_ + detail::inline_column_offset<N, Ts...>( I ) );
+            } );
+            capacity_ = N;
+        }
+
+        // Capacities up to N select the inline storage, larger ones a heap block per column.
+        void reallocate( size_type capacity )
+        {
+            assert( capacity >= size_ );
+            if ( capacity <= N )
+            {
+                if ( !is_inline() )
+                {
+                    const std::tuple<Ts *...> heap = columns_;
+                    point_inline();
+                    detail::for_each_index<column_count>( [&]( auto column ) {
+                        constexpr std::size_t I = decltype( column )::value;
+                        copy_n( std::get<I>( heap ), size_, std::get<I>( columns_ ) );
+                        detail::deallocate( std::get<I>( heap ) );
+                    } );
+                }
+                return;
+            }
+
+            adopt( copy_columns( capacity ), capacity );
+        }
+
+        // Heap columns of the given capacity holding the current rows. If an allocation throws, the columns
+        // allocated so far are freed and the container is left unchanged.
+        std::tuple<Ts *...> copy_columns( size_type capacity ) const
+        {
+            std::tuple<Ts *...> columns{};
+            try
+            {
+                detail::for_each_index<column_count>( [&]( auto column ) {
+                    constexpr std::size_t I = decltype( column )::value;
+                    std::get<I>( columns ) = detail::allocate_column<column_type<I>>( capacity );
+                    copy_n( std::get<I>( columns_ ), size_, std::get<I>( columns ) );
+                } );
+            }
+            catch ( ... )
+            {
+                free_columns( columns );
+                throw;
+            }
+            return columns;
+        }
+
+        void adopt( const std::tuple<Ts *...> & columns, size_type capacity )
+        {
+            release();
+            columns_ = columns;
+            capacity_ = capacity;
+        }
+
+        static void free_columns( const std::tuple<Ts *...> & columns )
+        {
+            detail::for_each_index<column_count>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                detail::deallocate( std::get<I>( columns ) );
+            } );
+        }
+
+        void release()
+        {
+            if ( !is_inline() )
+            {
+                free_columns( columns_ );
+            }
+        }
+
+        // Expects an empty container.
+        void assign( const small_vector & other )
+        {
+            reserve( other.size_ );
+            size_ = other.size_;
+            detail::for_each_index<column_count>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                copy_n( other.template data<I>(), size_, this->template data<I>() );
+            } );
+        }
+
+        // Expects an empty, inline container. Steals heap columns, copies inline rows, and leaves other empty.
+        void take( small_vector & other ) noexcept
+        {
+            if ( other.is_inline() )
+            {
+                size_ = other.size_;
+                detail::for_each_index<column_count>( [&]( auto column ) {
+                    constexpr std::size_t I = decltype( column )::value;
+                    copy_n( other.template data<I>(), size_, this->template data<I>() );
+                } );
+            }
+            else
+            {
+                columns_ = other.columns_;
+                size_ = other.size_;
+                capacity_ = other.capacity_;
+                other.point_inline();
+            }
+            other.size_ = 0;
+        }
+
+        template <std::size_t... Is>
+        static void assign_row(
+            const std::tuple<Ts *...> & columns, size_type i, std::index_sequence<Is...>, const Ts &... values )
+        {
+            using swallow = int[];
+            (void)swallow{0, ( std::get<Is>( columns )[ i ] = values, 0 )...};
+        }
+
+        template <std::size_t... Is>
+        void push_back_tuple( const value_type & row, std::index_sequence<Is...> )
+        {
+            push_back( std::get<Is>( row )... );
+        }
+
+        template <std::size_t... Is>
+        reference row( size_type i, std::index_sequence<Is...> )
+        {
+            return reference( std::get<Is>( columns_ )[ i ]... );
+        }
+
+        template <std::size_t... Is>
+        const_reference row( size_type i, std::index_sequence<Is...> ) const
+        {
+            return const_reference( std::get<Is>( columns_ )[ i ]... );
+        }
+
+        static constexpr std::size_t storage_bytes = detail::inline_column_offset<N, Ts...>( sizeof...( Ts ) );
+
+        std::tuple<Ts *...> columns_{};
+        size_type size_ = 0;
+        size_type capacity_ = N;
+        alignas( detail::max_alignment<Ts...>() ) unsigned char storage_[ storage_bytes ];
+    };
+
+    namespace detail
+    {
+        constexpr std::size_t round_up_to_power_of_two( std::size_t value )
+        {
+            std::size_t result = 1;
+            while ( result < value )
+            {
+                result *= 2;
+            }
+            return result;
+        }
+    }
+
+    // The rows of a ring column, oldest first: the part up to the end of the allocation, then the wrapped part.
+    // Either may be empty.
+    template <typename T>
+    struct ring_segments
+    {
+        span<T> first;
+        span<T> second;
+
+        std::size_t size() const
+        {
+            return first.size() + second.size();
+        }
+    };
+
+    // Fixed-capacity double-ended ring of rows stored as columns, for sliding windows. The capacity is rounded up to
+    // a power of two so that positions wrap with a mask. Each column is one cache line aligned array and the rows
+    // of a column always form at most two contiguous segments, which segments<I>() exposes for vectorized
+    // processing of the whole window. Pushing onto a full ring is a precondition violation: pop first, or use
+    // push_back_overwrite to drop the oldest row.
+    //
+    //     soa::ring<double, double> window( 1024 );
+    //     if ( window.full() ) window.pop_front();
+    //     window.push_back( price, volume );
+    template <typename... Ts>
+    class ring
+    {
+        static_assert( sizeof...( Ts ) > 0, "soa::ring needs at least one column" );
+        static_assert( detail::all_of<std::is_trivially_copyable<Ts>::value...>::value,
+                       "soa::ring columns must be trivially copyable" );
+
+    public:
+        using size_type = std::size_t;
+        using value_type = std::tuple<Ts...>;
+        using reference = std::tuple<Ts &...>;
+        using const_reference = std::tuple<const Ts &...>;
+        using iterator = row_iterator<ring, reference>;
+        using const_iterator = row_iterator<const ring, const_reference>;
+
+        template <std::size_t I>
+        using column_type = typename std::tuple_element<I, value_type>::type;
+
+        static constexpr std::size_t column_count = sizeof...( Ts );
+
+        ring() = default;
+
+        explicit ring( size_type capacity )
+            : ring()
+        {
+            allocate( detail::round_up_to_power_of_two( capacity ) );
+        }
+
+        ring( const ring & other )
+            : ring()
+        {
+            allocate( other.capacity_ );
+            head_ = other.head_;
+            size_ = other.size_;
+            detail::for_each_index<column_count>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                const auto from = other.template segments<I>();
+                std::copy( from.first.begin(), from.first.end(), std::get<I>( columns_ ) + head_ );
+                std::copy( from.second.begin(), from.second.end(), std::get<I>( columns_ ) );
+            } );
+        }
+
+        ring( ring && other ) noexcept
+        {
+            swap( other );
+        }
+
+        ring & operator=( const ring & other )
+        {
+            if ( this != &other )
+            {
+                ring copy( other );
+                swap( copy );
+            }
+            return *this;
+        }
+
+        ring & operator=( ring && other ) noexcept
+        {
+            ring moved( std::move( other ) );
+            swap( moved );
+            return *this;
+        }
+
+        ~ring()
+        {
+            detail::for_each_index<column_count>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                detail::deallocate( std::get<I>( columns_ ) );
+            } );
+        }
+
+        void swap( ring & other ) noexcept
+        {
+            std::swap( columns_, other.columns_ );
+            std::swap( head_, other.head_ );
+            std::swap( size_, other.size_ );
+            std::swap( capacity_, other.capacity_ );
+        }
+
+        size_type size() const
+        {
+            return size_;
+        }
+
+        size_type capacity() const
+        {
+            return capacity_;
+        }
+
+        bool empty() const
+        {
+            return size_ == 0;
+        }
+
+        bool full() const
+        {
+            return size_ == capacity_;
+        }
+
+        void clear()
+        {
+            head_ = 0;
+            size_ = 0;
+        }
+
+        void push_back( const Ts &... values )
+        {
+            assert( !full() );
+            assign_row( position( size_ ), std::index_sequence_for<Ts...>{}, values... );
+            ++size_;
+        }
+
+        void push_back( const value_type & row )
+        {
+            push_back_tuple( row, std::index_sequence_for<Ts...>{} );
+        }
+
+        // Appends a row, dropping the oldest one first when the ring is full.
+        void push_back_overwrite( const Ts &... values )
+        {
+            if ( full() )
+            {
+                pop_front();
+            }
+            push_back( values... );
+        }
+
+        void push_front( const Ts &... values )
+        {
+            assert( !full() );
+            head_ = ( head_ - 1 ) & ( capacity_ - 1 );
+            assign_row( head_, std::index_sequence_for<Ts...>{}, values... );
+            ++size_;
+        }
+
+        void pop_back()
+        {
+            assert( size_ > 0 );
+            --size_;
+        }
+
+        void pop_front()
+        {
+            assert( size_ > 0 );
+            head_ = ( head_ + 1 ) & ( capacity_ - 1 );
+            --size_;
+        }
+
+        // Drops the count oldest rows.
+        void pop_front( size_type count )
+        {
+            assert( count <= size_ );
+            head_ = ( head_ + count ) & ( capacity_ - 1 );
+            size_ -= count;
+        }
+
+        template <std::size_t I>
+        ring_segments<column_type<I>> segments()
+        {
+            return make_segments( std::get<I>( columns_ ) );
+        }
+
+        template <std::size_t I>
+        ring_segments<const column_type<I>> segments() const
+        {
+            return make_segments<const column_type<I>>( std::get<I>( columns_ ) );
+        }
+
+        // Row i counts from the oldest row.
+        template <std::size_t I>
+        column_type<I> & get( size_type i )
+        {
+            assert( i < size_ );
+            return std::get<I>( columns_ )[ position( i ) ];
+        }
+
+        template <std::size_t I>
+        const column_type<I> & get( size_type i ) const
+        {
+            assert( i < size_ );
+            return std::get<I>( columns_ )[ position( i ) ];
+        }
+
+        reference operator[]( size_type i )
+        {
+            assert( i < size_ );
+            return row( position( i ), std::index_sequence_for<Ts...>{} );
+        }
+
+        const_reference operator[]( size_type i ) const
+        {
+            assert( i < size_ );
+            return row( position( i ), std::index_sequence_for<Ts...>{} );
+        }
+
+        reference front()
+        {
+            return ( *this )[ 0 ];
+        }
+
+        const_reference front() const
+        {
+            return ( *this )[ 0 ];
+        }
+
+        reference back()
+        {
+            return ( *this )[ size_ - 1 ];
+        }
+
+        const_reference back() const
+        {
+            return ( *this )[ size_ - 1 ];
+        }
+
+        iterator begin()
+        {
+            return {this, 0};
+        }
+
+        iterator end()
+        {
+            return {this, size_};
+        }
+
+        const_iterator begin() const
+        {
+            return {this, 0};
+        }
+
+        const_iterator end() const
+        {
+            return {this, size_};
+        }
+
+        const_iterator cbegin() const
+        {
+            return begin();
+        }
+
+        const_iterator cend() const
+        {
+            return end();
+        }
+
+    private:
+        // Gives an empty ring columns for exactly capacity rows. If an allocation throws, the destructor frees the
+        // columns allocated before it.
+        void allocate( size_type capacity )
+        {
+            detail::for_each_index<column_count>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                std::get<I>( columns_ ) = detail::allocate_column<column_type<I>>( capacity );
+            } );
+            capacity_ = capacity;
+        }
+
+        size_type position( size_type i ) const
+        {
+            return ( head_ + i ) & ( capacity_ - 1 );
+        }
+
+        template <typename T>
+        ring_segments<T> make_segments( T * column ) const
+        {
+            const size_type first = std::min( size_, capacity_ - head_ );
+            return {span<T>( column + head_, first ), span<T>( column, size_ - first )};
+        }
+
+        template <std::size_t... Is>
+        void assign_row( size_type slot, std::index_sequence<Is...>, const Ts &... values )
+        {
+            using swallow = int[];
+            (void)swallow{0, ( std::get<Is>( columns_ )[ slot ] = values, 0 )...};
+        }
+
+        template <std::size_t... Is>
+        void push_back_tuple( const value_type & row, std::index_sequence<Is...> )
+        {
+            push_back( std::get<Is>( row )... );
+        }
+
+        template <std::size_t... Is>
+        reference row( size_type slot, std::index_sequence<Is...> )
+        {
+            return reference( std::get<Is>( columns_ )[ slot ]... );
+        }
+
+        template <std::size_t... Is>
+        const_reference row( size_type slot, std::index_sequence<Is...> ) const
+        {
+            return const_reference( std::get<Is>( columns_ )[ slot ]... );
+        }
+
+        std::tuple<Ts *...> columns_{};
+        size_type head_ = 0;
+        size_type size_ = 0;
+        size_type capacity_ = 0;
+    };
+
+    template <typename... Ts>
+    void swap( ring<Ts...> & a, ring<Ts...> & b ) noexcept
+    {
+        a.swap( b );
+    }
+
+    // Reductions
+    //
+    // Columns are cut into fixed-size blocks whose boundaries depend only on the row count. Each block is reduced
+    // with a fixed number of independent accumulator lanes (which the compiler maps onto SIMD registers), and the
+    // per-block partials are combined with a fixed pairwise tree. Threads only decide who computes which block, so
+    // the result is bit-identical for any thread count, even for non-associative floating point operations.
+
+    namespace detail
+    {
+        constexpr std::size_t reduce_block_size = 4096;
+        constexpr std::size_t reduce_lanes = 8;
+
+        inline std::size_t block_count( std::size_t size, std::size_t block_size )
+        {
+            return ( size + block_size - 1 ) / block_size;
+        }
+
+        // Calls f( block ) once for every block in [0, blocks), split in contiguous ranges over at most `threads`
+        // workers (the calling thread included). Ranges whose thread cannot be started run on the calling thread.
+        // A worker stops at the first exception thrown by f; once every worker has finished, the exception of the
+        // lowest failing worker is rethrown.
+        template <typename F>
+        void parallel_for_blocks( std::size_t blocks, unsigned threads, F f )
+        {
+            const std::size_t workers = std::max<std::size_t>( 1, std::min<std::size_t>( threads, blocks ) );
+            if ( workers == 1 )
+            {
+                for ( std::size_t b = 0; b < blocks; ++b )
+                {
+                    f( b );
+                }
+                return;
+            }
+
+            const std::size_t per_worker = block_count( blocks, workers );
+            std::vector<std::exception_ptr> errors( workers );
+            auto run = [&]( std::size_t worker ) {
+                try
+                {
+                    const std::size_t end = std::min( blocks, ( worker + 1 ) * per_worker );
+                    for ( std::size_t b = worker * per_worker; b < end; ++b )
+                    {
+                        f( b );
+                    }
+                }
+                catch ( ... )
+                {
+                    errors[ worker ] = std::current_exception();
+                }
+            };
+
+            std::vector<std::thread> pool;
+            pool.reserve( workers - 1 );
+            try
+            {
+                for ( std::size_t worker = 1; worker < workers; ++worker )
+                {
+                    pool.emplace_back( run, worker );
+                }
+            }
+            catch ( const std::system_error & )
+            {
+            }
+            run( 0 );
+            for ( std::size_t worker = pool.size() + 1; worker < workers; ++worker )
+            {
+                run( worker );
+            }
+            for ( auto & thread : pool )
+            {
+                thread.join();
+            }
+            for ( const std::exception_ptr & error : errors )
+            {
+                if ( error )
+                {
+                    std::rethrow_exception( error );
+                }
+            }
+        }
+
+        // Combines partials pairwise: ((p0 p1) (p2 p3)) ((p4 p5) ...). The shape only depends on partials.size().
+        template <typename T, typename Op>
+        T tree_combine( std::vector<T> & partials, T identity, Op op )
+        {
+            if ( partials.empty() )
+            {
+                return identity;
+            }
+            for ( std::size_t stride = 1; stride < partials.size(); stride *= 2 )
+            {
+                for ( std::size_t i = 0; i + stride < partials.size(); i += 2 * stride )
+                {
+                    partials[ i ] = op( partials[ i ], partials[ i + stride ] );
+                }
+            }
+            return partials[ 0 ];
+        }
+
+        template <typename T, typename Op, typename Load>
+        T reduce_range( std::size_t begin, std::size_t end, T identity, Op op, Load load )
+        {
+            T lanes[ reduce_lanes ];
+            std::fill( lanes, lanes + reduce_lanes, identity );
+
+            std::size_t i = begin;
+            for ( ; i + reduce_lanes <= end; i += reduce_lanes )
+            {
+                for ( std::size_t lane = 0; lane < reduce_lanes; ++lane )
+                {
+                    lanes[ lane ] = op( lanes[ lane ], load( i + lane ) );
+                }
+            }
+            for ( std::size_t lane = 0; i < end; ++i, ++lane )
+            {
+                lanes[ lane ] = op( lanes[ lane ], load( i ) );
+            }
+
+            for ( std::size_t width = reduce_lanes / 2; width > 0; width /= 2 )
+            {
+                for ( std::size_t lane = 0; lane < width; ++lane )
+                {
+                    lanes[ lane ] = op( lanes[ lane ], lanes[ lane + width ] );
+                }
+            }
+            return lanes[ 0 ];
+        }
+
+        template <typename T, typename Op, typename Load>
+        T deterministic_reduce( std::size_t size, T identity, Op op, Load load, unsigned threads )
+        {
+            std::vector<T> partials( block_count( size, reduce_block_size ), identity );
+            parallel_for_blocks( partials.size(), threads, [&]( std::size_t block ) {
+                const std::size_t begin = block * reduce_block_size;
+                const std::size_t end = std::min( size, begin + reduce_block_size );
+                partials[ block ] = reduce_range( begin, end, identity, op, load );
+            } );
+            return tree_combine( partials, identity, op );
+        }
+
+        // Count, mean and sum of squared deviations of a block, merged with Chan et al.'s pairwise update.
+        struct moments
+        {
+            double count = 0.0;
+            double mean = 0.0;
+            double m2 = 0.0;
+        };
+
+        inline moments merge_moments( const moments & a, const moments & b )
+        {
+            if ( a.count == 0.0 )
+            {
+                return b;
+            }
+            if ( b.count == 0.0 )
+            {
+                return a;
+            }
+            moments result;
+            result.count = a.count + b.count;
+            const double delta = b.mean - a.mean;
+            result.mean = a.mean + delta * ( b.count / result.count );
+            result.m2 = a.m2 + b.m2 + delta * delta * ( a.count * b.count / result.count );
+            return result;
+        }
+
+        template <typename T>
+        T lowest_identity()
+        {
+            return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity()
+                                                        : std::numeric_limits<T>::lowest();
+        }
+
+        template <typename T>
+        T highest_identity()
+        {
+            return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity()
+                                                        : std::numeric_limits<T>::max();
+        }
+    }
+
+    // Reduces column I with op, which must be associative and have `identity` as its identity element.
+    template <std::size_t I, typename Vector, typename T, typename Op>
+    T reduce( const Vector & v, T identity, Op op, unsigned threads = 1 )
+    {
+        const auto * column = v.template data<I>();
+        return detail::deterministic_reduce(
+            v.size(), identity, op, [column]( std::size_t i ) { return static_cast<T>( column[ i ] ); }, threads );
+    }
+
+    // Reduces transform( column<Is>[ i ]... ) over all rows, e.g. a weighted sum of two columns.
+    template <std::size_t... Is, typename Vector, typename T, typename Op, typename Transform>
+    T transform_reduce( const Vector & v, T identity, Op op, Transform transform, unsigned threads = 1 )
+    {
+        const auto columns = std::make_tuple( v.template data<Is>()... );
+        return detail::deterministic_reduce( v.size(),
+                                             identity,
+                                             op,
+                                             [&columns, &transform]( std::size_t i ) {
+                                                 return static_cast<T>( transform( std::get<Is>( columns )[ i ]... ) );
+                                             },
+                                             threads );
+    }
+
+    template <std::size_t I, typename Vector>
+    column_type_t<I, Vector> sum( const Vector & v, unsigned threads = 1 )
+    {
+        using T = column_type_t<I, Vector>;
+        return reduce<I>( v, T(), []( T a, T b ) { return a + b; }, threads );
+    }
+
+    // Smallest value of column I; the container must not be empty.
+    template <std::size_t I, typename Vector>
+    column_type_t<I, Vector> min( const Vector & v, unsigned threads = 1 )
+    {
+        using T = column_type_t<I, Vector>;
+        assert( v.size() > 0 );
+        return reduce<I>( v, detail::highest_identity<T>(), []( T a, T b ) { return b < a ? b : a; }, threads );
+    }
+
+    // Largest value of column I; the container must not be empty.
+    template <std::size_t I, typename Vector>
+    column_type_t<I, Vector> max( const Vector & v, unsigned threads = 1 )
+    {
+        using T = column_type_t<I, Vector>;
+        assert( v.size() > 0 );
+        return reduce<I>( v, detail::lowest_identity<T>(), []( T a, T b ) { return a < b ? b : a; }, threads );
+    }
+
+    // Sum of column I times column J, accumulated in their common type.
+    template <std::size_t I, std::size_t J, typename Vector>
+    typename std::common_type<column_type_t<I, Vector>, column_type_t<J, Vector>>::type weighted_sum(
+        const Vector & v,
+        unsigned threads = 1 )
+    {
+        using T = typename std::common_type<column_type_t<I, Vector>, column_type_t<J, Vector>>::type;
+        return transform_reduce<I, J>(
+            v, T(), []( T a, T b ) { return a + b; }, []( T a, T b ) { return a * b; }, threads );
+    }
+
+    template <std::size_t I, typename Vector>
+    double mean( const Vector & v, unsigned threads = 1 )
+    {
+        if ( v.size() == 0 )
+        {
+            return 0.0;
+        }
+        const double total = reduce<I>( v, 0.0, []( double a, double b ) { return a + b; }, threads );
+        return total / static_cast<double>( v.size() );
+    }
+
+    // Population variance of column I.
+    template <std::size_t I, typename Vector>
+    double variance( const Vector & v, unsigned threads = 1 )
+    {
+        const auto * column = v.template data<I>();
+        const std::size_t size = v.size();
+        std::vector<detail::moments> partials( detail::block_count( size, detail::reduce_block_size ) );
+
+        detail::parallel_for_blocks( partials.size(), threads, [&]( std::size_t block ) {
+            const std::size_t begin = block * detail::reduce_block_size;
+            const std::size_t end = std::min( size, begin + detail::reduce_block_size );
+            const auto add = []( double a, double b ) { return a + b; };
+            const auto load = [column]( std::size_t i ) { return static_cast<double>( column[ i ] ); };
+
+            detail::moments m;
+            m.count = static_cast<double>( end - begin );
+            m.mean = detail::reduce_range( begin, end, 0.0, add, load ) / m.count;
+            const double mu = m.mean;
+            m.m2 = detail::reduce_range( begin, end, 0.0, add, [&]( std::size_t i ) {
+                const double d = load( i ) - mu;
+                return d * d;
+            } );
+            partials[ block ] = m;
+        } );
+
+        const detail::moments total = detail::tree_combine( partials, detail::moments(), detail::merge_moments );
+        return total.count > 0.0 ? total.m2 / total.count : 0.0;
+    }
+
+    // Hash aggregation
+
+    namespace detail
+    {
+        inline void prefetch( const void * p )
+        {
+#if defined( __GNUC__ ) || defined( __clang__ )
+            __builtin_prefetch( p );
+#else
+            (void)p;
+#endif
+        }
+
+        // splitmix64 finalizer
+        inline std::uint64_t mix( std::uint64_t x )
+        {
+            x ^= x >> 30;
+            x *= 0xbf58476d1ce4e5b9ULL;
+            x ^= x >> 27;
+            x *= 0x94d049bb133111ebULL;
+            x ^= x >> 31;
+            return x;
+        }
+
+        // Keys are hashed and compared by their object representation, so float keys group -0.0 and 0.0 apart and
+        // NaNs with identical bits together.
+        template <typename Key>
+        std::uint64_t hash_key( const Key & key )
+        {
+            static_assert( std::is_trivially_copyable<Key>::value, "hash keys must be trivially copyable" );
+            const auto * bytes = reinterpret_cast<const unsigned char *>( &key );
+            std::uint64_t hash = sizeof( Key );
+            for ( std::size_t offset = 0; offset < sizeof( Key ); offset += sizeof( std::uint64_t ) )
+            {
+                std::uint64_t word = 0;
+                std::memcpy( &word, bytes + offset, std::min( sizeof( word ), sizeof( Key ) - offset ) );
+                hash = mix( hash ^ word );
+            }
+            return hash;
+        }
+
+        template <typename Key>
+        bool key_equal( const Key & a, const Key & b )
+        {
+            return std::memcmp( &a, &b, sizeof( Key ) ) == 0;
+        }
+
+        // Rows are hashed and probed in batches: all hashes of a batch are computed and their slots prefetched
+        // before the first probe, so the cache misses of a batch overlap instead of serializing.
+        constexpr std::size_t hash_batch_size = 64;
+
+        // Open addressing table with linear probing mapping keys to 32-bit payloads. Slots are themselves stored as
+        // a SoA (key column, payload column) so probing a run of slots touches contiguous keys.
+        template <typename Key>
+        class hash_table
+        {
+        public:
+            static constexpr std::uint32_t empty = std::numeric_limits<std::uint32_t>::max();
+
+            explicit hash_table( std::size_t expected = 0 )
+            {
+                rehash( capacity_for( expected ) );
+            }
+
+            std::size_t size() const
+            {
+                return size_;
+            }
+
+            std::size_t capacity() const
+            {
+                return slots_.size();
+            }
+
+            std::size_t memory_bytes() const
+            {
+                return slots_.capacity() * ( sizeof( Key ) + sizeof( std::uint32_t ) );
+            }
+
+            void prefetch( std::uint64_t hash ) const
+            {
+                const std::size_t slot = hash & mask_;
+                detail::prefetch( slots_.template data<0>() + slot );
+                detail::prefetch( slots_.template data<1>() + slot );
+            }
+
+            // Returns the payload stored for key, or empty.
+            std::uint32_t find( const Key & key, std::uint64_t hash ) const
+            {
+                const Key * keys = slots_.template data<0>();
+                const std::uint32_t * payloads = slots_.template data<1>();
+                for ( std::size_t slot = hash & mask_;; slot = ( slot + 1 ) & mask_ )
+                {
+                    if ( payloads[ slot ] == empty )
+                    {
+                        return empty;
+                    }
+                    if ( key_equal( keys[ slot ], key ) )
+                    {
+                        return payloads[ slot ];
+                    }
+                }
+            }
+
+            // Stores payload for key and returns the payload it replaces, or empty if key was not present.
+            std::uint32_t exchange( const Key & key, std::uint64_t hash, std::uint32_t payload )
+            {
+                const auto found = insert( key, hash, payload );
+                if ( found.second )
+                {
+                    return empty;
+                }
+                slots_.template get<1>( slot_ ) = payload;
+                return found.first;
+            }
+
+            // Returns the payload already stored for key and false, or stores payload and returns it with true.
+            std::pair<std::uint32_t, bool> insert( const Key & key, std::uint64_t hash, std::uint32_t payload )
+            {
+                assert( payload != empty );
+                if ( 2 * ( size_ + 1 ) > slots_.size() )
+                {
+                    rehash( slots_.size() * 2 );
+                }
+
+                Key * keys = slots_.template data<0>();
+                std::uint32_t * payloads = slots_.template data<1>();
+                for ( std::size_t slot = hash & mask_;; slot = ( slot + 1 ) & mask_ )
+                {
+                    if ( payloads[ slot ] == empty )
+                    {
+                        keys[ slot ] = key;
+                        payloads[ slot ] = payload;
+                        ++size_;
+                        return {payload, true};
+                    }
+                    if ( key_equal( keys[ slot ], key ) )
+                    {
+                        slot_ = slot;
+                        return {payloads[ slot ], false};
+                    }
+                }
+            }
+
+        private:
+            static std::size_t capacity_for( std::size_t expected )
+            {
+                std::size_t capacity = 16;
+                while ( capacity < 2 * expected )
+                {
+                    capacity *= 2;
+                }
+                return capacity;
+            }
+
+            void rehash( std::size_t capacity )
+            {
+                vector<Key, std::uint32_t> old;
+                old.swap( slots_ );
+
+                slots_.resize( capacity );
+                std::fill( slots_.template data<1>(), slots_.template data<1>() + capacity, empty );
+                mask_ = capacity - 1;
+                size_ = 0;
+
+                for ( std::size_t slot = 0; slot < old.size(); ++slot )
+                {
+                    if ( old.template get<1>( slot ) != empty )
+                    {
+                        const Key & key = old.template get<0>( slot );
+                        insert( key, hash_key( key ), old.template get<1>( slot ) );
+                    }
+                }
+            }
+
+            vector<Key, std::uint32_t> slots_;
+            std::size_t mask_ = 0;
+            std::size_t size_ = 0;
+            std::size_t slot_ = 0; // slot of the last key insert found already present
+        };
+
+        template <typename Key>
+        constexpr std::uint32_t hash_table<Key>::empty;
+    }
+
+    // Aggregate functions for grouping::aggregate.
+    namespace agg
+    {
+        struct sum_t
+        {
+            template <typename T>
+            using result_type = T;
+
+            template <typename T>
+            static T identity()
+            {
+                return T();
+            }
+
+            template <typename T>
+            static void update( T & accumulator, T value )
+            {
+                accumulator = static_cast<T>( accumulator + value );
+            }
+        };
+
+        struct count_t
+        {
+            template <typename T>
+            using result_type = std::uint64_t;
+
+            template <typename T>
+            static std::uint64_t identity()
+            {
+                return 0;
+            }
+
+            template <typename T>
+            static void update( std::uint64_t & accumulator, T )
+            {
+                ++accumulator;
+            }
+        };
+
+        struct min_t
+        {
+            template <typename T>
+            using result_type = T;
+
+            template <typename T>
+            static T identity()
+            {
+                return detail::highest_identity<T>();
+            }
+
+            template <typename T>
+            static void update( T & accumulator, T value )
+            {
+                accumulator = value < accumulator ? value : accumulator;
+            }
+        };
+
+        struct max_t
+        {
+            template <typename T>
+            using result_type = T;
+
+            template <typename T>
+            static T identity()
+            {
+                return detail::lowest_identity<T>();
+            }
+
+            template <typename T>
+            static void update( T & accumulator, T value )
+            {
+                accumulator = accumulator < value ? value : accumulator;
+            }
+        };
+
+        constexpr sum_t sum{};
+        constexpr count_t count{};
+        constexpr min_t min{};
+        constexpr max_t max{};
+    }
+
+    // Result of group_by: aggregates columns of the source container per distinct value of column Key.
+    template <std::size_t Key, typename Vector>
+    class grouping
+    {
+    public:
+        using key_type = column_type_t<Key, Vector>;
+
+        explicit grouping( const Vector & v )
+            : source_( &v )
+        {
+        }
+
+        // Returns a table with one row per distinct key, in order of first appearance: the key followed by one
+        // column per aggregate of column Column, e.g. aggregate<2>( agg::sum, agg::count ).
+        template <std::size_t Column, typename... Aggregates>
+        vector<key_type, typename Aggregates::template result_type<column_type_t<Column, Vector>>...> aggregate(
+            Aggregates... ) const
+        {
+            using value_type = column_type_t<Column, Vector>;
+            using result_type = vector<key_type, typename Aggregates::template result_type<value_type>...>;
+            using updates = std::index_sequence_for<Aggregates...>;
+
+            const key_type * keys = source_->template data<Key>();
+            const value_type * values = source_->template data<Column>();
+            const std::size_t size = source_->size();
+
+            result_type result;
+            detail::hash_table<key_type> table;
+            std::uint64_t hashes[ detail::hash_batch_size ];
+
+            for ( std::size_t base = 0; base < size; base += detail::hash_batch_size )
+            {
+                const std::size_t count = std::min( detail::hash_batch_size, size - base );
+                for ( std::size_t i = 0; i < count; ++i )
+                {
+                    hashes[ i ] = detail::hash_key( keys[ base + i ] );
+                    table.prefetch( hashes[ i ] );
+                }
+                for ( std::size_t i = 0; i < count; ++i )
+                {
+                    const auto group = static_cast<std::uint32_t>( result.size() );
+                    const auto found = table.insert( keys[ base + i ], hashes[ i ], group );
+                    if ( found.second )
+                    {
+                        result.push_back( keys[ base + i ], Aggregates::template identity<value_type>()... );
+                    }
+                    update<Aggregates...>( result, found.first, values[ base + i ], updates{} );
+                }
+            }
+            return result;
+        }
+
+    private:
+        template <typename... Aggregates, typename Result, typename T, std::size_t... Is>
+        static void update( Result & result, std::size_t group, T value, std::index_sequence<Is...> )
+        {
+            using swallow = int[];
+            (void)swallow{0, ( Aggregates::update( result.template get<Is + 1>( group ), value ), 0 )...};
+        }
+
+        const Vector * source_;
+    };
+
+    // Groups the rows of v by column Key: soa::group_by<0>( trades ).aggregate<2>( soa::agg::sum, soa::agg::max ).
+    template <std::size_t Key, typename Vector>
+    grouping<Key, Vector> group_by( const Vector & v )
+    {
+        return grouping<Key, Vector>( v );
+    }
+
+    // Joins
+
+    // Matching (left row, right row) pairs produced by the join operators.
+    using join_pairs = vector<std::uint32_t, std::uint32_t>;
+
+    namespace detail
+    {
+        // Size of the build side hash table each radix partition should fit in, roughly a per-core L2.
+        constexpr std::size_t join_partition_bytes = 256 * 1024;
+
+        // Joins two key arrays with a hash table on the build side. build_rows/probe_rows translate positions into
+        // source row ids; nullptr means position == row id. Matches are emitted per probe row, build rows ascending.
+        template <typename Key>
+        void hash_join_into( const Key * build_keys,
+                             const std::uint32_t * build_rows,
+                             std::size_t build_size,
+                             const Key * probe_keys,
+                             const std::uint32_t * probe_rows,
+                             std::size_t probe_size,
+                             bool build_is_left,
+                             join_pairs & out )
+        {
+            assert( build_size < hash_table<Key>::empty );
+
+            // Rows sharing a key are chained through next, starting from the payload stored in the table.
+            hash_table<Key> table( build_size );
+            std::vector<std::uint32_t> next( build_size );
+            for ( std::size_t i = build_size; i-- > 0; )
+            {
+                next[ i ] = table.exchange( build_keys[ i ], hash_key( build_keys[ i ] ), std::uint32_t( i ) );
+            }
+
+            std::uint64_t hashes[ hash_batch_size ];
+            for ( std::size_t base = 0; base < probe_size; base += hash_batch_size )
+            {
+                const std::size_t count = std::min( hash_batch_size, probe_size - base );
+                for ( std::size_t i = 0; i < count; ++i )
+                {
+                    hashes[ i ] = hash_key( probe_keys[ base + i ] );
+                    table.prefetch( hashes[ i ] );
+                }
+                for ( std::size_t i = 0; i < count; ++i )
+                {
+                    const std::size_t position = base + i;
+                    const auto probe_row = probe_rows ? probe_rows[ position ] : std::uint32_t( position );
+                    for ( auto match = table.find( probe_keys[ position ], hashes[ i ] );
+                          match != hash_table<Key>::empty;
+                          match = next[ match ] )
+                    {
+                        const auto build_row = build_rows ? build_rows[ match ] : match;
+                        if ( build_is_left )
+                        {
+                            out.push_back( build_row, probe_row );
+                        }
+                        else
+                        {
+                            out.push_back( probe_row, build_row );
+                        }
+                    }
+                }
+            }
+        }
+
+        // Scatters (key, row id) into 2^bits partitions on the top hash bits. offsets receives 2^bits + 1 bounds.
+        template <typename Key>
+        void radix_partition( const Key * keys,
+                              std::size_t size,
+                              unsigned bits,
+                              vector<Key, std::uint32_t> & partitioned,
+                              std::vector<std::size_t> & offsets )
+        {
+            const std::size_t partitions = std::size_t( 1 ) << bits;
+            const auto partition_of = [bits]( const Key & key ) {
+                return bits == 0 ? std::size_t( 0 ) : std::size_t( hash_key( key ) >> ( 64 - bits ) );
+            };
+
+            std::vector<std::uint32_t> partition( size );
+            offsets.assign( partitions + 1, 0 );
+            for ( std::size_t i = 0; i < size; ++i )
+            {
+                partition[ i ] = std::uint32_t( partition_of( keys[ i ] ) );
+                ++offsets[ partition[ i ] + 1 ];
+            }
+            for ( std::size_t p = 0; p < partitions; ++p )
+            {
+                offsets[ p + 1 ] += offsets[ p ];
+            }
+
+            std::vector<std::size_t> cursor( offsets.begin(), offsets.end() - 1 );
+            partitioned.resize( size );
+            Key * out_keys = partitioned.template data<0>();
+            std::uint32_t * out_rows = partitioned.template data<1>();
+            for ( std::size_t i = 0; i < size; ++i )
+            {
+                const std::size_t position = cursor[ partition[ i ] ]++;
+                out_keys[ position ] = keys[ i ];
+                out_rows[ position ] = std::uint32_t( i );
+            }
+        }
+    }
+
+    // Equi-join of left column LeftKey with right column RightKey. The hash table is built on the smaller side and
+    // the larger one probes it in prefetched batches. Gather output columns with take() on the returned rows.
+    template <std::size_t LeftKey, std::size_t RightKey, typename Left, typename Right>
+    join_pairs hash_join( const Left & left, const Right & right )
+    {
+        using key_type = column_type_t<LeftKey, Left>;
+        static_assert( std::is_same<key_type, column_type_t<RightKey, Right>>::value,
+                       "join keys must have the same type" );
+
+        const key_type * left_keys = left.template data<LeftKey>();
+        const key_type * right_keys = right.template data<RightKey>();
+
+        join_pairs result;
+        if ( left.size() <= right.size() )
+        {
+            detail::hash_join_into( left_keys, nullptr, left.size(), right_keys, nullptr, right.size(), true, result );
+        }
+        else
+        {
+            detail::hash_join_into( right_keys, nullptr, right.size(), left_keys, nullptr, left.size(), false, result );
+        }
+        return result;
+    }
+
+    // hash_join for build sides that do not fit in cache: both key columns are first radix partitioned on their
+    // hash so each partition's hash table fits in cache_bytes, then partitions are joined independently on up to
+    // `threads` threads. Output is concatenated in partition order, so it does not depend on the thread count.
+    template <std::size_t LeftKey, std::size_t RightKey, typename Left, typename Right>
+    join_pairs radix_hash_join( const Left & left,
+                                const Right & right,
+                                unsigned threads = 1,
+                                std::size_t cache_bytes = detail::join_partition_bytes )
+    {
+        using key_type = column_type_t<LeftKey, Left>;
+        static_assert( std::is_same<key_type, column_type_t<RightKey, Right>>::value,
+                       "join keys must have the same type" );
+
+        const bool build_is_left = left.size() <= right.size();
+        const std::size_t build_size = std::min( left.size(), right.size() );
+
+        // Hash table slots are kept at most half full.
+        const std::size_t build_bytes = 2 * build_size * ( sizeof( key_type ) + sizeof( std::uint32_t ) );
+        unsigned bits = 0;
+        while ( bits < 16 && ( build_bytes >> bits ) > cache_bytes )
+        {
+            ++bits;
+        }
+
+        vector<key_type, std::uint32_t> left_parts;
+        vector<key_type, std::uint32_t> right_parts;
+        std::vector<std::size_t> left_offsets;
+        std::vector<std::size_t> right_offsets;
+        detail::radix_partition( left.template data<LeftKey>(), left.size(), bits, left_parts, left_offsets );
+        detail::radix_partition( right.template data<RightKey>(), right.size(), bits, right_parts, right_offsets );
+
+        const auto & build = build_is_left ? left_parts : right_parts;
+        const auto & probe = build_is_left ? right_parts : left_parts;
+        const auto & build_offsets = build_is_left ? left_offsets : right_offsets;
+        const auto & probe_offsets = build_is_left ? right_offsets : left_offsets;
+
+        std::vector<join_pairs> matches( std::size_t( 1 ) << bits );
+        detail::parallel_for_blocks( matches.size(), threads, [&]( std::size_t p ) {
+            const std::size_t build_begin = build_offsets[ p ];
+            const std::size_t probe_begin = probe_offsets[ p ];
+            detail::hash_join_into( build.template data<0>() + build_begin,
+                                    build.template data<1>() + build_begin,
+                                    build_offsets[ p + 1 ] - build_begin,
+                                    probe.template data<0>() + probe_begin,
+                                    probe.template data<1>() + probe_begin,
+                                    probe_offsets[ p + 1 ] - probe_begin,
+                                    build_is_left,
+                                    matches[ p ] );
+        } );
+
+        join_pairs result;
+        std::size_t total = 0;
+        for ( const auto & part : matches )
+        {
+            total += part.size();
+        }
+        result.reserve( total );
+        for ( const auto & part : matches )
+        {
+            result.append( part );
+        }
+        return result;
+    }
+
+    // Merging of sorted tables
+
+    namespace detail
+    {
+        // Minimum number of output rows per merge path segment before another thread is worth spawning.
+        constexpr std::size_t merge_segment_size = 16 * 1024;
+
+        // Number of rows of a preceding output position `diagonal` in the stable merge of a and b (ties from a
+        // first). This is the merge path split: segments cut at different diagonals can be merged independently.
+        template <typename T>
+        std::size_t merge_path_split( const T * a,
+                                      std::size_t a_size,
+                                      const T * b,
+                                      std::size_t b_size,
+                                      std::size_t diagonal )
+        {
+            std::size_t low = diagonal > b_size ? diagonal - b_size : 0;
+            std::size_t high = std::min( diagonal, a_size );
+            while ( low < high )
+            {
+                const std::size_t mid = low + ( high - low ) / 2;
+                if ( b[ diagonal - mid - 1 ] < a[ mid ] )
+                {
+                    high = mid;
+                }
+                else
+                {
+                    low = mid + 1;
+                }
+            }
+            return low;
+        }
+    }
+
+    // Stable merge of two tables sorted on column Key into a new sorted table carrying every column. The merge
+    // order is decided once on the key column, then each column is written in its own linear pass. With several
+    // threads the output is cut into merge path segments that are merged independently.
+    template <std::size_t Key = 0, typename... Ts>
+    vector<Ts...> merge( const vector<Ts...> & a, const vector<Ts...> & b, unsigned threads = 1 )
+    {
+        using key_type = typename vector<Ts...>::template column_type<Key>;
+        const key_type * a_keys = a.template data<Key>();
+        const key_type * b_keys = b.template data<Key>();
+        assert( std::is_sorted( a_keys, a_keys + a.size() ) );
+        assert( std::is_sorted( b_keys, b_keys + b.size() ) );
+
+        const std::size_t size = a.size() + b.size();
+        vector<Ts...> result( size );
+
+        const std::size_t segments =
+            std::max<std::size_t>( 1, std::min<std::size_t>( threads, size / detail::merge_segment_size ) );
+        detail::parallel_for_blocks( segments, threads, [&]( std::size_t segment ) {
+            const std::size_t begin = size * segment / segments;
+            const std::size_t end = size * ( segment + 1 ) / segments;
+            const std::size_t a_begin = detail::merge_path_split( a_keys, a.size(), b_keys, b.size(), begin );
+            const std::size_t a_end = detail::merge_path_split( a_keys, a.size(), b_keys, b.size(), end );
+            const std::size_t b_begin = begin - a_begin;
+
+            std::vector<unsigned char> from_b( end - begin );
+            for ( std::size_t k = 0, i = a_begin, j = b_begin; k < from_b.size(); ++k )
+            {
+                const bool take_b = i == a_end || ( j < b.size() && b_keys[ j ] < a_keys[ i ] );
+                from_b[ k ] = take_b;
+                i += !take_b;
+                j += take_b;
+            }
+
+            detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                const auto * a_column = a.template data<I>();
+                const auto * b_column = b.template data<I>();
+                auto * out = result.template data<I>() + begin;
+                for ( std::size_t k = 0, i = a_begin, j = b_begin; k < from_b.size(); ++k )
+                {
+                    out[ k ] = from_b[ k ] ? b_column[ j++ ] : a_column[ i++ ];
+                }
+            } );
+        } );
+        return result;
+    }
+
+    // Equi-join of two tables sorted on their key columns in a single linear pass. Every pair of rows with equal
+    // keys is emitted, ordered by left row then right row.
+    template <std::size_t LeftKey, std::size_t RightKey, typename Left, typename Right>
+    join_pairs merge_join( const Left & left, const Right & right )
+    {
+        using key_type = column_type_t<LeftKey, Left>;
+        static_assert( std::is_same<key_type, column_type_t<RightKey, Right>>::value,
+                       "join keys must have the same type" );
+
+        const key_type * left_keys = left.template data<LeftKey>();
+        const key_type * right_keys = right.template data<RightKey>();
+        assert( std::is_sorted( left_keys, left_keys + left.size() ) );
+        assert( std::is_sorted( right_keys, right_keys + right.size() ) );
+
+        join_pairs result;
+        std::size_t i = 0;
+        std::size_t j = 0;
+        while ( i < left.size() && j < right.size() )
+        {
+            if ( left_keys[ i ] < right_keys[ j ] )
+            {
+                ++i;
+            }
+            else if ( right_keys[ j ] < left_keys[ i ] )
+            {
+                ++j;
+            }
+            else
+            {
+                std::size_t right_end = j + 1;
+                while ( right_end < right.size() && !( right_keys[ j ] < right_keys[ right_end ] ) )
+                {
+                    ++right_end;
+                }
+                for ( ; i < left.size() && !( right_keys[ j ] < left_keys[ i ] ); ++i )
+                {
+                    for ( std::size_t r = j; r < right_end; ++r )
+                    {
+                        result.push_back( std::uint32_t( i ), std::uint32_t( r ) );
+                    }
+                }
+                j = right_end;
+            }
+        }
+        return result;
+    }
+
+    // Gather and scatter
+
+    namespace detail
+    {
+        // Indices handled per column before moving on to the next one: small enough for the index block to stay in
+        // L1 while every column is processed.
+        constexpr std::size_t gather_block = 2048;
+        // How many indices ahead the target cache line is prefetched.
+        constexpr std::size_t gather_prefetch_distance = 16;
+
+#if defined( __AVX2__ )
+        // Hardware gathers of 8 4-byte or 4 8-byte values; indices are sign-extended, so src must have fewer than
+        // 2^31 rows. Returns the number of values gathered.
+        template <typename T>
+        std::size_t gather_vector( const T * src, const std::uint32_t * indices, std::size_t count, T * dst )
+        {
+            constexpr std::size_t lanes = sizeof( T ) == 4 ? 8 : 4;
+            std::size_t i = 0;
+            for ( ; i + lanes <= count; i += lanes )
+            {
+                const std::size_t ahead = std::min( count, i + gather_prefetch_distance + lanes );
+                for ( std::size_t j = i + gather_prefetch_distance; j < ahead; ++j )
+                {
+                    prefetch( src + indices[ j ] );
+                }
+                if ( sizeof( T ) == 4 )
+                {
+                    const __m256i index = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( indices + i ) );
+                    const __m256i values = _mm256_i32gather_epi32( reinterpret_cast<const int *>( src ), index, 4 );
+                    _mm256_storeu_si256( reinterpret_cast<__m256i *>( dst + i ), values );
+                }
+                else
+                {
+                    const __m128i index = _mm_loadu_si128( reinterpret_cast<const __m128i *>( indices + i ) );
+                    const __m256i values =
+                        _mm256_i32gather_epi64( reinterpret_cast<const long long *>( src ), index, 8 );
+                    _mm256_storeu_si256( reinterpret_cast<__m256i *>( dst + i ), values );
+                }
+            }
+            return i;
+        }
+#endif
+
+        // dst[ i ] = src[ indices[ i ] ] for i in [0, count), prefetching source lines a few indices ahead.
+        template <typename T>
+        void gather_column(
+            const T * src, std::size_t src_size, const std::uint32_t * indices, std::size_t count, T * dst )
+        {
+            static_cast<void>( src_size );
+            for ( std::size_t i = 0; i < std::min( count, gather_prefetch_distance ); ++i )
+            {
+                prefetch( src + indices[ i ] );
+            }
+            std::size_t i = 0;
+#if defined( __AVX2__ )
+            if ( ( sizeof( T ) == 4 || sizeof( T ) == 8 ) &&
+                 src_size <= std::size_t( std::numeric_limits<std::int32_t>::max() ) )
+            {
+                i = gather_vector( src, indices, count, dst );
+            }
+#endif
+            for ( ; i < count; ++i )
+            {
+                assert( indices[ i ] < src_size );
+                if ( i + gather_prefetch_distance < count )
+                {
+                    prefetch( src + indices[ i + gather_prefetch_distance ] );
+                }
+                dst[ i ] = src[ indices[ i ] ];
+            }
+        }
+
+        // dst[ indices[ i ] ] = src[ i ] for i in [0, count).
+        template <typename T>
+        void scatter_column(
+            const T * src, const std::uint32_t * indices, std::size_t count, T * dst, std::size_t dst_size )
+        {
+            static_cast<void>( dst_size );
+            for ( std::size_t i = 0; i < count; ++i )
+            {
+                assert( indices[ i ] < dst_size );
+                if ( i + gather_prefetch_distance < count )
+                {
+                    prefetch( dst + indices[ i + gather_prefetch_distance ] );
+                }
+                dst[ indices[ i ] ] = src[ i ];
+            }
+        }
+
+        // Calls f( column, begin, size ) for every column of every block of gather_block indices, block by block.
+        template <std::size_t Columns, typename F>
+        void for_each_index_block( std::size_t count, F f )
+        {
+            for ( std::size_t begin = 0; begin < count; begin += gather_block )
+            {
+                const std::size_t size = std::min( gather_block, count - begin );
+                for_each_index<Columns>( [&]( auto column ) { f( column, begin, size ); } );
+            }
+        }
+    }
+
+    // Replaces the content of dst with the rows of src at indices: column k of dst is gathered from column Is[ k ]
+    // of src. Work is done column by column over blocks of indices, so each pass streams one source column and the
+    // indices stay cached, instead of touching every column for every row.
+    template <std::size_t I0, std::size_t... Is, typename Vector, typename... Ts>
+    void gather( const Vector & src, span<const std::uint32_t> indices, vector<Ts...> & dst )
+    {
+        static_assert( sizeof...( Ts ) == 1 + sizeof...( Is ), "dst needs one column per gathered column" );
+        dst.resize( indices.size() );
+        const auto block = [&]( auto column, std::size_t begin, std::size_t size ) {
+            constexpr std::size_t I = decltype( column )::value;
+            constexpr std::size_t source_columns[] = {I0, Is...};
+            detail::gather_column( src.template data<source_columns[ I ]>(),
+                                   src.size(),
+                                   indices.data() + begin,
+                                   size,
+                                   dst.template data<I>() + begin );
+        };
+        detail::for_each_index_block<sizeof...( Ts )>( indices.size(), block );
+    }
+
+    // Replaces the content of dst with the rows of src at indices, every column.
+    template <typename... Ts>
+    void gather( const vector<Ts...> & src, span<const std::uint32_t> indices, vector<Ts...> & dst )
+    {
+        dst.resize( indices.size() );
+        const auto block = [&]( auto column, std::size_t begin, std::size_t size ) {
+            constexpr std::size_t I = decltype( column )::value;
+            detail::gather_column(
+                src.template data<I>(), src.size(), indices.data() + begin, size, dst.template data<I>() + begin );
+        };
+        detail::for_each_index_block<sizeof...( Ts )>( indices.size(), block );
+    }
+
+    // Writes row i of src to row indices[ i ] of dst: column k of src goes to column Is[ k ] of dst. When indices
+    // repeat a row, the last write wins.
+    template <std::size_t I0, std::size_t... Is, typename... Ts, typename... Us>
+    void scatter( const vector<Ts...> & src, span<const std::uint32_t> indices, vector<Us...> & dst )
+    {
+        static_assert( sizeof...( Ts ) == 1 + sizeof...( Is ), "src needs one column per scattered column" );
+        assert( indices.size() == src.size() );
+        const auto block = [&]( auto column, std::size_t begin, std::size_t size ) {
+            constexpr std::size_t I = decltype( column )::value;
+            constexpr std::size_t target_columns[] = {I0, Is...};
+            detail::scatter_column( src.template data<I>() + begin,
+                                    indices.data() + begin,
+                                    size,
+                                    dst.template data<target_columns[ I ]>(),
+                                    dst.size() );
+        };
+        detail::for_each_index_block<sizeof...( Ts )>( indices.size(), block );
+    }
+
+    // Writes row i of src to row indices[ i ] of dst, every column.
+    template <typename... Ts>
+    void scatter( const vector<Ts...> & src, span<const std::uint32_t> indices, vector<Ts...> & dst )
+    {
+        assert( indices.size() == src.size() );
+        const auto block = [&]( auto column, std::size_t begin, std::size_t size ) {
+            constexpr std::size_t I = decltype( column )::value;
+            detail::scatter_column(
+                src.template data<I>() + begin, indices.data() + begin, size, dst.template data<I>(), dst.size() );
+        };
+        detail::for_each_index_block<sizeof...( Ts )>( indices.size(), block );
+    }
+
+    // Returns a new table made of columns Is of v, taken at the given rows.
+    template <std::size_t... Is, typename Vector>
+    vector<column_type_t<Is, Vector>...> take( const Vector & v, span<const std::uint32_t> rows )
+    {
+        vector<column_type_t<Is, Vector>...> result( rows.size() );
+        detail::for_each_index<sizeof...( Is )>( [&]( auto column ) {
+            constexpr std::size_t I = decltype( column )::value;
+            constexpr std::size_t source_columns[] = {Is...};
+            detail::gather_column( v.template data<source_columns[ I ]>(),
+                                   v.size(),
+                                   rows.data(),
+                                   rows.size(),
+                                   result.template data<I>() );
+        } );
+        return result;
+    }
+
+    // Selections
+
+    namespace detail
+    {
+        inline unsigned popcount( std::uint64_t word )
+        {
+#if defined( __GNUC__ ) || defined( __clang__ )
+            return unsigned( __builtin_popcountll( word ) );
+#else
+            unsigned count = 0;
+            for ( ; word != 0; word &= word - 1 )
+            {
+                ++count;
+            }
+            return count;
+#endif
+        }
+
+        inline unsigned count_trailing_zeros( std::uint64_t word )
+        {
+            assert( word != 0 );
+#if defined( __GNUC__ ) || defined( __clang__ )
+            return unsigned( __builtin_ctzll( word ) );
+#else
+            unsigned count = 0;
+            for ( ; ( word & 1 ) == 0; word >>= 1 )
+            {
+                ++count;
+            }
+            return count;
+#endif
+        }
+
+        inline unsigned count_leading_zeros( std::uint64_t word )
+        {
+            assert( word != 0 );
+#if defined( __GNUC__ ) || defined( __clang__ )
+            return unsigned( __builtin_clzll( word ) );
+#else
+            unsigned count = 0;
+            for ( ; ( word >> 63 ) == 0; word <<= 1 )
+            {
+                ++count;
+            }
+            return count;
+#endif
+        }
+    }
+
+    // Set of selected rows of a table, produced by filters and consumed by later operators so that columns are only
+    // gathered once, at the end of a pipeline. Stored as ascending row ids when sparse and as a bitmask over
+    // [0, universe) when dense; operators pick whichever is smaller.
+    //
+    //     auto selected = soa::filter<2>( orders, []( double price ) { return price > 100.0; } );
+    //     selected = soa::filter<1>( orders, selected, []( int side ) { return side == 1; } );
+    //     auto result = soa::take<0, 2>( orders, selected );
+    class selection
+    {
+    public:
+        selection() = default;
+
+        // Ascending, distinct row ids within [0, universe).
+        selection( std::vector<std::uint32_t> rows, std::size_t universe )
+            : rows_( std::move( rows ) )
+            , universe_( universe )
+        {
+            assert( std::is_sorted( rows_.begin(), rows_.end() ) );
+            assert( rows_.empty() || rows_.back() < universe_ );
+        }
+
+        // Every row of [0, universe).
+        static selection all( std::size_t universe )
+        {
+            std::vector<std::uint64_t> words( word_count( universe ), ~std::uint64_t( 0 ) );
+            if ( universe % 64 != 0 )
+            {
+                words.back() = ( std::uint64_t( 1 ) << ( universe % 64 ) ) - 1;
+            }
+            return from_mask( std::move( words ), universe );
+        }
+
+        // Bit i of word i / 64 selects row i; bits at or past universe must be clear.
+        static selection from_mask( std::vector<std::uint64_t> words, std::size_t universe )
+        {
+            assert( words.size() == word_count( universe ) );
+            selection result;
+            result.mask_ = std::move( words );
+            result.universe_ = universe;
+            result.is_mask_ = true;
+            for ( const auto word : result.mask_ )
+            {
+                result.size_ += detail::popcount( word );
+            }
+            return result;
+        }
+
+        bool is_mask() const
+        {
+            return is_mask_;
+        }
+
+        // Number of rows of the table the selection applies to.
+        std::size_t universe() const
+        {
+            return universe_;
+        }
+
+        // Number of selected rows.
+        std::size_t size() const
+        {
+            return is_mask_ ? size_ : rows_.size();
+        }
+
+        bool empty() const
+        {
+            return size() == 0;
+        }
+
+        bool contains( std::uint32_t row ) const
+        {
+            if ( is_mask_ )
+            {
+                return row < universe_ && ( ( mask_[ row / 64 ] >> ( row % 64 ) ) & 1 );
+            }
+            return std::binary_search( rows_.begin(), rows_.end(), row );
+        }
+
+        // Selected row ids; only valid when !is_mask().
+        span<const std::uint32_t> rows() const
+        {
+            assert( !is_mask_ );
+            return rows_;
+        }
+
+        // Selection bitmask; only valid when is_mask().
+        span<const std::uint64_t> mask() const
+        {
+            assert( is_mask_ );
+            return mask_;
+        }
+
+        selection & to_rows()
+        {
+            if ( is_mask_ )
+            {
+                std::vector<std::uint32_t> rows;
+                rows.reserve( size_ );
+                for_each( [&rows]( std::uint32_t row ) { rows.push_back( row ); } );
+                *this = selection( std::move( rows ), universe_ );
+            }
+            return *this;
+        }
+
+        selection & to_mask()
+        {
+            if ( !is_mask_ )
+            {
+                std::vector<std::uint64_t> words( word_count( universe_ ) );
+                for ( const auto row : rows_ )
+                {
+                    words[ row / 64 ] |= std::uint64_t( 1 ) << ( row % 64 );
+                }
+                *this = from_mask( std::move( words ), universe_ );
+            }
+            return *this;
+        }
+
+        // Switches to row ids when fewer than one row in 32 is selected, where they take less room than the mask.
+        selection & compact()
+        {
+            return size() * 32 < universe_ ? to_rows() : to_mask();
+        }
+
+        // Calls f( row ) for every selected row, ascending.
+        template <typename F>
+        void for_each( F f ) const
+        {
+            if ( !is_mask_ )
+            {
+                for ( const auto row : rows_ )
+                {
+                    f( row );
+                }
+                return;
+            }
+            for ( std::size_t w = 0; w < mask_.size(); ++w )
+            {
+                for ( std::uint64_t word = mask_[ w ]; word != 0; word &= word - 1 )
+                {
+                    f( std::uint32_t( w * 64 + detail::count_trailing_zeros( word ) ) );
+                }
+            }
+        }
+
+        friend selection operator&( const selection & a, const selection & b )
+        {
+            assert( a.universe_ == b.universe_ );
+            if ( !a.is_mask_ || !b.is_mask_ )
+            {
+                const selection & rows = a.is_mask_ ? b : a;
+                const selection & other = a.is_mask_ ? a : b;
+                std::vector<std::uint32_t> result;
+                for ( const auto row : rows.rows_ )
+                {
+                    if ( other.contains( row ) )
+                    {
+                        result.push_back( row );
+                    }
+                }
+                return selection( std::move( result ), a.universe_ );
+            }
+            std::vector<std::uint64_t> words( a.mask_.size() );
+            for ( std::size_t w = 0; w < words.size(); ++w )
+            {
+                words[ w ] = a.mask_[ w ] & b.mask_[ w ];
+            }
+            return from_mask( std::move( words ), a.universe_ ).compact();
+        }
+
+        friend selection operator|( const selection & a, const selection & b )
+        {
+            assert( a.universe_ == b.universe_ );
+            if ( !a.is_mask_ && !b.is_mask_ )
+            {
+                std::vector<std::uint32_t> result;
+                std::set_union(
+                    a.rows_.begin(), a.rows_.end(), b.rows_.begin(), b.rows_.end(), std::back_inserter( result ) );
+                return selection( std::move( result ), a.universe_ ).compact();
+            }
+            selection result = a;
+            result.to_mask();
+            b.for_each( [&result]( std::uint32_t row ) {
+                result.mask_[ row / 64 ] |= std::uint64_t( 1 ) << ( row % 64 );
+            } );
+            return from_mask( std::move( result.mask_ ), a.universe_ ).compact();
+        }
+
+    private:
+        static std::size_t word_count( std::size_t universe )
+        {
+            return ( universe + 63 ) / 64;
+        }
+
+        std::vector<std::uint32_t> rows_;
+        std::vector<std::uint64_t> mask_;
+        std::size_t universe_ = 0;
+        std::size_t size_ = 0; // selected rows, when a mask
+        bool is_mask_ = false;
+    };
+
+    // Rows of v whose column I satisfies pred. The predicate is evaluated branch-free 64 rows at a time into a
+    // bitmask, which is kept as is or turned into row ids depending on the selectivity.
+    template <std::size_t I, typename Vector, typename Predicate>
+    selection filter( const Vector & v, Predicate pred )
+    {
+        const auto * column = v.template data<I>();
+        const std::size_t size = v.size();
+        std::vector<std::uint64_t> words( ( size + 63 ) / 64 );
+        for ( std::size_t w = 0; w < words.size(); ++w )
+        {
+            const std::size_t begin = w * 64;
+            const std::size_t count = std::min<std::size_t>( 64, size - begin );
+            std::uint64_t word = 0;
+            for ( std::size_t bit = 0; bit < count; ++bit )
+            {
+                word |= std::uint64_t( bool( pred( column[ begin + bit ] ) ) ) << bit;
+            }
+            words[ w ] = word;
+        }
+        return selection::from_mask( std::move( words ), size ).compact();
+    }
+
+    // Rows of selected whose column I also satisfies pred. Only selected rows are read.
+    template <std::size_t I, typename Vector, typename Predicate>
+    selection filter( const Vector & v, const selection & selected, Predicate pred )
+    {
+        assert( selected.universe() == v.size() );
+        const auto * column = v.template data<I>();
+        if ( !selected.is_mask() )
+        {
+            std::vector<std::uint32_t> rows;
+            for ( const auto row : selected.rows() )
+            {
+                if ( pred( column[ row ] ) )
+                {
+                    rows.push_back( row );
+                }
+            }
+            return selection( std::move( rows ), v.size() );
+        }
+
+        const auto mask = selected.mask();
+        std::vector<std::uint64_t> words( mask.size() );
+        for ( std::size_t w = 0; w < words.size(); ++w )
+        {
+            std::uint64_t word = 0;
+            for ( std::uint64_t bits = mask[ w ]; bits != 0; bits &= bits - 1 )
+            {
+                const unsigned bit = detail::count_trailing_zeros( bits );
+                word |= std::uint64_t( bool( pred( column[ w * 64 + bit ] ) ) ) << bit;
+            }
+            words[ w ] = word;
+        }
+        return selection::from_mask( std::move( words ), v.size() ).compact();
+    }
+
+    // Materializes columns Is of the selected rows, one column at a time.
+    template <std::size_t... Is, typename Vector>
+    vector<column_type_t<Is, Vector>...> take( const Vector & v, const selection & selected )
+    {
+        assert( selected.universe() == v.size() );
+        if ( !selected.is_mask() )
+        {
+            return take<Is...>( v, selected.rows() );
+        }
+
+        vector<column_type_t<Is, Vector>...> result( selected.size() );
+        detail::for_each_index<sizeof...( Is )>( [&]( auto column ) {
+            constexpr std::size_t I = decltype( column )::value;
+            constexpr std::size_t source_columns[] = {Is...};
+            const auto * src = v.template data<source_columns[ I ]>();
+            auto * dst = result.template data<I>();
+            selected.for_each( [&]( std::uint32_t row ) { *dst++ = src[ row ]; } );
+        } );
+        return result;
+    }
+
+    // Zone maps
+
+    // Per-block min/max summary of column I of an append-only table. update() folds rows appended since the last
+    // call into the summaries, touching only the new rows. Range filters skip every block whose [min, max] does not
+    // intersect the queried range and copy blocks that lie entirely inside it without comparing rows.
+    //
+    //     auto zones = soa::make_zone_map<0>( ticks );
+    //     ticks.push_back( ... );
+    //     zones.update( ticks );
+    //     auto rows = zones.filter( ticks, from, to );
+    template <std::size_t I, typename Vector>
+    class zone_map
+    {
+    public:
+        using value_type = column_type_t<I, Vector>;
+
+        static constexpr std::size_t default_block_size = 4096;
+
+        explicit zone_map( std::size_t block_size = default_block_size )
+            : block_size_( block_size )
+        {
+            assert( block_size_ > 0 );
+        }
+
+        std::size_t block_size() const
+        {
+            return block_size_;
+        }
+
+        std::size_t block_count() const
+        {
+            return zones_.size();
+        }
+
+        // Number of rows covered by the summaries.
+        std::size_t rows() const
+        {
+            return rows_;
+        }
+
+        value_type min( std::size_t block ) const
+        {
+            return zones_.template get<0>( block );
+        }
+
+        value_type max( std::size_t block ) const
+        {
+            return zones_.template get<1>( block );
+        }
+
+        // Extends the summaries to rows appended to v since the last update. Rebuilds when v shrank.
+        void update( const Vector & v )
+        {
+            if ( v.size() < rows_ )
+            {
+                rebuild( v );
+                return;
+            }
+
+            const value_type * column = v.template data<I>();
+            for ( ; rows_ < v.size(); )
+            {
+                const std::size_t block = rows_ / block_size_;
+                const std::size_t end = std::min( v.size(), ( block + 1 ) * block_size_ );
+                if ( block == zones_.size() )
+                {
+                    zones_.push_back( column[ rows_ ], column[ rows_ ] );
+                }
+
+                value_type low = zones_.template get<0>( block );
+                value_type high = zones_.template get<1>( block );
+                for ( std::size_t row = rows_; row < end; ++row )
+                {
+                    low = column[ row ] < low ? column[ row ] : low;
+                    high = high < column[ row ] ? column[ row ] : high;
+                }
+                zones_.template get<0>( block ) = low;
+                zones_.template get<1>( block ) = high;
+                rows_ = end;
+            }
+        }
+
+        // Recomputes every summary, e.g. after rows were modified in place.
+        void rebuild( const Vector & v )
+        {
+            zones_.clear();
+            rows_ = 0;
+            update( v );
+        }
+
+        // Calls f( begin, end, contained ) for every block that may hold values in [low, high]. contained is true
+        // when every row of the block is known to match.
+        template <typename F>
+        void for_each_candidate( const value_type & low, const value_type & high, F f ) const
+        {
+            for ( std::size_t block = 0; block < zones_.size(); ++block )
+            {
+                const value_type & block_min = zones_.template get<0>( block );
+                const value_type & block_max = zones_.template get<1>( block );
+                if ( block_max < low || high < block_min )
+                {
+                    continue;
+                }
+                const std::size_t begin = block * block_size_;
+                const bool contained = !( block_min < low ) && !( high < block_max );
+                f( begin, std::min( rows_, begin + block_size_ ), contained );
+            }
+        }
+
+        // Rows of v whose column I lies in [low, high]. The zone map must be up to date with v.
+        selection filter( const Vector & v, const value_type & low, const value_type & high ) const
+        {
+            assert( v.size() == rows_ );
+            const value_type * column = v.template data<I>();
+            std::vector<std::uint32_t> rows;
+            for_each_candidate( low, high, [&]( std::size_t begin, std::size_t end, bool contained ) {
+                for ( std::size_t row = begin; row < end; ++row )
+                {
+                    if ( contained || ( !( column[ row ] < low ) && !( high < column[ row ] ) ) )
+                    {
+                        rows.push_back( std::uint32_t( row ) );
+                    }
+                }
+            } );
+            return selection( std::move( rows ), v.size() ).compact();
+        }
+
+    private:
+        vector<value_type, value_type> zones_; // min, max per block
+        std::size_t block_size_;
+        std::size_t rows_ = 0;
+    };
+
+    template <std::size_t I, typename Vector>
+    constexpr std::size_t zone_map<I, Vector>::default_block_size;
+
+    // Builds a zone map over column I of v.
+    template <std::size_t I, typename Vector>
+    zone_map<I, Vector> make_zone_map( const Vector & v,
+                                       std::size_t block_size = zone_map<I, Vector>::default_block_size )
+    {
+        zone_map<I, Vector> zones( block_size );
+        zones.update( v );
+        return zones;
+    }
+
+    // Sorted secondary index
+
+    // Secondary index on column I of a table: (key, row) entries sorted by key then row, kept as a SoA so binary
+    // searches only touch the key column and lookups return spans of row ids without visiting the table.
+    // update() sorts the rows appended since the last call and merges them in; rebuild() sorts chunks on several
+    // threads and merges them pairwise.
+    template <std::size_t I, typename Vector>
+    class sorted_index
+    {
+    public:
+        using key_type = column_type_t<I, Vector>;
+        using entries_type = vector<key_type, std::uint32_t>;
+
+        sorted_index() = default;
+
+        explicit sorted_index( const Vector & v, unsigned threads = 1 )
+        {
+            rebuild( v, threads );
+        }
+
+        std::size_t size() const
+        {
+            return entries_.size();
+        }
+
+        // Bytes held by the index on top of the table itself.
+        std::size_t memory_bytes() const
+        {
+            return entries_.capacity() * ( sizeof( key_type ) + sizeof( std::uint32_t ) );
+        }
+
+        span<const key_type> keys() const
+        {
+            return entries_.template column<0>();
+        }
+
+        span<const std::uint32_t> rows() const
+        {
+            return entries_.template column<1>();
+        }
+
+        std::size_t lower_bound( const key_type & key ) const
+        {
+            const key_type * keys = entries_.template data<0>();
+            return std::size_t( std::lower_bound( keys, keys + entries_.size(), key ) - keys );
+        }
+
+        std::size_t upper_bound( const key_type & key ) const
+        {
+            const key_type * keys = entries_.template data<0>();
+            return std::size_t( std::upper_bound( keys, keys + entries_.size(), key ) - keys );
+        }
+
+        // Rows whose key equals key, ascending.
+        span<const std::uint32_t> equal_range( const key_type & key ) const
+        {
+            const std::size_t first = lower_bound( key );
+            return rows().subspan( first, upper_bound( key ) - first );
+        }
+
+        // Rows whose key lies in [low, high], ordered by key then row.
+        span<const std::uint32_t> range( const key_type & low, const key_type & high ) const
+        {
+            const std::size_t first = lower_bound( low );
+            return rows().subspan( first, std::max( first, upper_bound( high ) ) - first );
+        }
+
+        // Indexes rows appended to v since the last update. Rebuilds when v shrank.
+        void update( const Vector & v )
+        {
+            if ( v.size() < entries_.size() )
+            {
+                rebuild( v );
+            }
+            else if ( v.size() > entries_.size() )
+            {
+                entries_ = soa::merge( entries_, sorted_entries( v, entries_.size(), v.size() ) );
+            }
+        }
+
+        // Reindexes every row of v, sorting on up to `threads` threads.
+        void rebuild( const Vector & v, unsigned threads = 1 )
+        {
+            assert( v.size() < std::numeric_limits<std::uint32_t>::max() );
+            const std::size_t chunks = std::max<std::size_t>(
+                1, std::min<std::size_t>( threads, v.size() / detail::merge_segment_size ) );
+
+            std::vector<entries_type> sorted( chunks );
+            detail::parallel_for_blocks( chunks, threads, [&]( std::size_t chunk ) {
+                sorted[ chunk ] = sorted_entries( v, v.size() * chunk / chunks, v.size() * ( chunk + 1 ) / chunks );
+            } );
+
+            // Chunks cover ascending row ranges and merge is stable, so equal keys stay ordered by row.
+            for ( std::size_t width = 1; width < chunks; width *= 2 )
+            {
+                for ( std::size_t chunk = 0; chunk + width < chunks; chunk += 2 * width )
+                {
+                    sorted[ chunk ] = soa::merge( sorted[ chunk ], sorted[ chunk + width ], threads );
+                    sorted[ chunk + width ] = entries_type();
+                }
+            }
+            entries_ = std::move( sorted[ 0 ] );
+        }
+
+    private:
+        static entries_type sorted_entries( const Vector & v, std::size_t begin, std::size_t end )
+        {
+            const key_type * column = v.template data<I>();
+            std::vector<std::uint32_t> order( end - begin );
+            for ( std::size_t i = 0; i < order.size(); ++i )
+            {
+                order[ i ] = std::uint32_t( begin + i );
+            }
+            std::stable_sort( order.begin(), order.end(), [column]( std::uint32_t a, std::uint32_t b ) {
+                return column[ a ] < column[ b ];
+            } );
+
+            entries_type entries( order.size() );
+            for ( std::size_t i = 0; i < order.size(); ++i )
+            {
+                entries.template get<0>( i ) = column[ order[ i ] ];
+                entries.template get<1>( i ) = order[ i ];
+            }
+            return entries;
+        }
+
+        entries_type entries_;
+    };
+
+    // Bitmap index
+
+    // Compressed set of 32-bit row ids in the style of roaring bitmaps: rows are split in chunks of 65536 on their
+    // high 16 bits, and each chunk stores its low 16 bits either as a sorted array (up to 4096 rows) or as a
+    // 65536-bit bitset, whichever is smaller.
+    class bitmap
+    {
+    public:
+        // Adds row; appending in ascending order is the fast path.
+        void add( std::uint32_t row )
+        {
+            const auto key = std::uint16_t( row >> 16 );
+            const auto low = std::uint16_t( row & 0xffff );
+
+            if ( chunks_.empty() || chunks_.back().key < key )
+            {
+                chunks_.emplace_back();
+                chunks_.back().key = key;
+            }
+            chunk & target = chunks_.back().key == key ? chunks_.back() : find_or_insert( key );
+
+            if ( target.is_bitset() )
+            {
+                std::uint64_t & word = target.words[ low / 64 ];
+                const std::uint64_t bit = std::uint64_t( 1 ) << ( low % 64 );
+                target.cardinality += ( word & bit ) == 0;
+                word |= bit;
+                return;
+            }
+
+            if ( target.values.empty() || target.values.back() < low )
+            {
+                target.values.push_back( low );
+            }
+            else
+            {
+                const auto position = std::lower_bound( target.values.begin(), target.values.end(), low );
+                if ( *position == low )
+                {
+                    return;
+                }
+                target.values.insert( position, low );
+            }
+            ++target.cardinality;
+            if ( target.cardinality > array_limit )
+            {
+                to_bitset( target );
+            }
+        }
+
+        bool contains( std::uint32_t row ) const
+        {
+            const chunk * found = find( std::uint16_t( row >> 16 ) );
+            return found != nullptr && found->contains( std::uint16_t( row & 0xffff ) );
+        }
+
+        std::size_t cardinality() const
+        {
+            std::size_t total = 0;
+            for ( const auto & c : chunks_ )
+            {
+                total += c.cardinality;
+            }
+            return total;
+        }
+
+        bool empty() const
+        {
+            return chunks_.empty();
+        }
+
+        std::size_t memory_bytes() const
+        {
+            std::size_t bytes = chunks_.capacity() * sizeof( chunk );
+            for ( const auto & c : chunks_ )
+            {
+                bytes += c.values.capacity() * sizeof( std::uint16_t ) + c.words.capacity() * sizeof( std::uint64_t );
+            }
+            return bytes;
+        }
+
+        // Calls f( row ) for every row, ascending.
+        template <typename F>
+        void for_each( F f ) const
+        {
+            for ( const auto & c : chunks_ )
+            {
+                const std::uint32_t high = std::uint32_t( c.key ) << 16;
+                if ( !c.is_bitset() )
+                {
+                    for ( const auto low : c.values )
+                    {
+                        f( high | low );
+                    }
+                    continue;
+                }
+                for ( std::uint32_t w = 0; w < words_per_chunk; ++w )
+                {
+                    for ( std::uint64_t word = c.words[ w ]; word != 0; word &= word - 1 )
+                    {
+                        f( high | ( w * 64 + detail::count_trailing_zeros( word ) ) );
+                    }
+                }
+            }
+        }
+
+        // Ascending row ids, ready for take() and other gathers.
+        std::vector<std::uint32_t> rows() const
+        {
+            std::vector<std::uint32_t> result;
+            result.reserve( cardinality() );
+            for_each( [&result]( std::uint32_t row ) { result.push_back( row ); } );
+            return result;
+        }
+
+        selection to_selection( std::size_t universe ) const
+        {
+            return selection( rows(), universe ).compact();
+        }
+
+        // Rows of [0, universe) that are not in this bitmap.
+        bitmap complement( std::uint32_t universe ) const
+        {
+            bitmap result;
+            const std::size_t chunk_count = ( std::size_t( universe ) + 0xffff ) >> 16;
+            for ( std::size_t key = 0; key < chunk_count; ++key )
+            {
+                const std::size_t limit = std::min<std::size_t>( 0x10000, universe - ( key << 16 ) );
+                const chunk * found = find( std::uint16_t( key ) );
+
+                chunk flipped;
+                flipped.key = std::uint16_t( key );
+                flipped.words = found ? bitset_words( *found ) : std::vector<std::uint64_t>( words_per_chunk );
+                for ( std::size_t w = 0; w < words_per_chunk; ++w )
+                {
+                    const std::size_t first = w * 64;
+                    const std::uint64_t mask = first >= limit ? 0
+                                               : limit - first >= 64
+                                                   ? ~std::uint64_t( 0 )
+                                                   : ( std::uint64_t( 1 ) << ( limit - first ) ) - 1;
+                    flipped.words[ w ] = ~flipped.words[ w ] & mask;
+                }
+                result.push_normalized( std::move( flipped ) );
+            }
+            return result;
+        }
+
+        friend bitmap operator&( const bitmap & a, const bitmap & b )
+        {
+            bitmap result;
+            auto i = a.chunks_.begin();
+            auto j = b.chunks_.begin();
+            while ( i != a.chunks_.end() && j != b.chunks_.end() )
+            {
+                if ( i->key < j->key )
+                {
+                    ++i;
+                }
+                else if ( j->key < i->key )
+                {
+                    ++j;
+                }
+                else
+                {
+                    result.push_normalized( intersect( *i++, *j++ ) );
+                }
+            }
+            return result;
+        }
+
+        friend bitmap operator|( const bitmap & a, const bitmap & b )
+        {
+            bitmap result;
+            auto i = a.chunks_.begin();
+            auto j = b.chunks_.begin();
+            while ( i != a.chunks_.end() || j != b.chunks_.end() )
+            {
+                if ( j == b.chunks_.end() || ( i != a.chunks_.end() && i->key < j->key ) )
+                {
+                    result.chunks_.push_back( *i++ );
+                }
+                else if ( i == a.chunks_.end() || j->key < i->key )
+                {
+                    result.chunks_.push_back( *j++ );
+                }
+                else
+                {
+                    result.push_normalized( unite( *i++, *j++ ) );
+                }
+            }
+            return result;
+        }
+
+        friend bool operator==( const bitmap & a, const bitmap & b )
+        {
+            return a.rows() == b.rows();
+        }
+
+        friend bool operator!=( const bitmap & a, const bitmap & b )
+        {
+            return !( a == b );
+        }
+
+    private:
+        static constexpr std::size_t array_limit = 4096;
+        static constexpr std::size_t words_per_chunk = 1024;
+
+        struct chunk
+        {
+            std::vector<std::uint16_t> values; // sorted low bits, when not a bitset
+            std::vector<std::uint64_t> words;  // words_per_chunk words, when a bitset
+            std::uint32_t cardinality = 0;
+            std::uint16_t key = 0;
+
+            bool is_bitset() const
+            {
+                return !words.empty();
+            }
+
+            bool contains( std::uint16_t low ) const
+            {
+                if ( is_bitset() )
+                {
+                    return ( words[ low / 64 ] >> ( low % 64 ) ) & 1;
+                }
+                return std::binary_search( values.begin(), values.end(), low );
+            }
+        };
+
+        static std::vector<std::uint64_t> bitset_words( const chunk & c )
+        {
+            if ( c.is_bitset() )
+            {
+                return c.words;
+            }
+            std::vector<std::uint64_t> words( words_per_chunk );
+            for ( const auto low : c.values )
+            {
+                words[ low / 64 ] |= std::uint64_t( 1 ) << ( low % 64 );
+            }
+            return words;
+        }
+
+        static void to_bitset( chunk & c )
+        {
+            c.words = bitset_words( c );
+            c.values = std::vector<std::uint16_t>();
+        }
+
+        static chunk intersect( const chunk & a, const chunk & b )
+        {
+            chunk result;
+            result.key = a.key;
+            if ( a.is_bitset() && b.is_bitset() )
+            {
+                result.words.resize( words_per_chunk );
+                for ( std::size_t w = 0; w < words_per_chunk; ++w )
+                {
+                    result.words[ w ] = a.words[ w ] & b.words[ w ];
+                }
+            }
+            else if ( !a.is_bitset() && !b.is_bitset() )
+            {
+                std::set_intersection( a.values.begin(),
+                                       a.values.end(),
+                                       b.values.begin(),
+                                       b.values.end(),
+                                       std::back_inserter( result.values ) );
+            }
+            else
+            {
+                const chunk & array = a.is_bitset() ? b : a;
+                const chunk & bits = a.is_bitset() ? a : b;
+                for ( const auto low : array.values )
+                {
+                    if ( bits.contains( low ) )
+                    {
+                        result.values.push_back( low );
+                    }
+                }
+            }
+            return result;
+        }
+
+        static chunk unite( const chunk & a, const chunk & b )
+        {
+            chunk result;
+            result.key = a.key;
+            if ( !a.is_bitset() && !b.is_bitset() && a.cardinality + b.cardinality <= array_limit )
+            {
+                std::set_union( a.values.begin(),
+                                a.values.end(),
+                                b.values.begin(),
+                                b.values.end(),
+                                std::back_inserter( result.values ) );
+                return result;
+            }
+            result.words = bitset_words( a );
+            const std::vector<std::uint64_t> other = bitset_words( b );
+            for ( std::size_t w = 0; w < words_per_chunk; ++w )
+            {
+                result.words[ w ] |= other[ w ];
+            }
+            return result;
+        }
+
+        // Recomputes the cardinality of c, picks its cheapest representation and appends it unless empty.
+        void push_normalized( chunk c )
+        {
+            if ( c.is_bitset() )
+            {
+                std::uint32_t cardinality = 0;
+                for ( const auto word : c.words )
+                {
+                    cardinality += detail::popcount( word );
+                }
+                c.cardinality = cardinality;
+                if ( cardinality <= array_limit )
+                {
+                    for_each_bit( c, [&c]( std::uint16_t low ) { c.values.push_back( low ); } );
+                    c.words = std::vector<std::uint64_t>();
+                }
+            }
+            else
+            {
+                c.cardinality = std::uint32_t( c.values.size() );
+            }
+            if ( c.cardinality > 0 )
+            {
+                chunks_.push_back( std::move( c ) );
+            }
+        }
+
+        template <typename F>
+        static void for_each_bit( const chunk & c, F f )
+        {
+            for ( std::size_t w = 0; w < words_per_chunk; ++w )
+            {
+                for ( std::uint64_t word = c.words[ w ]; word != 0; word &= word - 1 )
+                {
+                    f( std::uint16_t( w * 64 + detail::count_trailing_zeros( word ) ) );
+                }
+            }
+        }
+
+        const chunk * find( std::uint16_t key ) const
+        {
+            const auto found = std::lower_bound(
+                chunks_.begin(), chunks_.end(), key, []( const chunk & c, std::uint16_t k ) { return c.key < k; } );
+            return found != chunks_.end() && found->key == key ? &*found : nullptr;
+        }
+
+        chunk & find_or_insert( std::uint16_t key )
+        {
+            auto found = std::lower_bound(
+                chunks_.begin(), chunks_.end(), key, []( const chunk & c, std::uint16_t k ) { return c.key < k; } );
+            if ( found == chunks_.end() || found->key != key )
+            {
+                found = chunks_.emplace( found );
+                found->key = key;
+            }
+            return *found;
+        }
+
+        std::vector<chunk> chunks_;
+    };
+
+    // One bitmap per distinct value of column I, for equality predicates on low-cardinality columns. Combine the
+    // bitmaps of several predicates with &, | and complement() to answer a filter without reading any column.
+    template <std::size_t I, typename Vector>
+    class bitmap_index
+    {
+    public:
+        using key_type = column_type_t<I, Vector>;
+
+        bitmap_index() = default;
+
+        explicit bitmap_index( const Vector & v )
+        {
+            update( v );
+        }
+
+        // Number of rows indexed.
+        std::size_t rows() const
+        {
+            return rows_;
+        }
+
+        std::size_t distinct_count() const
+        {
+            return keys_.size();
+        }
+
+        // Distinct values, in order of first appearance.
+        const std::vector<key_type> & keys() const
+        {
+            return keys_;
+        }
+
+        // Rows whose column I equals key.
+        const bitmap & equal( const key_type & key ) const
+        {
+            const std::uint32_t found = table_.find( key, detail::hash_key( key ) );
+            return found == detail::hash_table<key_type>::empty ? empty_ : bitmaps_[ found ];
+        }
+
+        std::size_t memory_bytes() const
+        {
+            std::size_t bytes = table_.memory_bytes() + keys_.capacity() * sizeof( key_type );
+            for ( const auto & b : bitmaps_ )
+            {
+                bytes += b.memory_bytes();
+            }
+            return bytes;
+        }
+
+        // Indexes rows appended to v since the last update. Rebuilds when v shrank.
+        void update( const Vector & v )
+        {
+            if ( v.size() < rows_ )
+            {
+                *this = bitmap_index();
+            }
+            assert( v.size() < std::numeric_limits<std::uint32_t>::max() );
+
+            const key_type * column = v.template data<I>();
+            for ( ; rows_ < v.size(); ++rows_ )
+            {
+                const key_type & key = column[ rows_ ];
+                const auto found = table_.insert( key, detail::hash_key( key ), std::uint32_t( bitmaps_.size() ) );
+                if ( found.second )
+                {
+                    keys_.push_back( key );
+                    bitmaps_.emplace_back();
+                }
+                bitmaps_[ found.first ].add( std::uint32_t( rows_ ) );
+            }
+        }
+
+        void rebuild( const Vector & v )
+        {
+            *this = bitmap_index();
+            update( v );
+        }
+
+    private:
+        detail::hash_table<key_type> table_;
+        std::vector<key_type> keys_;
+        std::vector<bitmap> bitmaps_;
+        bitmap empty_;
+        std::size_t rows_ = 0;
+    };
+
+    // Change tracking
+
+    // Set of rows written since the last clear, one bit per row, with a summary bit per 64-bit word so that
+    // iterating, counting and clearing cost time proportional to the dirty words rather than to the table.
+    class dirty_bitmap
+    {
+    public:
+        void mark( std::size_t row )
+        {
+            const std::size_t w = row / 64;
+            grow( w + 1 );
+            words_[ w ] |= std::uint64_t( 1 ) << ( row % 64 );
+            summary_[ w / 64 ] |= std::uint64_t( 1 ) << ( w % 64 );
+        }
+
+        // Marks rows [first, last).
+        void mark( std::size_t first, std::size_t last )
+        {
+            if ( first >= last )
+            {
+                return;
+            }
+            grow( ( last + 63 ) / 64 );
+            for ( std::size_t w = first / 64; w * 64 < last; ++w )
+            {
+                const std::size_t begin = std::max( first, w * 64 ) - w * 64;
+                const std::size_t end = std::min( last, w * 64 + 64 ) - w * 64;
+                const std::uint64_t high = end == 64 ? ~std::uint64_t( 0 ) : ( std::uint64_t( 1 ) << end ) - 1;
+                words_[ w ] |= high & ~( ( std::uint64_t( 1 ) << begin ) - 1 );
+                summary_[ w / 64 ] |= std::uint64_t( 1 ) << ( w % 64 );
+            }
+        }
+
+        bool contains( std::size_t row ) const
+        {
+            return row / 64 < words_.size() && ( ( words_[ row / 64 ] >> ( row % 64 ) ) & 1 );
+        }
+
+        bool empty() const
+        {
+            return std::all_of( summary_.begin(), summary_.end(), []( std::uint64_t word ) { return word == 0; } );
+        }
+
+        // Number of dirty rows.
+        std::size_t count() const
+        {
+            std::size_t total = 0;
+            for_each_word( [&total]( std::size_t, std::uint64_t word ) { total += detail::popcount( word ); } );
+            return total;
+        }
+
+        // Bit i of word i / 64 marks row i. Rows past the end of the words are clean.
+        span<const std::uint64_t> words() const
+        {
+            return words_;
+        }
+
+        // Calls f( index, word ) for every non-zero word, ascending.
+        template <typename F>
+        void for_each_word( F f ) const
+        {
+            for ( std::size_t s = 0; s < summary_.size(); ++s )
+            {
+                for ( std::uint64_t bits = summary_[ s ]; bits != 0; bits &= bits - 1 )
+                {
+                    const std::size_t w = s * 64 + detail::count_trailing_zeros( bits );
+                    f( w, words_[ w ] );
+                }
+            }
+        }
+
+        // Calls f( row ) for every dirty row, ascending.
+        template <typename F>
+        void for_each( F f ) const
+        {
+            for_each_word( [&f]( std::size_t w, std::uint64_t word ) {
+                for ( ; word != 0; word &= word - 1 )
+                {
+                    f( w * 64 + detail::count_trailing_zeros( word ) );
+                }
+            } );
+        }
+
+        // Dirty rows of a table of universe rows, ready for take() and filters.
+        selection to_selection( std::size_t universe ) const
+        {
+            std::vector<std::uint64_t> mask( ( universe + 63 ) / 64, 0 );
+            std::copy( words_.begin(), words_.begin() + std::ptrdiff_t( std::min( words_.size(), mask.size() ) ),
+                       mask.begin() );
+            if ( universe % 64 != 0 )
+            {
+                mask.back() &= ( std::uint64_t( 1 ) << ( universe % 64 ) ) - 1;
+            }
+            return selection::from_mask( std::move( mask ), universe ).compact();
+        }
+
+        // Clears rows [rows, ...), e.g. after the table shrank.
+        void truncate( std::size_t rows )
+        {
+            if ( rows >= words_.size() * 64 )
+            {
+                return;
+            }
+            for ( std::size_t w = ( rows + 63 ) / 64; w < words_.size(); ++w )
+            {
+                words_[ w ] = 0;
+                summary_[ w / 64 ] &= ~( std::uint64_t( 1 ) << ( w % 64 ) );
+            }
+            if ( rows % 64 != 0 )
+            {
+                const std::size_t w = rows / 64;
+                words_[ w ] &= ( std::uint64_t( 1 ) << ( rows % 64 ) ) - 1;
+                if ( words_[ w ] == 0 )
+                {
+                    summary_[ w / 64 ] &= ~( std::uint64_t( 1 ) << ( w % 64 ) );
+                }
+            }
+        }
+
+        // Keeps the allocated words, touching only the dirty ones.
+        void clear()
+        {
+            for_each_word( [this]( std::size_t w, std::uint64_t ) { words_[ w ] = 0; } );
+            std::fill( summary_.begin(), summary_.end(), 0 );
+        }
+
+    private:
+        void grow( std::size_t words )
+        {
+            if ( words > words_.size() )
+            {
+                words_.resize( std::max( words, words_.size() * 2 ), 0 );
+                summary_.resize( ( words_.size() + 63 ) / 64, 0 );
+            }
+        }
+
+        std::vector<std::uint64_t> words_;
+        std::vector<std::uint64_t> summary_;
+    };
+
+    // soa::vector that records which rows of which columns were written since the last checkpoint, for shipping
+    // only the changed cells. Writes go through set, set_row, write and the appending members, which mark the
+    // written cells in one dirty bitmap per column and in a bitmap of dirty rows; const access is unchanged.
+    // Appended rows are dirty in every column. Removed rows are not recorded: compare size() with
+    // checkpoint_size().
+    //
+    //     soa::tracked_vector<std::uint64_t, double> quotes( std::move( initial ) );
+    //     quotes.set<1>( row, price );
+    //     quotes.dirty<1>().for_each( [&]( std::size_t i ) { send( i, quotes.get<1>( i ) ); } );
+    //     quotes.checkpoint();
+    template <typename... Ts>
+    class tracked_vector
+    {
+    public:
+        using size_type = std::size_t;
+        using value_type = std::tuple<Ts...>;
+        using const_reference = std::tuple<const Ts &...>;
+        using const_iterator = row_iterator<const tracked_vector, const_reference>;
+
+        template <std::size_t I>
+        using column_type = typename std::tuple_element<I, value_type>::type;
+
+        static constexpr std::size_t column_count = sizeof...( Ts );
+
+        tracked_vector() = default;
+
+        // Starts from rows as the checkpointed state, with nothing dirty.
+        explicit tracked_vector( vector<Ts...> rows )
+            : rows_( std::move( rows ) )
+            , checkpoint_size_( rows_.size() )
+        {
+        }
+
+        size_type size() const
+        {
+            return rows_.size();
+        }
+
+        bool empty() const
+        {
+            return rows_.empty();
+        }
+
+        void reserve( size_type capacity )
+        {
+            rows_.reserve( capacity );
+        }
+
+        // New rows are value-initialized and dirty.
+        void resize( size_type size )
+        {
+            const size_type old_size = rows_.size();
+            rows_.resize( size );
+            if ( size > old_size )
+            {
+                mark_all( old_size, size );
+            }
+            else
+            {
+                truncate( size );
+            }
+        }
+
+        void clear()
+        {
+            resize( 0 );
+        }
+
+        void push_back( const Ts &... values )
+        {
+            rows_.push_back( values... );
+            mark_all( rows_.size() - 1, rows_.size() );
+        }
+
+        void push_back( const value_type & row )
+        {
+            rows_.push_back( row );
+            mark_all( rows_.size() - 1, rows_.size() );
+        }
+
+        void pop_back()
+        {
+            rows_.pop_back();
+            truncate( rows_.size() );
+        }
+
+        template <std::size_t I>
+        void set( size_type i, const column_type<I> & value )
+        {
+            rows_.template get<I>( i ) = value;
+            columns_[ I ].mark( i );
+            rows_dirty_.mark( i );
+        }
+
+        void set_row( size_type i, const Ts &... values )
+        {
+            rows_[ i ] = std::tie( values... );
+            mark_all( i, i + 1 );
+        }
+
+        // Marks rows [first, first + count) of column I dirty and returns them for writing.
+        template <std::size_t I>
+        span<column_type<I>> write( size_type first, size_type count )
+        {
+            assert( first + count <= rows_.size() );
+            columns_[ I ].mark( first, first + count );
+            rows_dirty_.mark( first, first + count );
+            return rows_.template column<I>().subspan( first, count );
+        }
+
+        template <std::size_t I>
+        const column_type<I> * data() const
+        {
+            return rows_.template data<I>();
+        }
+
+        template <std::size_t I>
+        span<const column_type<I>> column() const
+        {
+            return rows_.template column<I>();
+        }
+
+        template <std::size_t I>
+        column_ref<const column_type<I>> col() const
+        {
+            return rows_.template col<I>();
+        }
+
+        template <std::size_t I>
+        const column_type<I> & get( size_type i ) const
+        {
+            return rows_.template get<I>( i );
+        }
+
+        const_reference operator[]( size_type i ) const
+        {
+            return rows_[ i ];
+        }
+
+        const_iterator begin() const
+        {
+            return {this, 0};
+        }
+
+        const_iterator end() const
+        {
+            return {this, size()};
+        }
+
+        // The tracked rows, for algorithms that take a soa::vector.
+        const vector<Ts...> & rows() const
+        {
+            return rows_;
+        }
+
+        // Rows of column I written since the last checkpoint.
+        template <std::size_t I>
+        const dirty_bitmap & dirty() const
+        {
+            return columns_[ I ];
+        }
+
+        // Rows with at least one column written since the last checkpoint.
+        const dirty_bitmap & dirty_rows() const
+        {
+            return rows_dirty_;
+        }
+
+        // Number of rows at the last checkpoint.
+        size_type checkpoint_size() const
+        {
+            return checkpoint_size_;
+        }
+
+        // Forgets all changes: the current rows become the reference state.
+        void checkpoint()
+        {
+            for ( dirty_bitmap & column : columns_ )
+            {
+                column.clear();
+            }
+            rows_dirty_.clear();
+            checkpoint_size_ = rows_.size();
+        }
+
+    private:
+        void mark_all( size_type first, size_type last )
+        {
+            for ( dirty_bitmap & column : columns_ )
+            {
+                column.mark( first, last );
+            }
+            rows_dirty_.mark( first, last );
+        }
+
+        void truncate( size_type size )
+        {
+            for ( dirty_bitmap & column : columns_ )
+            {
+                column.truncate( size );
+            }
+            rows_dirty_.truncate( size );
+        }
+
+        vector<Ts...> rows_;
+        dirty_bitmap columns_[ sizeof...( Ts ) ];
+        dirty_bitmap rows_dirty_;
+        size_type checkpoint_size_ = 0;
+    };
+
+    // AoS transposition
+    //
+    // Conversion between arrays of structs and columns, for trivially copyable, default-constructible structs.
+    // Fields are named with member pointers, so padding and field order in the struct do not matter. When every
+    // field is a 4-byte value, the struct is exactly 3, 4 or 8 of them and the fields are listed in declaration
+    // order, rows are transposed four at a time with SSE shuffles; other layouts are copied one strided column at a
+    // time.
+
+    namespace detail
+    {
+        template <typename T>
+        struct non_deduced
+        {
+            using type = T;
+        };
+
+        // Offset of a field within Struct, measured on a value-initialized instance.
+        template <typename Struct, typename T>
+        std::size_t member_offset( T Struct::*member )
+        {
+            static_assert( std::is_default_constructible<Struct>::value,
+                           "AoS transposition locates fields on a default-constructed struct" );
+            const Struct object{};
+            return std::size_t( reinterpret_cast<const unsigned char *>( &( object.*member ) ) -
+                                reinterpret_cast<const unsigned char *>( &object ) );
+        }
+
+        // Fields of a struct laid out as `fields` consecutive 4-byte values, in order, with nothing else.
+        template <typename Struct, typename... Ts>
+        unsigned packed_32bit_fields( const std::size_t * offsets )
+        {
+            if ( !all_of<sizeof( Ts ) == 4 ...>::value || sizeof( Struct ) != 4 * sizeof...( Ts ) )
+            {
+                return 0;
+            }
+            for ( std::size_t i = 0; i < sizeof...( Ts ); ++i )
+            {
+                if ( offsets[ i ] != 4 * i )
+                {
+                    return 0;
+                }
+            }
+            return unsigned( sizeof...( Ts ) );
+        }
+
+#if defined( __SSE2__ )
+        inline __m128 load4( const unsigned char * p )
+        {
+            return _mm_loadu_ps( reinterpret_cast<const float *>( p ) );
+        }
+
+        inline void store4( unsigned char * p, __m128 value )
+        {
+            _mm_storeu_ps( reinterpret_cast<float *>( p ), value );
+        }
+
+        // rows holds 4 structs of 3 fields; writes 4 values to each column.
+        inline void deinterleave_3x4( const unsigned char * rows, unsigned char * const * columns, std::size_t at )
+        {
+            const __m128 a = load4( rows );
+            const __m128 b = load4( rows + 16 );
+            const __m128 c = load4( rows + 32 );
+            const __m128 x =
+                _mm_shuffle_ps( a, _mm_shuffle_ps( b, c, _MM_SHUFFLE( 1, 1, 2, 2 ) ), _MM_SHUFFLE( 2, 0, 3, 0 ) );
+            const __m128 y = _mm_shuffle_ps( _mm_shuffle_ps( a, b, _MM_SHUFFLE( 0, 0, 1, 1 ) ),
+                                             _mm_shuffle_ps( b, c, _MM_SHUFFLE( 2, 2, 3, 3 ) ),
+                                             _MM_SHUFFLE( 2, 0, 2, 0 ) );
+            const __m128 z = _mm_shuffle_ps( _mm_shuffle_ps( a, b, _MM_SHUFFLE( 1, 1, 2, 2 ) ),
+                                             _mm_shuffle_ps( c, c, _MM_SHUFFLE( 3, 3, 0, 0 ) ),
+                                             _MM_SHUFFLE( 2, 0, 2, 0 ) );
+            store4( columns[ 0 ] + at, x );
+            store4( columns[ 1 ] + at, y );
+            store4( columns[ 2 ] + at, z );
+        }
+
+        inline void interleave_3x4( const unsigned char * const * columns, std::size_t at, unsigned char * rows )
+        {
+            const __m128 x = load4( columns[ 0 ] + at );
+            const __m128 y = load4( columns[ 1 ] + at );
+            const __m128 z = load4( columns[ 2 ] + at );
+            store4( rows,
+                    _mm_shuffle_ps( _mm_shuffle_ps( x, y, _MM_SHUFFLE( 0, 0, 0, 0 ) ),
+                                    _mm_shuffle_ps( z, x, _MM_SHUFFLE( 1, 1, 0, 0 ) ),
+                                    _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+            store4( rows + 16,
+                    _mm_shuffle_ps( _mm_shuffle_ps( y, z, _MM_SHUFFLE( 1, 1, 1, 1 ) ),
+                                    _mm_shuffle_ps( x, y, _MM_SHUFFLE( 2, 2, 2, 2 ) ),
+                                    _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+            store4( rows + 32,
+                    _mm_shuffle_ps( _mm_shuffle_ps( z, x, _MM_SHUFFLE( 3, 3, 2, 2 ) ),
+                                    _mm_shuffle_ps( y, z, _MM_SHUFFLE( 3, 3, 3, 3 ) ),
+                                    _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+        }
+
+        // Transposes the 4x4 block of 4-byte values starting at field `field` of 4 structs of `stride` bytes into
+        // columns field..field+3, or back. The transpose is its own inverse.
+        inline void deinterleave_4x4( const unsigned char * rows,
+                                      std::size_t stride,
+                                      std::size_t field,
+                                      unsigned char * const * columns,
+                                      std::size_t at )
+        {
+            __m128 r0 = load4( rows + 4 * field );
+            __m128 r1 = load4( rows + stride + 4 * field );
+            __m128 r2 = load4( rows + 2 * stride + 4 * field );
+            __m128 r3 = load4( rows + 3 * stride + 4 * field );
+            _MM_TRANSPOSE4_PS( r0, r1, r2, r3 );
+            store4( columns[ field ] + at, r0 );
+            store4( columns[ field + 1 ] + at, r1 );
+            store4( columns[ field + 2 ] + at, r2 );
+            store4( columns[ field + 3 ] + at, r3 );
+        }
+
+        inline void interleave_4x4( const unsigned char * const * columns,
+                                    std::size_t at,
+                                    std::size_t field,
+                                    unsigned char * rows,
+                                    std::size_t stride )
+        {
+            __m128 c0 = load4( columns[ field ] + at );
+            __m128 c1 = load4( columns[ field + 1 ] + at );
+            __m128 c2 = load4( columns[ field + 2 ] + at );
+            __m128 c3 = load4( columns[ field + 3 ] + at );
+            _MM_TRANSPOSE4_PS( c0, c1, c2, c3 );
+            store4( rows + 4 * field, c0 );
+            store4( rows + stride + 4 * field, c1 );
+            store4( rows + 2 * stride + 4 * field, c2 );
+            store4( rows + 3 * stride + 4 * field, c3 );
+        }
+#endif
+
+        // Moves the rows [0, count) of packed 4-byte-field structs into columns, four rows per step, and returns
+        // the number of rows moved; the caller copies the remainder.
+        inline std::size_t deinterleave_packed( const unsigned char * rows,
+                                                std::size_t count,
+                                                unsigned fields,
+                                                unsigned char * const * columns )
+        {
+            std::size_t i = 0;
+#if defined( __SSE2__ )
+            const std::size_t stride = 4 * std::size_t( fields );
+            for ( ; i + 4 <= count && fields == 3; i += 4 )
+            {
+                deinterleave_3x4( rows + i * stride, columns, 4 * i );
+            }
+            for ( ; i + 4 <= count && ( fields == 4 || fields == 8 ); i += 4 )
+            {
+                for ( std::size_t field = 0; field < fields; field += 4 )
+                {
+                    deinterleave_4x4( rows + i * stride, stride, field, columns, 4 * i );
+                }
+            }
+#else
+            static_cast<void>( rows );
+            static_cast<void>( count );
+            static_cast<void>( fields );
+            static_cast<void>( columns );
+#endif
+            return i;
+        }
+
+        inline std::size_t interleave_packed( const unsigned char * const * columns,
+                                              std::size_t count,
+                                              unsigned fields,
+                                              unsigned char * rows )
+        {
+            std::size_t i = 0;
+#if defined( __SSE2__ )
+            const std::size_t stride = 4 * std::size_t( fields );
+            for ( ; i + 4 <= count && fields == 3; i += 4 )
+            {
+                interleave_3x4( columns, 4 * i, rows + i * stride );
+            }
+            for ( ; i + 4 <= count && ( fields == 4 || fields == 8 ); i += 4 )
+            {
+                for ( std::size_t field = 0; field < fields; field += 4 )
+                {
+                    interleave_4x4( columns, 4 * i, field, rows + i * stride, stride );
+                }
+            }
+#else
+            static_cast<void>( columns );
+            static_cast<void>( count );
+            static_cast<void>( fields );
+            static_cast<void>( rows );
+#endif
+            return i;
+        }
+    }
+
+    // Replaces the content of result with the given fields of every struct in rows, one column per member pointer.
+    // Reuses the capacity of result.
+    template <typename Struct, typename... Ts>
+    void from_aos( typename detail::non_deduced<span<const Struct>>::type rows,
+                   vector<Ts...> & result,
+                   Ts Struct::*... members )
+    {
+        static_assert( std::is_trivially_copyable<Struct>::value, "from_aos copies structs bytewise" );
+        result.resize( rows.size() );
+        const std::size_t offsets[] = {detail::member_offset( members )...};
+        std::size_t done = 0;
+        const unsigned fields = detail::packed_32bit_fields<Struct, Ts...>( offsets );
+        if ( fields == 3 || fields == 4 || fields == 8 )
+        {
+            unsigned char * columns[ sizeof...( Ts ) ];
+            detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                columns[ I ] = reinterpret_cast<unsigned char *>( result.template data<I>() );
+            } );
+            done = detail::deinterleave_packed(
+                reinterpret_cast<const unsigned char *>( rows.data() ), rows.size(), fields, columns );
+        }
+
+        const auto * base = reinterpret_cast<const unsigned char *>( rows.data() );
+        detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+            constexpr std::size_t I = decltype( column )::value;
+            using T = column_type_t<I, vector<Ts...>>;
+            const unsigned char * field = base + done * sizeof( Struct ) + offsets[ I ];
+            T * const end = result.template data<I>() + rows.size();
+            for ( T * out = result.template data<I>() + done; out != end; ++out, field += sizeof( Struct ) )
+            {
+                std::memcpy( out, field, sizeof( T ) );
+            }
+        } );
+    }
+
+    // Copies the given fields of every struct in rows into a new table, one column per member pointer:
+    //
+    //     struct particle { float x, y, z; };
+    //     auto positions = soa::from_aos( particles, &particle::x, &particle::y, &particle::z );
+    template <typename Struct, typename... Ts>
+    vector<Ts...> from_aos( typename detail::non_deduced<span<const Struct>>::type rows, Ts Struct::*... members )
+    {
+        vector<Ts...> result;
+        from_aos( rows, result, members... );
+        return result;
+    }
+
+    // Writes the columns of v into the given fields of the structs in rows, which must hold v.size() structs;
+    // other fields are left untouched.
+    template <typename Struct, typename... Ts>
+    void to_aos( const vector<Ts...> & v,
+                 typename detail::non_deduced<span<Struct>>::type rows,
+                 Ts Struct::*... members )
+    {
+        static_assert( std::is_trivially_copyable<Struct>::value, "to_aos copies structs bytewise" );
+        assert( rows.size() == v.size() );
+        const std::size_t offsets[] = {detail::member_offset( members )...};
+        std::size_t done = 0;
+        const unsigned fields = detail::packed_32bit_fields<Struct, Ts...>( offsets );
+        if ( fields == 3 || fields == 4 || fields == 8 )
+        {
+            const unsigned char * columns[ sizeof...( Ts ) ];
+            detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                columns[ I ] = reinterpret_cast<const unsigned char *>( v.template data<I>() );
+            } );
+            done = detail::interleave_packed(
+                columns, rows.size(), fields, reinterpret_cast<unsigned char *>( rows.data() ) );
+        }
+
+        auto * base = reinterpret_cast<unsigned char *>( rows.data() );
+        detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+            constexpr std::size_t I = decltype( column )::value;
+            using T = column_type_t<I, vector<Ts...>>;
+            unsigned char * field = base + done * sizeof( Struct ) + offsets[ I ];
+            const T * const end = v.template data<I>() + rows.size();
+            for ( const T * in = v.template data<I>() + done; in != end; ++in, field += sizeof( Struct ) )
+            {
+                std::memcpy( field, in, sizeof( T ) );
+            }
+        } );
+    }
+}
+
 #endif
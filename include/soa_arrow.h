@@ -0,0 +1,367 @@
+#ifndef SOA_ARROW_H
+#define SOA_ARROW_H
+
+#include "soa.h"
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+// Apache Arrow C data interface, https://arrow.apache.org/docs/format/CDataInterface.html. The structs are part of
+// a stable C ABI and are declared here verbatim, guarded so they can coexist with Arrow's own headers.
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+extern "C" {
+struct ArrowSchema
+{
+    // Array type description
+    const char * format;
+    const char * name;
+    const char * metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema ** children;
+    struct ArrowSchema * dictionary;
+
+    // Release callback
+    void ( *release )( struct ArrowSchema * );
+    // Opaque producer-specific data
+    void * private_data;
+};
+
+struct ArrowArray
+{
+    // Array data description
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void ** buffers;
+    struct ArrowArray ** children;
+    struct ArrowArray * dictionary;
+
+    // Release callback
+    void ( *release )( struct ArrowArray * );
+    // Opaque producer-specific data
+    void * private_data;
+};
+}
+
+#endif
+
+namespace soa
+{
+    // Raised when an imported Arrow array does not match the requested schema.
+    class arrow_error : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    // Arrow interop
+    //
+    // A table maps onto a struct array ("+s") with one primitive child per column and no validity bitmaps. Column
+    // buffers are shared, never copied: exported arrays point into the container's columns, and imported tables
+    // read straight from the producer's buffers.
+
+    namespace detail
+    {
+        // Arrow format string of a column type. bool is rejected: Arrow booleans are bit packed.
+        template <typename T>
+        const char * arrow_format()
+        {
+            static_assert( std::is_arithmetic<T>::value && !std::is_same<T, bool>::value,
+                           "only integer and floating point columns map onto Arrow primitive arrays; store booleans "
+                           "as std::uint8_t" );
+            static_assert( !std::is_floating_point<T>::value || sizeof( T ) == 4 || sizeof( T ) == 8,
+                           "unsupported floating point width" );
+
+            if ( std::is_floating_point<T>::value )
+            {
+                return sizeof( T ) == 4 ? "f" : "g";
+            }
+            const bool is_signed = std::is_signed<T>::value;
+            switch ( sizeof( T ) )
+            {
+            case 1:
+                return is_signed ? "c" : "C";
+            case 2:
+                return is_signed ? "s" : "S";
+            case 4:
+                return is_signed ? "i" : "I";
+            default:
+                return is_signed ? "l" : "L";
+            }
+        }
+
+        // Keeps the exported data alive for as long as any exported array, parent or moved-out child, exists.
+        struct arrow_array_private
+        {
+            std::shared_ptr<const void> owner;
+            const void * buffers[ 2 ] = {nullptr, nullptr};
+            std::vector<ArrowArray *> children;
+        };
+
+        struct arrow_schema_private
+        {
+            std::string name;
+            std::vector<ArrowSchema *> children;
+        };
+
+        inline void release_arrow_array( ArrowArray * array )
+        {
+            auto * state = static_cast<arrow_array_private *>( array->private_data );
+            for ( ArrowArray * child : state->children )
+            {
+                if ( child->release != nullptr )
+                {
+                    child->release( child );
+                }
+                delete child;
+            }
+            delete state;
+            array->release = nullptr;
+        }
+
+        inline void release_arrow_schema( ArrowSchema * schema )
+        {
+            auto * state = static_cast<arrow_schema_private *>( schema->private_data );
+            for ( ArrowSchema * child : state->children )
+            {
+                if ( child->release != nullptr )
+                {
+                    child->release( child );
+                }
+                delete child;
+            }
+            delete state;
+            schema->release = nullptr;
+        }
+
+        inline ArrowArray make_arrow_array( std::int64_t length,
+                                            std::int64_t n_buffers,
+                                            arrow_array_private * state )
+        {
+            ArrowArray array{};
+            array.length = length;
+            array.n_buffers = n_buffers;
+            array.n_children = std::int64_t( state->children.size() );
+            array.buffers = state->buffers;
+            array.children = state->children.empty() ? nullptr : state->children.data();
+            array.release = release_arrow_array;
+            array.private_data = state;
+            return array;
+        }
+
+        inline ArrowSchema make_arrow_schema( const char * format, std::string name, arrow_schema_private * state )
+        {
+            state->name = std::move( name );
+            ArrowSchema schema{};
+            schema.format = format;
+            schema.name = state->name.c_str();
+            schema.n_children = std::int64_t( state->children.size() );
+            schema.children = state->children.empty() ? nullptr : state->children.data();
+            schema.release = release_arrow_schema;
+            schema.private_data = state;
+            return schema;
+        }
+
+        template <typename Vector>
+        void export_arrow_array( const Vector & v, std::shared_ptr<const void> owner, ArrowArray * out )
+        {
+            auto * state = new arrow_array_private;
+            state->owner = owner;
+            detail::for_each_index<Vector::column_count>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                auto * child_state = new arrow_array_private;
+                child_state->owner = owner;
+                child_state->buffers[ 1 ] = v.template data<I>();
+                state->children.push_back(
+                    new ArrowArray( make_arrow_array( std::int64_t( v.size() ), 2, child_state ) ) );
+            } );
+            *out = make_arrow_array( std::int64_t( v.size() ), 1, state );
+        }
+    }
+
+    // Describes the layout of a table with columns Ts... as a struct of primitive arrays. names, when given, must
+    // hold one name per column; columns are otherwise named by index.
+    template <typename... Ts>
+    void export_arrow_schema( ArrowSchema * out, const std::vector<std::string> & names = {} )
+    {
+        assert( names.empty() || names.size() == sizeof...( Ts ) );
+        const char * formats[] = {detail::arrow_format<Ts>()...};
+
+        auto * state = new detail::arrow_schema_private;
+        for ( std::size_t i = 0; i < sizeof...( Ts ); ++i )
+        {
+            auto * child = new ArrowSchema(
+                detail::make_arrow_schema( formats[ i ],
+                                           names.empty() ? std::to_string( i ) : names[ i ],
+                                           new detail::arrow_schema_private ) );
+            state->children.push_back( child );
+        }
+        *out = detail::make_arrow_schema( "+s", "", state );
+    }
+
+    // Exports v without copying and without taking ownership: the caller must keep v alive and unmodified until
+    // the consumer calls out->release.
+    template <typename... Ts>
+    void export_arrow( const vector<Ts...> & v, ArrowArray * out, ArrowSchema * schema = nullptr )
+    {
+        detail::export_arrow_array( v, nullptr, out );
+        if ( schema != nullptr )
+        {
+            export_arrow_schema<Ts...>( schema );
+        }
+    }
+
+    // Exports v without copying, moving it into the exported array; it is freed by the consumer's last release.
+    template <typename... Ts>
+    void export_arrow( vector<Ts...> && v, ArrowArray * out, ArrowSchema * schema = nullptr )
+    {
+        auto owned = std::make_shared<const vector<Ts...>>( std::move( v ) );
+        detail::export_arrow_array( *owned, owned, out );
+        if ( schema != nullptr )
+        {
+            export_arrow_schema<Ts...>( schema );
+        }
+    }
+
+    // Read-only table over the buffers of an imported Arrow struct array, without copying. Takes ownership of the
+    // array (the source struct is marked released) and releases it on destruction.
+    template <typename... Ts>
+    class arrow_table
+    {
+    public:
+        using size_type = std::size_t;
+        using value_type = std::tuple<Ts...>;
+
+        template <std::size_t I>
+        using column_type = typename std::tuple_element<I, value_type>::type;
+
+        static constexpr std::size_t column_count = sizeof...( Ts );
+
+        // Checks schema against Ts... and moves array in. Throws arrow_error on mismatch, leaving array untouched.
+        arrow_table( ArrowArray * array, const ArrowSchema & schema )
+        {
+            validate( *array, schema );
+
+            array_ = *array;
+            array->release = nullptr;
+            size_ = std::size_t( array_.length );
+            detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                const ArrowArray & child = *array_.children[ I ];
+                std::get<I>( columns_ ) = static_cast<const column_type<I> *>( child.buffers[ 1 ] ) +
+                                          ( child.offset + array_.offset );
+            } );
+        }
+
+        arrow_table( arrow_table && other ) noexcept
+            : array_( other.array_ )
+            , size_( other.size_ )
+            , columns_( other.columns_ )
+        {
+            other.array_.release = nullptr;
+            other.size_ = 0;
+        }
+
+        arrow_table( const arrow_table & ) = delete;
+        arrow_table & operator=( const arrow_table & ) = delete;
+
+        ~arrow_table()
+        {
+            if ( array_.release != nullptr )
+            {
+                array_.release( &array_ );
+            }
+        }
+
+        size_type size() const
+        {
+            return size_;
+        }
+
+        bool empty() const
+        {
+            return size_ == 0;
+        }
+
+        template <std::size_t I>
+        const column_type<I> * data() const
+        {
+            return std::get<I>( columns_ );
+        }
+
+        template <std::size_t I>
+        span<const column_type<I>> column() const
+        {
+            return {data<I>(), size_};
+        }
+
+        template <std::size_t I>
+        const column_type<I> & get( size_type i ) const
+        {
+            assert( i < size_ );
+            return data<I>()[ i ];
+        }
+
+        vector<Ts...> to_vector() const
+        {
+            vector<Ts...> result( size_ );
+            detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                std::copy( data<I>(), data<I>() + size_, result.template data<I>() );
+            } );
+            return result;
+        }
+
+    private:
+        static void validate( const ArrowArray & array, const ArrowSchema & schema )
+        {
+            if ( array.release == nullptr )
+            {
+                throw arrow_error( "arrow array was already released" );
+            }
+            if ( std::string( schema.format ) != "+s" || schema.n_children != std::int64_t( sizeof...( Ts ) ) ||
+                 array.n_children != schema.n_children )
+            {
+                throw arrow_error( "expected a struct array with " + std::to_string( sizeof...( Ts ) ) + " children" );
+            }
+            if ( array.null_count > 0 )
+            {
+                throw arrow_error( "null rows are not supported" );
+            }
+
+            const char * formats[] = {detail::arrow_format<Ts>()...};
+            for ( std::size_t i = 0; i < sizeof...( Ts ); ++i )
+            {
+                const ArrowArray & child = *array.children[ i ];
+                const std::string name = schema.children[ i ]->name ? schema.children[ i ]->name : "";
+                if ( std::string( schema.children[ i ]->format ) != formats[ i ] )
+                {
+                    throw arrow_error( "column " + std::to_string( i ) + " (" + name + ") has format " +
+                                       schema.children[ i ]->format + ", expected " + formats[ i ] );
+                }
+                if ( child.n_buffers != 2 || child.null_count > 0 || child.length < array.offset + array.length )
+                {
+                    throw arrow_error( "column " + std::to_string( i ) + " (" + name +
+                                       ") is not a dense primitive array of the table's length" );
+                }
+            }
+        }
+
+        ArrowArray array_{};
+        size_type size_ = 0;
+        std::tuple<const Ts *...> columns_{};
+    };
+}
+
+#endif
@@ -0,0 +1,626 @@
+#ifndef SOA_CODEC_H
+#define SOA_CODEC_H
+
+#include "soa.h"
+
+#include <stdexcept>
+#include <string>
+
+namespace soa
+{
+    // Raised when an encoded column payload is malformed.
+    class codec_error : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    // Lightweight column codecs
+    //
+    // Each codec turns a column of count values into bytes and back. They are cheap enough to run on every chunk,
+    // so encode_best() simply tries every codec that applies to the column type and keeps the smallest output.
+    //
+    //     delta               first value, then zigzag varint differences: counters, sorted ids
+    //     delta_of_delta      first value and delta, then zigzag varint second differences: regular timestamps
+    //     run_length          (value, varint run) pairs: flags, slowly changing states
+    //     frame_of_reference  minimum, then every value minus the minimum bit packed: narrow ranges, prices in ticks
+    //     xor_float           Gorilla style XOR with the previous value: slowly varying floating point series
+    enum class encoding : std::uint32_t
+    {
+        raw = 0,
+        delta = 1,
+        delta_of_delta = 2,
+        run_length = 3,
+        frame_of_reference = 4,
+        xor_float = 5,
+    };
+
+    namespace detail
+    {
+        template <typename T>
+        using is_integer_column =
+            std::integral_constant<bool, std::is_integral<T>::value && !std::is_same<T, bool>::value>;
+
+        // Integers are widened to 64 bits (sign extended when signed) so that differences wrap consistently.
+        template <typename T>
+        std::uint64_t widen( T value )
+        {
+            return std::is_signed<T>::value ? std::uint64_t( std::int64_t( value ) ) : std::uint64_t( value );
+        }
+
+        template <typename T>
+        T narrow( std::uint64_t value )
+        {
+            return T( typename std::make_unsigned<T>::type( value ) );
+        }
+
+        inline std::uint64_t zigzag( std::uint64_t value )
+        {
+            return ( value << 1 ) ^ ( std::uint64_t( 0 ) - ( value >> 63 ) );
+        }
+
+        inline std::uint64_t unzigzag( std::uint64_t value )
+        {
+            return ( value >> 1 ) ^ ( std::uint64_t( 0 ) - ( value & 1 ) );
+        }
+
+        inline void put_varint( std::vector<unsigned char> & out, std::uint64_t value )
+        {
+            for ( ; value >= 0x80; value >>= 7 )
+            {
+                out.push_back( static_cast<unsigned char>( value | 0x80 ) );
+            }
+            out.push_back( static_cast<unsigned char>( value ) );
+        }
+
+        template <typename T>
+        void put_raw( std::vector<unsigned char> & out, const T & value )
+        {
+            const auto * bytes = reinterpret_cast<const unsigned char *>( &value );
+            out.insert( out.end(), bytes, bytes + sizeof( T ) );
+        }
+
+        // Bounds-checked cursor over an encoded payload.
+        class byte_reader
+        {
+        public:
+            byte_reader( const unsigned char * data, std::size_t size )
+                : data_( data )
+                , end_( data + size )
+            {
+            }
+
+            std::uint64_t varint()
+            {
+                std::uint64_t value = 0;
+                for ( unsigned shift = 0; shift < 64; shift += 7 )
+                {
+                    const unsigned char byte = next();
+                    value |= std::uint64_t( byte & 0x7f ) << shift;
+                    if ( ( byte & 0x80 ) == 0 )
+                    {
+                        return value;
+                    }
+                }
+                throw codec_error( "malformed varint" );
+            }
+
+            template <typename T>
+            T raw()
+            {
+                require( sizeof( T ) );
+                T value;
+                std::memcpy( &value, data_, sizeof( T ) );
+                data_ += sizeof( T );
+                return value;
+            }
+
+            unsigned char next()
+            {
+                require( 1 );
+                return *data_++;
+            }
+
+            // Returns the next bytes and moves past them.
+            const unsigned char * take( std::size_t bytes )
+            {
+                require( bytes );
+                const unsigned char * result = data_;
+                data_ += bytes;
+                return result;
+            }
+
+            std::size_t remaining() const
+            {
+                return std::size_t( end_ - data_ );
+            }
+
+        private:
+            void require( std::size_t bytes ) const
+            {
+                if ( remaining() < bytes )
+                {
+                    throw codec_error( "truncated column payload" );
+                }
+            }
+
+            const unsigned char * data_;
+            const unsigned char * end_;
+        };
+
+        // Most significant bit first bit stream writer.
+        class bit_writer
+        {
+        public:
+            explicit bit_writer( std::vector<unsigned char> & out )
+                : out_( out )
+            {
+            }
+
+            void write( std::uint64_t value, unsigned bits )
+            {
+                if ( bits > 32 )
+                {
+                    write_small( value >> 32, bits - 32 );
+                    bits = 32;
+                }
+                write_small( value & 0xffffffffu, bits );
+            }
+
+            void flush()
+            {
+                if ( filled_ > 0 )
+                {
+                    out_.push_back( static_cast<unsigned char>( accumulator_ << ( 8 - filled_ ) ) );
+                    filled_ = 0;
+                }
+            }
+
+        private:
+            void write_small( std::uint64_t value, unsigned bits )
+            {
+                accumulator_ = ( accumulator_ << bits ) | ( value & ( ( std::uint64_t( 1 ) << bits ) - 1 ) );
+                for ( filled_ += bits; filled_ >= 8; filled_ -= 8 )
+                {
+                    out_.push_back( static_cast<unsigned char>( accumulator_ >> ( filled_ - 8 ) ) );
+                }
+            }
+
+            std::vector<unsigned char> & out_;
+            std::uint64_t accumulator_ = 0;
+            unsigned filled_ = 0;
+        };
+
+        class bit_reader
+        {
+        public:
+            explicit bit_reader( byte_reader & in )
+                : in_( in )
+            {
+            }
+
+            std::uint64_t read( unsigned bits )
+            {
+                if ( bits > 32 )
+                {
+                    const std::uint64_t high = read_small( bits - 32 );
+                    return ( high << 32 ) | read_small( 32 );
+                }
+                return read_small( bits );
+            }
+
+        private:
+            std::uint64_t read_small( unsigned bits )
+            {
+                for ( ; filled_ < bits; filled_ += 8 )
+                {
+                    accumulator_ = ( accumulator_ << 8 ) | in_.next();
+                }
+                filled_ -= bits;
+                return ( accumulator_ >> filled_ ) & ( ( std::uint64_t( 1 ) << bits ) - 1 );
+            }
+
+            byte_reader & in_;
+            std::uint64_t accumulator_ = 0;
+            unsigned filled_ = 0;
+        };
+
+        template <typename T>
+        void encode_delta( const T * values, std::size_t count, std::vector<unsigned char> & out )
+        {
+            std::uint64_t previous = 0;
+            for ( std::size_t i = 0; i < count; ++i )
+            {
+                const std::uint64_t current = widen( values[ i ] );
+                put_varint( out, zigzag( current - previous ) );
+                previous = current;
+            }
+        }
+
+        template <typename T>
+        void decode_delta( byte_reader & in, T * out, std::size_t count )
+        {
+            std::uint64_t previous = 0;
+            for ( std::size_t i = 0; i < count; ++i )
+            {
+                previous += unzigzag( in.varint() );
+                out[ i ] = narrow<T>( previous );
+            }
+        }
+
+        template <typename T>
+        void encode_delta_of_delta( const T * values, std::size_t count, std::vector<unsigned char> & out )
+        {
+            std::uint64_t previous = 0;
+            std::uint64_t previous_delta = 0;
+            for ( std::size_t i = 0; i < count; ++i )
+            {
+                const std::uint64_t current = widen( values[ i ] );
+                const std::uint64_t delta = current - previous;
+                put_varint( out, zigzag( delta - previous_delta ) );
+                previous = current;
+                previous_delta = delta;
+            }
+        }
+
+        template <typename T>
+        void decode_delta_of_delta( byte_reader & in, T * out, std::size_t count )
+        {
+            std::uint64_t previous = 0;
+            std::uint64_t delta = 0;
+            for ( std::size_t i = 0; i < count; ++i )
+            {
+                delta += unzigzag( in.varint() );
+                previous += delta;
+                out[ i ] = narrow<T>( previous );
+            }
+        }
+
+        template <typename T>
+        void encode_run_length( const T * values, std::size_t count, std::vector<unsigned char> & out )
+        {
+            for ( std::size_t i = 0; i < count; )
+            {
+                std::size_t run = 1;
+                while ( i + run < count && std::memcmp( &values[ i + run ], &values[ i ], sizeof( T ) ) == 0 )
+                {
+                    ++run;
+                }
+                put_raw( out, values[ i ] );
+                put_varint( out, run );
+                i += run;
+            }
+        }
+
+        template <typename T>
+        void decode_run_length( byte_reader & in, T * out, std::size_t count )
+        {
+            for ( std::size_t i = 0; i < count; )
+            {
+                const T value = in.raw<T>();
+                const std::uint64_t run = in.varint();
+                if ( run == 0 || run > count - i )
+                {
+                    throw codec_error( "run exceeds column length" );
+                }
+                std::fill( out + i, out + i + run, value );
+                i += run;
+            }
+        }
+
+        // Maps integers onto unsigned values with the same ordering.
+        template <typename T>
+        std::uint64_t ordered( T value )
+        {
+            return std::is_signed<T>::value ? widen( value ) ^ ( std::uint64_t( 1 ) << 63 ) : widen( value );
+        }
+
+        template <typename T>
+        T from_ordered( std::uint64_t value )
+        {
+            return narrow<T>( std::is_signed<T>::value ? value ^ ( std::uint64_t( 1 ) << 63 ) : value );
+        }
+
+        template <typename T>
+        void encode_frame_of_reference( const T * values, std::size_t count, std::vector<unsigned char> & out )
+        {
+            std::uint64_t low = ~std::uint64_t( 0 );
+            std::uint64_t high = 0;
+            for ( std::size_t i = 0; i < count; ++i )
+            {
+                low = std::min( low, ordered( values[ i ] ) );
+                high = std::max( high, ordered( values[ i ] ) );
+            }
+            const unsigned bits = count == 0 || high == low ? 0 : 64 - count_leading_zeros( high - low );
+
+            put_raw( out, low );
+            out.push_back( static_cast<unsigned char>( bits ) );
+            bit_writer writer( out );
+            for ( std::size_t i = 0; bits > 0 && i < count; ++i )
+            {
+                writer.write( ordered( values[ i ] ) - low, bits );
+            }
+            writer.flush();
+        }
+
+        template <typename T>
+        void decode_frame_of_reference( byte_reader & in, T * out, std::size_t count )
+        {
+            const auto low = in.raw<std::uint64_t>();
+            const unsigned bits = in.next();
+            if ( bits > 64 )
+            {
+                throw codec_error( "invalid bit width" );
+            }
+            if ( bits == 0 )
+            {
+                std::fill( out, out + count, from_ordered<T>( low ) );
+                return;
+            }
+            bit_reader reader( in );
+            for ( std::size_t i = 0; i < count; ++i )
+            {
+                out[ i ] = from_ordered<T>( low + reader.read( bits ) );
+            }
+        }
+
+        template <typename T>
+        using float_bits = typename std::conditional<sizeof( T ) == 4, std::uint32_t, std::uint64_t>::type;
+
+        // Gorilla (Pelkonen et al., VLDB 2015) value compression: each value is XORed with its predecessor; an
+        // identical value costs one bit, and a XOR whose significant bits fit in the previous window costs two
+        // control bits plus the window. Otherwise the new window is spelled out with 6-bit leading zero and length
+        // fields.
+        template <typename T>
+        void encode_xor_float( const T * values, std::size_t count, std::vector<unsigned char> & out )
+        {
+            constexpr unsigned width = sizeof( T ) * 8;
+            bit_writer writer( out );
+            std::uint64_t previous = 0;
+            unsigned leading = width + 1;
+            unsigned trailing = 0;
+            for ( std::size_t i = 0; i < count; ++i )
+            {
+                float_bits<T> bits;
+                std::memcpy( &bits, &values[ i ], sizeof( T ) );
+                const std::uint64_t x = bits ^ previous;
+                previous = bits;
+                if ( x == 0 )
+                {
+                    writer.write( 0, 1 );
+                    continue;
+                }
+
+                const unsigned new_leading = count_leading_zeros( x ) - ( 64 - width );
+                const unsigned new_trailing = count_trailing_zeros( x );
+                if ( leading <= width && new_leading >= leading && new_trailing >= trailing )
+                {
+                    writer.write( 2, 2 );
+                    writer.write( x >> trailing, width - leading - trailing );
+                    continue;
+                }
+
+                leading = new_leading;
+                trailing = new_trailing;
+                const unsigned length = width - leading - trailing;
+                writer.write( 3, 2 );
+                writer.write( leading, 6 );
+                writer.write( length - 1, 6 );
+                writer.write( x >> trailing, length );
+            }
+            writer.flush();
+        }
+
+        template <typename T>
+        void decode_xor_float( byte_reader & in, T * out, std::size_t count )
+        {
+            constexpr unsigned width = sizeof( T ) * 8;
+            bit_reader reader( in );
+            std::uint64_t previous = 0;
+            unsigned leading = width + 1;
+            unsigned trailing = 0;
+            for ( std::size_t i = 0; i < count; ++i )
+            {
+                if ( reader.read( 1 ) != 0 )
+                {
+                    if ( reader.read( 1 ) != 0 )
+                    {
+                        leading = unsigned( reader.read( 6 ) );
+                        const unsigned length = unsigned( reader.read( 6 ) ) + 1;
+                        if ( leading + length > width )
+                        {
+                            throw codec_error( "invalid xor window" );
+                        }
+                        trailing = width - leading - length;
+                    }
+                    else if ( leading > width )
+                    {
+                        throw codec_error( "xor window used before being defined" );
+                    }
+                    previous ^= reader.read( width - leading - trailing ) << trailing;
+                }
+                const auto bits = static_cast<float_bits<T>>( previous );
+                std::memcpy( &out[ i ], &bits, sizeof( T ) );
+            }
+        }
+
+        template <typename T>
+        bool codec_applies( encoding codec )
+        {
+            switch ( codec )
+            {
+            case encoding::raw:
+            case encoding::run_length:
+                return true;
+            case encoding::delta:
+            case encoding::delta_of_delta:
+            case encoding::frame_of_reference:
+                return is_integer_column<T>::value && sizeof( T ) <= 8;
+            case encoding::xor_float:
+                return std::is_floating_point<T>::value && ( sizeof( T ) == 4 || sizeof( T ) == 8 );
+            }
+            return false;
+        }
+
+        template <typename T>
+        void encode_integers( encoding codec,
+                              const T * values,
+                              std::size_t count,
+                              std::vector<unsigned char> & out,
+                              std::true_type )
+        {
+            switch ( codec )
+            {
+            case encoding::delta:
+                return encode_delta( values, count, out );
+            case encoding::delta_of_delta:
+                return encode_delta_of_delta( values, count, out );
+            default:
+                return encode_frame_of_reference( values, count, out );
+            }
+        }
+
+        template <typename T>
+        void encode_integers( encoding, const T *, std::size_t, std::vector<unsigned char> &, std::false_type )
+        {
+        }
+
+        template <typename T>
+        void encode_floats( const T * values, std::size_t count, std::vector<unsigned char> & out, std::true_type )
+        {
+            encode_xor_float( values, count, out );
+        }
+
+        template <typename T>
+        void encode_floats( const T *, std::size_t, std::vector<unsigned char> &, std::false_type )
+        {
+        }
+
+        template <typename T>
+        void decode_integers( encoding codec, byte_reader & in, T * out, std::size_t count, std::true_type )
+        {
+            switch ( codec )
+            {
+            case encoding::delta:
+                return decode_delta( in, out, count );
+            case encoding::delta_of_delta:
+                return decode_delta_of_delta( in, out, count );
+            default:
+                return decode_frame_of_reference( in, out, count );
+            }
+        }
+
+        template <typename T>
+        void decode_integers( encoding, byte_reader &, T *, std::size_t, std::false_type )
+        {
+        }
+
+        template <typename T>
+        void decode_floats( byte_reader & in, T * out, std::size_t count, std::true_type )
+        {
+            decode_xor_float( in, out, count );
+        }
+
+        template <typename T>
+        void decode_floats( byte_reader &, T *, std::size_t, std::false_type )
+        {
+        }
+
+        template <typename T>
+        using is_xor_float = std::integral_constant<bool,
+                                                    std::is_floating_point<T>::value &&
+                                                        ( sizeof( T ) == 4 || sizeof( T ) == 8 )>;
+    }
+
+    // Replaces out with count values encoded with codec, which must apply to T.
+    template <typename T>
+    void encode( encoding codec, const T * values, std::size_t count, std::vector<unsigned char> & out )
+    {
+        assert( detail::codec_applies<T>( codec ) );
+        out.clear();
+        switch ( codec )
+        {
+        case encoding::raw:
+            out.resize( count * sizeof( T ) );
+            if ( count > 0 )
+            {
+                std::memcpy( out.data(), values, count * sizeof( T ) );
+            }
+            return;
+        case encoding::run_length:
+            return detail::encode_run_length( values, count, out );
+        case encoding::xor_float:
+            return detail::encode_floats( values, count, out, detail::is_xor_float<T>{} );
+        default:
+            return detail::encode_integers( codec, values, count, out, detail::is_integer_column<T>{} );
+        }
+    }
+
+    // Encodes values with every codec that applies to T and keeps the smallest result in out; scratch is working
+    // space. Both buffers keep their capacity, so steady-state encoding allocates nothing.
+    template <typename T>
+    encoding encode_best( const T * values,
+                          std::size_t count,
+                          std::vector<unsigned char> & out,
+                          std::vector<unsigned char> & scratch )
+    {
+        const encoding candidates[] = {encoding::delta,
+                                       encoding::delta_of_delta,
+                                       encoding::run_length,
+                                       encoding::frame_of_reference,
+                                       encoding::xor_float};
+        encoding best = encoding::raw;
+        std::size_t best_size = count * sizeof( T );
+        for ( const encoding codec : candidates )
+        {
+            if ( !detail::codec_applies<T>( codec ) )
+            {
+                continue;
+            }
+            encode( codec, values, count, scratch );
+            if ( scratch.size() < best_size )
+            {
+                best = codec;
+                best_size = scratch.size();
+                out.swap( scratch );
+            }
+        }
+        if ( best == encoding::raw )
+        {
+            encode( encoding::raw, values, count, out );
+        }
+        return best;
+    }
+
+    // Decodes count values straight into out, typically a column of an existing container.
+    template <typename T>
+    void decode( encoding codec, const unsigned char * data, std::size_t bytes, T * out, std::size_t count )
+    {
+        if ( !detail::codec_applies<T>( codec ) )
+        {
+            throw codec_error( "encoding " + std::to_string( std::uint32_t( codec ) ) + " does not apply to column" );
+        }
+        detail::byte_reader in( data, bytes );
+        switch ( codec )
+        {
+        case encoding::raw:
+            if ( bytes != count * sizeof( T ) )
+            {
+                throw codec_error( "raw column payload has the wrong size" );
+            }
+            if ( count > 0 )
+            {
+                std::memcpy( out, data, bytes );
+            }
+            return;
+        case encoding::run_length:
+            return detail::decode_run_length( in, out, count );
+        case encoding::xor_float:
+            return detail::decode_floats( in, out, count, detail::is_xor_float<T>{} );
+        default:
+            return detail::decode_integers( codec, in, out, count, detail::is_integer_column<T>{} );
+        }
+    }
+}
+
+#endif
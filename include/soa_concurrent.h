@@ -0,0 +1,537 @@
+#ifndef SOA_CONCURRENT_H
+#define SOA_CONCURRENT_H
+
+#include "soa.h"
+
+#include <atomic>
+#include <thread>
+
+namespace soa
+{
+    namespace detail
+    {
+        constexpr std::size_t cache_line_size = 64;
+
+        // A position owned by one thread, next to that thread's cached copy of the other thread's position. Padded
+        // on both sides so that it shares no cache line with anything else, whatever the enclosing object's
+        // alignment.
+        struct queue_position
+        {
+            unsigned char leading_padding[ cache_line_size ];
+            std::atomic<std::size_t> position{0};
+            std::size_t cached_other = 0;
+            unsigned char trailing_padding[ cache_line_size - sizeof( std::atomic<std::size_t> ) -
+                                           sizeof( std::size_t ) ];
+        };
+
+        // A counter shared by many threads, alone on its cache line.
+        struct padded_counter
+        {
+            unsigned char leading_padding[ cache_line_size ];
+            std::atomic<std::size_t> value{0};
+            unsigned char trailing_padding[ cache_line_size - sizeof( std::atomic<std::size_t> ) ];
+        };
+    }
+
+    // Bounded lock-free queue of rows between exactly one producer thread and one consumer thread. Slots are
+    // columns: one cache line aligned array per column, with a power-of-two capacity. Batch push and pop copy
+    // whole column ranges and publish them with a single atomic store, so the synchronization cost is paid per
+    // batch rather than per row. The producer and consumer positions live on separate cache lines, and each side
+    // caches the other's position, reading the other side's line only when the cached value looks too full or
+    // too empty for the request.
+    //
+    //     soa::spsc_queue<std::uint64_t, double> ticks( 1 << 16 );
+    //     // producer                               // consumer
+    //     ticks.push( decoded );                    ticks.pop( batch, 1024 );
+    template <typename... Ts>
+    class spsc_queue
+    {
+        static_assert( sizeof...( Ts ) > 0, "soa::spsc_queue needs at least one column" );
+        static_assert( detail::all_of<std::is_trivially_copyable<Ts>::value...>::value,
+                       "soa::spsc_queue columns must be trivially copyable" );
+
+    public:
+        using size_type = std::size_t;
+        using value_type = std::tuple<Ts...>;
+
+        template <std::size_t I>
+        using column_type = typename std::tuple_element<I, value_type>::type;
+
+        static constexpr std::size_t column_count = sizeof...( Ts );
+
+        // The capacity is rounded up to a power of two. If an allocation throws, the columns allocated so far are
+        // freed.
+        explicit spsc_queue( size_type capacity )
+            : capacity_( detail::round_up_to_power_of_two( std::max<size_type>( capacity, 1 ) ) )
+        {
+            try
+            {
+                detail::for_each_index<column_count>( [&]( auto column ) {
+                    constexpr std::size_t I = decltype( column )::value;
+                    std::get<I>( columns_ ) = detail::allocate_column<column_type<I>>( capacity_ );
+                } );
+            }
+            catch ( ... )
+            {
+                free_columns( columns_ );
+                throw;
+            }
+        }
+
+        spsc_queue( const spsc_queue & ) = delete;
+        spsc_queue & operator=( const spsc_queue & ) = delete;
+
+        ~spsc_queue()
+        {
+            free_columns( columns_ );
+        }
+
+        size_type capacity() const
+        {
+            return capacity_;
+        }
+
+        // Rows in the queue; exact only when called while the other side is idle.
+        size_type size() const
+        {
+            const size_type head = consumer_.position.load( std::memory_order_acquire );
+            const size_type tail = producer_.position.load( std::memory_order_acquire );
+            return tail - head;
+        }
+
+        // Producer side. Copies up to count rows from the given columns and returns how many fit.
+        size_type push( size_type count, const Ts *... columns )
+        {
+            const size_type tail = producer_.position.load( std::memory_order_relaxed );
+            count = std::min( count, free_slots( tail, count ) );
+            if ( count == 0 )
+            {
+                return 0;
+            }
+
+            const std::tuple<const Ts *...> sources( columns... );
+            const size_type start = tail & ( capacity_ - 1 );
+            const size_type first = std::min( count, capacity_ - start );
+            detail::for_each_index<column_count>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                copy_n( std::get<I>( sources ), first, std::get<I>( columns_ ) + start );
+                copy_n( std::get<I>( sources ) + first, count - first, std::get<I>( columns_ ) );
+            } );
+            producer_.position.store( tail + count, std::memory_order_release );
+            return count;
+        }
+
+        // Producer side. Pushes rows [first, rows.size()) of any container with the queue's columns, as many as fit.
+        template <typename Vector>
+        size_type push( const Vector & rows, size_type first = 0 )
+        {
+            assert( first <= rows.size() );
+            return push_columns( rows, first, std::index_sequence_for<Ts...>{} );
+        }
+
+        // Producer side.
+        bool try_push( const Ts &... values )
+        {
+            return push( 1, &values... ) == 1;
+        }
+
+        // Consumer side. Moves up to max_count rows into the given columns and returns how many were available.
+        size_type pop( size_type max_count, Ts *... columns )
+        {
+            const size_type head = consumer_.position.load( std::memory_order_relaxed );
+            const size_type count = std::min( max_count, available_rows( head, max_count ) );
+            if ( count == 0 )
+            {
+                return 0;
+            }
+
+            const std::tuple<Ts *...> targets( columns... );
+            const size_type start = head & ( capacity_ - 1 );
+            const size_type first = std::min( count, capacity_ - start );
+            detail::for_each_index<column_count>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                copy_n( std::get<I>( columns_ ) + start, first, std::get<I>( targets ) );
+                copy_n( std::get<I>( columns_ ), count - first, std::get<I>( targets ) + first );
+            } );
+            consumer_.position.store( head + count, std::memory_order_release );
+            return count;
+        }
+
+        // Consumer side. Appends up to max_count rows to out and returns how many were available.
+        size_type pop( vector<Ts...> & out, size_type max_count )
+        {
+            const size_type head = consumer_.position.load( std::memory_order_relaxed );
+            const size_type offset = out.size();
+            out.resize( offset + std::min( max_count, available_rows( head, max_count ) ) );
+            return pop_columns( out, offset, std::index_sequence_for<Ts...>{} );
+        }
+
+        // Consumer side.
+        bool try_pop( Ts &... values )
+        {
+            return pop( 1, &values... ) == 1;
+        }
+
+    private:
+        template <typename T>
+        static void copy_n( const T * src, size_type count, T * dst )
+        {
+            if ( count > 0 )
+            {
+                std::memcpy( dst, src, count * sizeof( T ) );
+            }
+        }
+
+        // Reloads the consumer position only when the cached one leaves room for fewer than wanted rows.
+        size_type free_slots( size_type tail, size_type wanted )
+        {
+            size_type free = capacity_ - ( tail - producer_.cached_other );
+            if ( free < wanted )
+            {
+                producer_.cached_other = consumer_.position.load( std::memory_order_acquire );
+                free = capacity_ - ( tail - producer_.cached_other );
+            }
+            return free;
+        }
+
+        // Reloads the producer position only when the cached one shows fewer than wanted rows.
+        size_type available_rows( size_type head, size_type wanted )
+        {
+            size_type available = consumer_.cached_other - head;
+            if ( available < wanted )
+            {
+                consumer_.cached_other = producer_.position.load( std::memory_order_acquire );
+                available = consumer_.cached_other - head;
+            }
+            return available;
+        }
+
+        template <typename Vector, std::size_t... Is>
+        size_type push_columns( const Vector & rows, size_type first, std::index_sequence<Is...> )
+        {
+            return push( rows.size() - first, ( rows.template data<Is>() + first )... );
+        }
+
+        template <std::size_t... Is>
+        size_type pop_columns( vector<Ts...> & out, size_type offset, std::index_sequence<Is...> )
+        {
+            return pop( out.size() - offset, ( out.template data<Is>() + offset )... );
+        }
+
+        static void free_columns( const std::tuple<Ts *...> & columns )
+        {
+            detail::for_each_index<column_count>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                detail::deallocate( std::get<I>( columns ) );
+            } );
+        }
+
+        std::tuple<Ts *...> columns_{};
+        size_type capacity_;
+        detail::queue_position producer_;
+        detail::queue_position consumer_;
+    };
+
+    // Append-only table that many threads fill at once. A writer reserves a range of rows with a single atomic
+    // fetch_add, writes its columns straight into the table, and publishes the range. Storage grows by segments
+    // whose sizes double, so rows never move once written and no reservation waits on a reallocation. Readers see
+    // the published prefix: every row below size() is fully written and stays valid while writers keep appending.
+    //
+    // Ranges are published in reservation order: publish waits until every earlier range has been published, so a
+    // writer must publish each range it reserves.
+    //
+    //     soa::concurrent_appender<std::uint64_t, double> fills;
+    //     // on any thread
+    //     const std::size_t first = fills.reserve( batch.size() );
+    //     fills.write( first, batch );
+    //     fills.publish( first, batch.size() );
+    template <typename... Ts>
+    class concurrent_appender
+    {
+        static_assert( sizeof...( Ts ) > 0, "soa::concurrent_appender needs at least one column" );
+        static_assert( detail::all_of<std::is_trivially_copyable<Ts>::value...>::value,
+                       "soa::concurrent_appender columns must be trivially copyable" );
+
+    public:
+        using size_type = std::size_t;
+        using value_type = std::tuple<Ts...>;
+        using const_reference = std::tuple<const Ts &...>;
+        using const_iterator = row_iterator<const concurrent_appender, const_reference>;
+
+        template <std::size_t I>
+        using column_type = typename std::tuple_element<I, value_type>::type;
+
+        static constexpr std::size_t column_count = sizeof...( Ts );
+
+        // Segment k holds first_segment << k rows; first_segment is rounded up to a power of two.
+        explicit concurrent_appender( size_type first_segment = 1024 )
+            : segment_shift_( shift_of( detail::round_up_to_power_of_two( std::max<size_type>( first_segment, 1 ) ) ) )
+        {
+            for ( std::atomic<segment *> & s : segments_ )
+            {
+                s.store( nullptr, std::memory_order_relaxed );
+            }
+        }
+
+        concurrent_appender( const concurrent_appender & ) = delete;
+        concurrent_appender & operator=( const concurrent_appender & ) = delete;
+
+        ~concurrent_appender()
+        {
+            for ( std::atomic<segment *> & s : segments_ )
+            {
+                delete s.load( std::memory_order_relaxed );
+            }
+        }
+
+        // Rows published so far.
+        size_type size() const
+        {
+            return published_.value.load( std::memory_order_acquire );
+        }
+
+        bool empty() const
+        {
+            return size() == 0;
+        }
+
+        // Rows reserved so far, published or not.
+        size_type reserved() const
+        {
+            return reserved_.value.load( std::memory_order_relaxed );
+        }
+
+        // Reserves count rows for the calling thread and returns the first one. Their values are unspecified until
+        // written.
+        size_type reserve( size_type count )
+        {
+            const size_type first = reserved_.value.fetch_add( count, std::memory_order_relaxed );
+            if ( count > 0 )
+            {
+                const size_type last = segment_of( first + count - 1 );
+                for ( size_type k = segment_of( first ); k <= last; ++k )
+                {
+                    allocate_segment( k );
+                }
+            }
+            return first;
+        }
+
+        // Copies the rows of any container with the table's columns into the reserved rows starting at first.
+        template <typename Vector>
+        void write( size_type first, const Vector & rows )
+        {
+            assert( first + rows.size() <= reserved() );
+            detail::for_each_index<column_count>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                const auto * source = rows.template data<I>();
+                for_each_piece( first, first + rows.size(), [&]( segment & s, size_type offset, size_type count ) {
+                    std::copy( source, source + count, std::get<I>( s.columns ) + offset );
+                    source += count;
+                } );
+            } );
+        }
+
+        void write_row( size_type row, const Ts &... values )
+        {
+            assert( row < reserved() );
+            segment & s = *segments_[ segment_of( row ) ].load( std::memory_order_acquire );
+            assign_row( s, row - segment_begin( segment_of( row ) ), std::index_sequence_for<Ts...>{}, values... );
+        }
+
+        // Makes rows [first, first + count) visible to readers, once all earlier reservations are published.
+        void publish( size_type first, size_type count )
+        {
+            while ( published_.value.load( std::memory_order_acquire ) != first )
+            {
+                std::this_thread::yield();
+            }
+            published_.value.store( first + count, std::memory_order_release );
+        }
+
+        // Reserves, writes and publishes the rows of a container; returns the first row.
+        template <typename Vector>
+        size_type append( const Vector & rows )
+        {
+            const size_type first = reserve( rows.size() );
+            write( first, rows );
+            publish( first, rows.size() );
+            return first;
+        }
+
+        // Writers may access their reserved rows, readers the published ones.
+        template <std::size_t I>
+        column_type<I> & get( size_type row )
+        {
+            assert( row < reserved() );
+            const size_type k = segment_of( row );
+            segment & s = *segments_[ k ].load( std::memory_order_acquire );
+            return std::get<I>( s.columns )[ row - segment_begin( k ) ];
+        }
+
+        template <std::size_t I>
+        const column_type<I> & get( size_type row ) const
+        {
+            assert( row < reserved() );
+            const size_type k = segment_of( row );
+            const segment & s = *segments_[ k ].load( std::memory_order_acquire );
+            return std::get<I>( s.columns )[ row - segment_begin( k ) ];
+        }
+
+        // Calls f with the published rows of column I, one contiguous span per segment, in row order.
+        template <std::size_t I, typename F>
+        void for_each_span( F f ) const
+        {
+            for_each_piece( 0, size(), [&]( const segment & s, size_type offset, size_type count ) {
+                f( span<const column_type<I>>( std::get<I>( s.columns ) + offset, count ) );
+            } );
+        }
+
+        const_reference operator[]( size_type i ) const
+        {
+            assert( i < reserved() );
+            const size_type k = segment_of( i );
+            return row( *segments_[ k ].load( std::memory_order_acquire ),
+                        i - segment_begin( k ),
+                        std::index_sequence_for<Ts...>{} );
+        }
+
+        // Iterates the rows published when begin() and end() are called.
+        const_iterator begin() const
+        {
+            return {this, 0};
+        }
+
+        const_iterator end() const
+        {
+            return {this, size()};
+        }
+
+        // Copies the published rows.
+        vector<Ts...> to_vector() const
+        {
+            vector<Ts...> result( size() );
+            detail::for_each_index<column_count>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                auto * target = result.template data<I>();
+                for_each_piece( 0, result.size(), [&]( const segment & s, size_type offset, size_type count ) {
+                    std::copy( std::get<I>( s.columns ) + offset, std::get<I>( s.columns ) + offset + count, target );
+                    target += count;
+                } );
+            } );
+            return result;
+        }
+
+    private:
+        struct segment
+        {
+            // If an allocation throws, the columns allocated so far are freed.
+            explicit segment( size_type rows )
+            {
+                try
+                {
+                    detail::for_each_index<column_count>( [&]( auto column ) {
+                        constexpr std::size_t I = decltype( column )::value;
+                        std::get<I>( columns ) = detail::allocate_column<column_type<I>>( rows );
+                    } );
+                }
+                catch ( ... )
+                {
+                    release();
+                    throw;
+                }
+            }
+
+            segment( const segment & ) = delete;
+            segment & operator=( const segment & ) = delete;
+
+            ~segment()
+            {
+                release();
+            }
+
+            void release()
+            {
+                detail::for_each_index<column_count>( [&]( auto column ) {
+                    constexpr std::size_t I = decltype( column )::value;
+                    detail::deallocate( std::get<I>( columns ) );
+                } );
+            }
+
+            std::tuple<Ts *...> columns{};
+        };
+
+        static constexpr std::size_t max_segments = 64;
+
+        static unsigned shift_of( size_type power_of_two )
+        {
+            return 63 - detail::count_leading_zeros( power_of_two );
+        }
+
+        // Segment k covers rows [( 2^k - 1 ) << shift, ( 2^( k + 1 ) - 1 ) << shift).
+        size_type segment_of( size_type row ) const
+        {
+            return shift_of( ( row >> segment_shift_ ) + 1 );
+        }
+
+        size_type segment_begin( size_type k ) const
+        {
+            return ( ( size_type( 1 ) << k ) - 1 ) << segment_shift_;
+        }
+
+        size_type segment_rows( size_type k ) const
+        {
+            return size_type( 1 ) << ( k + segment_shift_ );
+        }
+
+        // Installs segment k unless another writer already has.
+        void allocate_segment( size_type k )
+        {
+            assert( k < max_segments );
+            if ( segments_[ k ].load( std::memory_order_acquire ) != nullptr )
+            {
+                return;
+            }
+            auto * fresh = new segment( segment_rows( k ) );
+            segment * expected = nullptr;
+            if ( !segments_[ k ].compare_exchange_strong( expected, fresh, std::memory_order_acq_rel ) )
+            {
+                delete fresh;
+            }
+        }
+
+        // Calls f( segment, offset in segment, count ) for each segment that rows [begin, end) span.
+        template <typename F>
+        void for_each_piece( size_type begin, size_type end, F f ) const
+        {
+            while ( begin < end )
+            {
+                const size_type k = segment_of( begin );
+                const size_type offset = begin - segment_begin( k );
+                const size_type count = std::min( end - begin, segment_rows( k ) - offset );
+                f( *segments_[ k ].load( std::memory_order_acquire ), offset, count );
+                begin += count;
+            }
+        }
+
+        template <std::size_t... Is>
+        static void assign_row( segment & s, size_type offset, std::index_sequence<Is...>, const Ts &... values )
+        {
+            using swallow = int[];
+            (void)swallow{0, ( std::get<Is>( s.columns )[ offset ] = values, 0 )...};
+        }
+
+        template <std::size_t... Is>
+        static const_reference row( const segment & s, size_type offset, std::index_sequence<Is...> )
+        {
+            return const_reference( std::get<Is>( s.columns )[ offset ]... );
+        }
+
+        const unsigned segment_shift_;
+        std::atomic<segment *> segments_[ max_segments ];
+        detail::padded_counter reserved_;
+        detail::padded_counter published_;
+    };
+}
+
+#endif
@@ -0,0 +1,489 @@
+#ifndef SOA_CSV_H
+#define SOA_CSV_H
+
+#include "soa_io.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+
+#if defined( __AVX2__ )
+#include <immintrin.h>
+#elif defined( __SSE2__ )
+#include <emmintrin.h>
+#endif
+
+namespace soa
+{
+    // Raised when CSV input does not match the requested schema.
+    class csv_error : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    struct csv_options
+    {
+        char delimiter = ',';
+        // Skip the first line.
+        bool header = true;
+        // Inputs larger than a few megabytes are split at line boundaries and parsed by this many threads.
+        unsigned threads = 1;
+    };
+
+    // CSV ingest
+    //
+    // Input is classified 64 bytes at a time into bitmasks of quotes, delimiters and newlines. A prefix XOR of the
+    // quote mask marks the bytes inside quoted fields, which leaves the field separators as
+    // ( delimiters | newlines ) & ~inside: fields are then found by walking set bits instead of bytes. Each field is
+    // parsed in place, without copying, and stored straight into its column.
+    //
+    // Fields hold numbers (optionally quoted) or, for bool columns, 0, 1, true or false. Empty fields are errors.
+    // Lines may end in \n or \r\n; blank lines are skipped.
+
+    namespace detail
+    {
+        constexpr std::size_t csv_block = 64;
+        constexpr std::size_t csv_min_split_bytes = std::size_t( 4 ) << 20;
+
+        struct csv_masks
+        {
+            std::uint64_t quotes;
+            std::uint64_t delimiters;
+            std::uint64_t newlines;
+        };
+
+        inline csv_masks classify_scalar( const char * p, char delimiter )
+        {
+            csv_masks masks{0, 0, 0};
+            for ( unsigned i = 0; i < csv_block; ++i )
+            {
+                masks.quotes |= std::uint64_t( p[ i ] == '"' ) << i;
+                masks.delimiters |= std::uint64_t( p[ i ] == delimiter ) << i;
+                masks.newlines |= std::uint64_t( p[ i ] == '\n' ) << i;
+            }
+            return masks;
+        }
+
+        // Classifies 64 bytes with the widest vector compares available at compile time.
+        inline csv_masks classify( const char * p, char delimiter )
+        {
+#if defined( __AVX2__ )
+            const __m256i quote = _mm256_set1_epi8( '"' );
+            const __m256i separator = _mm256_set1_epi8( delimiter );
+            const __m256i newline = _mm256_set1_epi8( '\n' );
+            const auto mask = [&]( __m256i value ) {
+                return std::uint64_t( std::uint32_t( _mm256_movemask_epi8( value ) ) );
+            };
+            const __m256i low = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( p ) );
+            const __m256i high = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( p + 32 ) );
+            return {mask( _mm256_cmpeq_epi8( low, quote ) ) | mask( _mm256_cmpeq_epi8( high, quote ) ) << 32,
+                    mask( _mm256_cmpeq_epi8( low, separator ) ) | mask( _mm256_cmpeq_epi8( high, separator ) ) << 32,
+                    mask( _mm256_cmpeq_epi8( low, newline ) ) | mask( _mm256_cmpeq_epi8( high, newline ) ) << 32};
+#elif defined( __SSE2__ )
+            const __m128i quote = _mm_set1_epi8( '"' );
+            const __m128i separator = _mm_set1_epi8( delimiter );
+            const __m128i newline = _mm_set1_epi8( '\n' );
+            const auto mask = [&]( __m128i value, __m128i match, unsigned shift ) {
+                return std::uint64_t( std::uint32_t( _mm_movemask_epi8( _mm_cmpeq_epi8( value, match ) ) ) ) << shift;
+            };
+            csv_masks masks{0, 0, 0};
+            for ( unsigned i = 0; i < csv_block; i += 16 )
+            {
+                const __m128i value = _mm_loadu_si128( reinterpret_cast<const __m128i *>( p + i ) );
+                masks.quotes |= mask( value, quote, i );
+                masks.delimiters |= mask( value, separator, i );
+                masks.newlines |= mask( value, newline, i );
+            }
+            return masks;
+#else
+            return classify_scalar( p, delimiter );
+#endif
+        }
+
+        // Bit i of the result is the XOR of bits 0..i of x: set for every byte after an odd number of quotes.
+        inline std::uint64_t prefix_xor( std::uint64_t x )
+        {
+            x ^= x << 1;
+            x ^= x << 2;
+            x ^= x << 4;
+            x ^= x << 8;
+            x ^= x << 16;
+            x ^= x << 32;
+            return x;
+        }
+
+        // Start of the line after the first newline at or after p that is outside quotes, given whether p itself is
+        // inside quotes.
+        inline const char * next_line( const char * p, const char * end, bool quoted )
+        {
+            for ( ; p < end; ++p )
+            {
+                if ( *p == '"' )
+                {
+                    quoted = !quoted;
+                }
+                else if ( *p == '\n' && !quoted )
+                {
+                    return p + 1;
+                }
+            }
+            return end;
+        }
+
+        template <typename T>
+        typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, bool>::type
+        parse_value( const char * p, const char * end, T & out )
+        {
+            bool negative = false;
+            if ( p < end && ( *p == '-' || *p == '+' ) )
+            {
+                negative = *p++ == '-';
+            }
+            if ( p == end || ( negative && !std::is_signed<T>::value ) )
+            {
+                return false;
+            }
+
+            using unsigned_type = typename std::make_unsigned<T>::type;
+            const auto limit =
+                std::uint64_t( std::numeric_limits<T>::max() ) + std::uint64_t( negative && std::is_signed<T>::value );
+            std::uint64_t value = 0;
+            for ( ; p < end; ++p )
+            {
+                const auto digit = unsigned( *p - '0' );
+                if ( digit > 9 || value > ( limit - digit ) / 10 )
+                {
+                    return false;
+                }
+                value = value * 10 + digit;
+            }
+            out = T( unsigned_type( negative ? 0 - value : value ) );
+            return true;
+        }
+
+        inline bool parse_value( const char * p, const char * end, bool & out )
+        {
+            const auto length = std::size_t( end - p );
+            if ( ( length == 1 && *p == '1' ) || ( length == 4 && std::memcmp( p, "true", 4 ) == 0 ) )
+            {
+                out = true;
+                return true;
+            }
+            if ( ( length == 1 && *p == '0' ) || ( length == 5 && std::memcmp( p, "false", 5 ) == 0 ) )
+            {
+                out = false;
+                return true;
+            }
+            return false;
+        }
+
+        inline float parse_fallback( const char * text, char ** end, float )
+        {
+            return std::strtof( text, end );
+        }
+
+        inline double parse_fallback( const char * text, char ** end, double )
+        {
+            return std::strtod( text, end );
+        }
+
+        inline long double parse_fallback( const char * text, char ** end, long double )
+        {
+            return std::strtold( text, end );
+        }
+
+        // Decimal numbers whose mantissa and power of ten are both exactly representable in T are converted with a
+        // single, correctly rounded multiplication or division (Clinger's fast path); everything else, including
+        // long mantissas, nan and inf, goes through strtod on a terminated copy.
+        template <typename T>
+        typename std::enable_if<std::is_floating_point<T>::value, bool>::type
+        parse_value( const char * begin, const char * end, T & out )
+        {
+            constexpr int exact_digits = std::numeric_limits<T>::digits >= 53 ? 15 : 7;
+            constexpr int exact_power = std::numeric_limits<T>::digits >= 53 ? 22 : 10;
+            static const T powers[] = {T( 1e0 ),  T( 1e1 ),  T( 1e2 ),  T( 1e3 ),  T( 1e4 ),  T( 1e5 ),
+                                       T( 1e6 ),  T( 1e7 ),  T( 1e8 ),  T( 1e9 ),  T( 1e10 ), T( 1e11 ),
+                                       T( 1e12 ), T( 1e13 ), T( 1e14 ), T( 1e15 ), T( 1e16 ), T( 1e17 ),
+                                       T( 1e18 ), T( 1e19 ), T( 1e20 ), T( 1e21 ), T( 1e22 )};
+
+            const char * p = begin;
+            const bool negative = p < end && *p == '-';
+            if ( p < end && ( *p == '-' || *p == '+' ) )
+            {
+                ++p;
+            }
+            std::uint64_t mantissa = 0;
+            int digits = 0;
+            int exponent = 0;
+            bool any = false;
+            for ( ; p < end && unsigned( *p - '0' ) <= 9; ++p, any = true )
+            {
+                mantissa = mantissa * 10 + unsigned( *p - '0' );
+                digits += mantissa != 0;
+            }
+            if ( p < end && *p == '.' )
+            {
+                for ( ++p; p < end && unsigned( *p - '0' ) <= 9; ++p, any = true )
+                {
+                    mantissa = mantissa * 10 + unsigned( *p - '0' );
+                    digits += mantissa != 0;
+                    --exponent;
+                }
+            }
+            if ( any && p < end && ( *p == 'e' || *p == 'E' ) )
+            {
+                const char * q = p + 1;
+                const bool negative_exponent = q < end && *q == '-';
+                if ( q < end && ( *q == '-' || *q == '+' ) )
+                {
+                    ++q;
+                }
+                int value = 0;
+                const char * digits_begin = q;
+                for ( ; q < end && unsigned( *q - '0' ) <= 9 && value < 10000; ++q )
+                {
+                    value = value * 10 + ( *q - '0' );
+                }
+                if ( q != digits_begin )
+                {
+                    exponent += negative_exponent ? -value : value;
+                    p = q;
+                }
+            }
+
+            if ( any && p == end && digits <= exact_digits && std::abs( exponent ) <= exact_power )
+            {
+                const T value = exponent < 0 ? T( mantissa ) / powers[ -exponent ] : T( mantissa ) * powers[ exponent ];
+                out = negative ? -value : value;
+                return true;
+            }
+
+            char buffer[ 64 ];
+            std::string long_text;
+            const auto length = std::size_t( end - begin );
+            const char * text = buffer;
+            if ( length < sizeof( buffer ) )
+            {
+                std::memcpy( buffer, begin, length );
+                buffer[ length ] = '\0';
+            }
+            else
+            {
+                long_text.assign( begin, end );
+                text = long_text.c_str();
+            }
+            char * parsed_end = nullptr;
+            out = parse_fallback( text, &parsed_end, T() );
+            return length > 0 && parsed_end == text + length;
+        }
+
+        template <typename T>
+        bool parse_field( const char * begin, const char * end, char * destination )
+        {
+            return parse_value( begin, end, *reinterpret_cast<T *>( destination ) );
+        }
+
+        [[noreturn]] inline void throw_csv( const char * base, const char * at, const std::string & what )
+        {
+            throw csv_error( "csv byte " + std::to_string( at - base ) + ": " + what );
+        }
+
+        // Parses the complete lines in [begin, end) into out. base is the start of the input, for error messages.
+        template <typename... Ts>
+        void parse_csv_range(
+            const char * base, const char * begin, const char * end, char delimiter, vector<Ts...> & out )
+        {
+            using parser = bool ( * )( const char *, const char *, char * );
+            constexpr std::size_t column_count = sizeof...( Ts );
+            const parser parsers[] = {&parse_field<Ts>...};
+            const std::size_t sizes[] = {sizeof( Ts )...};
+            char * columns[ column_count ];
+            const auto refresh = [&]() {
+                detail::for_each_index<column_count>( [&]( auto column ) {
+                    constexpr std::size_t I = decltype( column )::value;
+                    columns[ I ] = reinterpret_cast<char *>( out.template data<I>() );
+                } );
+            };
+
+            std::size_t rows = 0;
+            std::size_t field = 0;
+            const char * field_begin = begin;
+            const auto end_field = [&]( const char * at, bool end_of_line ) {
+                const char * first = field_begin;
+                const char * last = at;
+                field_begin = at + 1;
+                if ( end_of_line && last > first && last[ -1 ] == '\r' )
+                {
+                    --last;
+                }
+                if ( end_of_line && field == 0 && first == last )
+                {
+                    return;
+                }
+                if ( field == column_count )
+                {
+                    throw_csv( base, first, "expected " + std::to_string( column_count ) + " fields" );
+                }
+                if ( field == 0 && rows == out.size() )
+                {
+                    out.resize( std::max<std::size_t>( 64, rows * 2 ) );
+                    refresh();
+                }
+                if ( last - first >= 2 && *first == '"' && last[ -1 ] == '"' )
+                {
+                    ++first;
+                    --last;
+                }
+                if ( !parsers[ field ]( first, last, columns[ field ] + rows * sizes[ field ] ) )
+                {
+                    throw_csv( base,
+                               first,
+                               "cannot parse '" + std::string( first, last ) + "' in column " +
+                                   std::to_string( field ) );
+                }
+                ++field;
+                if ( end_of_line )
+                {
+                    if ( field != column_count )
+                    {
+                        throw_csv( base, at, "expected " + std::to_string( column_count ) + " fields" );
+                    }
+                    field = 0;
+                    ++rows;
+                }
+            };
+
+            std::uint64_t quoted = 0;
+            for ( const char * block = begin; block < end; block += csv_block )
+            {
+                csv_masks masks;
+                if ( std::size_t( end - block ) >= csv_block )
+                {
+                    masks = classify( block, delimiter );
+                }
+                else
+                {
+                    char tail[ csv_block ];
+                    std::memset( tail, ' ', csv_block );
+                    std::memcpy( tail, block, std::size_t( end - block ) );
+                    masks = classify( tail, delimiter );
+                }
+
+                const std::uint64_t inside = prefix_xor( masks.quotes ) ^ quoted;
+                quoted = std::uint64_t( 0 ) - ( inside >> 63 );
+                for ( std::uint64_t separators = ( masks.delimiters | masks.newlines ) & ~inside; separators != 0;
+                      separators &= separators - 1 )
+                {
+                    const unsigned bit = count_trailing_zeros( separators );
+                    end_field( block + bit, ( ( masks.newlines >> bit ) & 1 ) != 0 );
+                }
+            }
+            if ( quoted != 0 )
+            {
+                throw_csv( base, end, "unterminated quote" );
+            }
+            if ( field_begin < end || field > 0 )
+            {
+                end_field( end, true );
+            }
+            out.resize( rows );
+        }
+    }
+
+    // Parses size bytes of CSV into a table with columns Ts..., one column per field. Throws csv_error, with the
+    // byte offset of the offending field, on malformed input.
+    template <typename... Ts>
+    vector<Ts...> parse_csv( const char * data, std::size_t size, const csv_options & options = {} )
+    {
+        const char * end = data + size;
+        const char * begin = options.header ? detail::next_line( data, end, false ) : data;
+
+        // Split points must not fall inside quoted fields: count the quotes of every part in parallel, then each
+        // split point knows whether it starts inside quotes and moves forward to the next real line break.
+        const std::size_t parts = std::max<std::size_t>(
+            1, std::min<std::size_t>( options.threads, std::size_t( end - begin ) / detail::csv_min_split_bytes ) );
+        std::vector<const char *> bounds( parts + 1, end );
+        bounds[ 0 ] = begin;
+        if ( parts > 1 )
+        {
+            std::vector<std::size_t> quotes( parts );
+            const auto part_begin = [&]( std::size_t part ) {
+                return begin + std::size_t( end - begin ) / parts * part;
+            };
+            detail::parallel_for_blocks( parts, options.threads, [&]( std::size_t part ) {
+                quotes[ part ] = std::size_t( std::count( part_begin( part ), part_begin( part + 1 ), '"' ) );
+            } );
+            std::size_t before = 0;
+            for ( std::size_t part = 1; part < parts; ++part )
+            {
+                before += quotes[ part - 1 ];
+                bounds[ part ] = std::max( bounds[ part - 1 ],
+                                           detail::next_line( part_begin( part ), end, before % 2 != 0 ) );
+            }
+        }
+
+        std::vector<vector<Ts...>> results( parts );
+        std::vector<std::exception_ptr> errors( parts );
+        detail::parallel_for_blocks( parts, options.threads, [&]( std::size_t part ) {
+            try
+            {
+                detail::parse_csv_range( data, bounds[ part ], bounds[ part + 1 ], options.delimiter, results[ part ] );
+            }
+            catch ( ... )
+            {
+                errors[ part ] = std::current_exception();
+            }
+        } );
+        for ( const std::exception_ptr & error : errors )
+        {
+            if ( error )
+            {
+                std::rethrow_exception( error );
+            }
+        }
+
+        vector<Ts...> result = std::move( results[ 0 ] );
+        for ( std::size_t part = 1; part < parts; ++part )
+        {
+            result.append( results[ part ] );
+        }
+        return result;
+    }
+
+    // Maps the CSV file at path and parses it with parse_csv.
+    template <typename... Ts>
+    vector<Ts...> read_csv( const std::string & path, const csv_options & options = {} )
+    {
+        detail::file in( path, O_RDONLY );
+        const auto bytes = std::size_t( in.size() );
+        if ( bytes == 0 )
+        {
+            return {};
+        }
+        void * base = ::mmap( nullptr, bytes, PROT_READ, MAP_PRIVATE, in.descriptor(), 0 );
+        if ( base == MAP_FAILED )
+        {
+            detail::throw_errno( "cannot map " + path );
+        }
+        ::madvise( base, bytes, MADV_SEQUENTIAL );
+        try
+        {
+            vector<Ts...> result = parse_csv<Ts...>( static_cast<const char *>( base ), bytes, options );
+            ::munmap( base, bytes );
+            return result;
+        }
+        catch ( const csv_error & e )
+        {
+            ::munmap( base, bytes );
+            throw csv_error( path + ": " + e.what() );
+        }
+        catch ( ... )
+        {
+            ::munmap( base, bytes );
+            throw;
+        }
+    }
+}
+
+#endif
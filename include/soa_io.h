@@ -0,0 +1,863 @@
+#ifndef SOA_IO_H
+#define SOA_IO_H
+
+#include "soa.h"
+#include "soa_codec.h"
+
+#include <cerrno>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <climits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace soa
+{
+    // Raised when a file is not a valid soa table or does not match the requested schema.
+    class io_error : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    // Columnar file format
+    //
+    //     file_header
+    //     column_descriptor[ column_count ]
+    //     column 0 data, starting on a file_alignment boundary
+    //     column 1 data, ...
+    //
+    // Every field is stored in the byte order of the machine that wrote the file; readers reject files whose
+    // endianness marker does not match theirs. Columns start on page boundaries so a mapped file exposes them
+    // directly, suitably aligned for SIMD loads.
+
+    constexpr std::size_t file_alignment = 4096;
+
+    struct file_header
+    {
+        char magic[ 8 ];
+        std::uint32_t version;
+        std::uint32_t endianness;
+        std::uint64_t rows;
+        std::uint32_t column_count;
+        std::uint32_t alignment;
+    };
+
+    struct column_descriptor
+    {
+        std::uint32_t type;
+        std::uint32_t element_size;
+        std::uint64_t offset;
+        std::uint64_t bytes;
+    };
+
+    namespace detail
+    {
+        constexpr char file_magic[ 8 ] = {'S', 'O', 'A', 'C', 'P', 'P', 'T', 'B'};
+        constexpr std::uint32_t file_version = 1;
+        constexpr std::uint32_t endianness_marker = 0x01020304;
+
+        // Identifies the column element type in the schema: kind in the high byte, size in the low byte. Types that
+        // are not arithmetic only have their size checked.
+        template <typename T>
+        constexpr std::uint32_t type_code()
+        {
+            return ( std::is_same<T, bool>::value
+                         ? 0x400u
+                         : std::is_floating_point<T>::value
+                               ? 0x100u
+                               : std::is_integral<T>::value ? ( std::is_signed<T>::value ? 0x200u : 0x300u ) : 0u ) |
+                   std::uint32_t( sizeof( T ) );
+        }
+
+        inline std::uint64_t align_up( std::uint64_t offset, std::uint64_t alignment )
+        {
+            return ( offset + alignment - 1 ) / alignment * alignment;
+        }
+
+        [[noreturn]] inline void throw_errno( const std::string & what )
+        {
+            throw std::system_error( errno, std::generic_category(), what );
+        }
+
+        // Owning POSIX file descriptor.
+        class file
+        {
+        public:
+            file( const std::string & path, int flags, mode_t mode = 0644 )
+                : path_( path )
+                , fd_( ::open( path.c_str(), flags | O_CLOEXEC, mode ) )
+            {
+                if ( fd_ < 0 )
+                {
+                    throw_errno( "cannot open " + path_ );
+                }
+            }
+
+            file( const file & ) = delete;
+            file & operator=( const file & ) = delete;
+
+            ~file()
+            {
+                ::close( fd_ );
+            }
+
+            int descriptor() const
+            {
+                return fd_;
+            }
+
+            const std::string & path() const
+            {
+                return path_;
+            }
+
+            std::uint64_t size() const
+            {
+                struct stat status;
+                if ( ::fstat( fd_, &status ) != 0 )
+                {
+                    throw_errno( "cannot stat " + path_ );
+                }
+                return std::uint64_t( status.st_size );
+            }
+
+            void write_at( const void * data, std::size_t bytes, std::uint64_t offset ) const
+            {
+                const auto * p = static_cast<const char *>( data );
+                while ( bytes > 0 )
+                {
+                    const ssize_t written = ::pwrite( fd_, p, bytes, off_t( offset ) );
+                    if ( written < 0 && errno == EINTR )
+                    {
+                        continue;
+                    }
+                    if ( written <= 0 )
+                    {
+                        throw_errno( "cannot write " + path_ );
+                    }
+                    p += written;
+                    bytes -= std::size_t( written );
+                    offset += std::uint64_t( written );
+                }
+            }
+
+            void read_at( void * data, std::size_t bytes, std::uint64_t offset ) const
+            {
+                auto * p = static_cast<char *>( data );
+                while ( bytes > 0 )
+                {
+                    const ssize_t read = ::pread( fd_, p, bytes, off_t( offset ) );
+                    if ( read < 0 && errno == EINTR )
+                    {
+                        continue;
+                    }
+                    if ( read < 0 )
+                    {
+                        throw_errno( "cannot read " + path_ );
+                    }
+                    if ( read == 0 )
+                    {
+                        throw io_error( path_ + ": unexpected end of file" );
+                    }
+                    p += read;
+                    bytes -= std::size_t( read );
+                    offset += std::uint64_t( read );
+                }
+            }
+
+            // Bytes from the current position to the end of the file, or UINT64_MAX when the descriptor is not a
+            // regular file, e.g. a pipe.
+            std::uint64_t remaining() const
+            {
+                struct stat status;
+                const off_t position = ::lseek( fd_, 0, SEEK_CUR );
+                if ( position < 0 || ::fstat( fd_, &status ) != 0 || !S_ISREG( status.st_mode ) )
+                {
+                    return UINT64_MAX;
+                }
+                return status.st_size > position ? std::uint64_t( status.st_size - position ) : 0;
+            }
+
+            // Writes every buffer at the current position, in as few system calls as possible. Consumes buffers.
+            void write_all( iovec * buffers, std::size_t count ) const
+            {
+                for ( ;; )
+                {
+                    for ( ; count > 0 && buffers->iov_len == 0; ++buffers, --count )
+                    {
+                    }
+                    if ( count == 0 )
+                    {
+                        return;
+                    }
+                    const ssize_t written = ::writev( fd_, buffers, int( std::min<std::size_t>( count, IOV_MAX ) ) );
+                    if ( written < 0 && errno == EINTR )
+                    {
+                        continue;
+                    }
+                    if ( written <= 0 )
+                    {
+                        throw_errno( "cannot write " + path_ );
+                    }
+                    advance( buffers, count, std::size_t( written ) );
+                }
+            }
+
+            // Fills every buffer from the current position. Returns false when the file ends before the first byte
+            // and throws io_error when it ends in the middle. Consumes buffers.
+            bool read_all( iovec * buffers, std::size_t count ) const
+            {
+                bool started = false;
+                for ( ;; )
+                {
+                    for ( ; count > 0 && buffers->iov_len == 0; ++buffers, --count )
+                    {
+                    }
+                    if ( count == 0 )
+                    {
+                        return true;
+                    }
+                    const ssize_t read = ::readv( fd_, buffers, int( std::min<std::size_t>( count, IOV_MAX ) ) );
+                    if ( read < 0 && errno == EINTR )
+                    {
+                        continue;
+                    }
+                    if ( read < 0 )
+                    {
+                        throw_errno( "cannot read " + path_ );
+                    }
+                    if ( read == 0 )
+                    {
+                        if ( !started )
+                        {
+                            return false;
+                        }
+                        throw io_error( path_ + ": unexpected end of file" );
+                    }
+                    started = true;
+                    advance( buffers, count, std::size_t( read ) );
+                }
+            }
+
+        private:
+            static void advance( iovec *& buffers, std::size_t & count, std::size_t bytes )
+            {
+                for ( ; count > 0 && bytes >= buffers->iov_len; ++buffers, --count )
+                {
+                    bytes -= buffers->iov_len;
+                }
+                if ( count > 0 )
+                {
+                    buffers->iov_base = static_cast<char *>( buffers->iov_base ) + bytes;
+                    buffers->iov_len -= bytes;
+                }
+            }
+
+            std::string path_;
+            int fd_;
+        };
+
+        template <typename... Ts>
+        std::vector<column_descriptor> expected_schema()
+        {
+            return {column_descriptor{type_code<Ts>(), std::uint32_t( sizeof( Ts ) ), 0, 0}...};
+        }
+
+        // Checks the fixed-size header against the schema Ts..., before the descriptors are read.
+        template <typename... Ts>
+        void validate_header( const std::string & path, const file_header & header )
+        {
+            if ( std::memcmp( header.magic, file_magic, sizeof( file_magic ) ) != 0 )
+            {
+                throw io_error( path + ": not a soa table" );
+            }
+            if ( header.endianness != endianness_marker )
+            {
+                throw io_error( path + ": written on a machine with a different byte order" );
+            }
+            if ( header.version != file_version )
+            {
+                throw io_error( path + ": unsupported version " + std::to_string( header.version ) );
+            }
+            if ( header.column_count != sizeof...( Ts ) )
+            {
+                throw io_error( path + ": expected " + std::to_string( sizeof...( Ts ) ) + " columns, file has " +
+                                std::to_string( header.column_count ) );
+            }
+        }
+
+        // Checks a header and its descriptors against the schema Ts... and the size of the file. Every column must
+        // start on a multiple of the header alignment and of its element alignment, and lie within the file.
+        template <typename... Ts>
+        void validate( const std::string & path,
+                       const file_header & header,
+                       const column_descriptor * columns,
+                       std::uint64_t file_size )
+        {
+            validate_header<Ts...>( path, header );
+
+            const auto schema = expected_schema<Ts...>();
+            const std::uint64_t alignments[] = {alignof( Ts )...};
+            for ( std::size_t i = 0; i < schema.size(); ++i )
+            {
+                const column_descriptor & column = columns[ i ];
+                if ( column.type != schema[ i ].type || column.element_size != schema[ i ].element_size )
+                {
+                    throw io_error( path + ": column " + std::to_string( i ) + " type mismatch" );
+                }
+                if ( header.alignment == 0 || column.offset % header.alignment != 0 ||
+                     column.offset % alignments[ i ] != 0 )
+                {
+                    throw io_error( path + ": column " + std::to_string( i ) + " is misaligned" );
+                }
+                if ( header.rows > UINT64_MAX / column.element_size ||
+                     column.bytes != header.rows * column.element_size || column.bytes > file_size ||
+                     column.offset > file_size - column.bytes )
+                {
+                    throw io_error( path + ": column " + std::to_string( i ) + " is truncated or misplaced" );
+                }
+            }
+        }
+
+        inline std::uint64_t descriptors_end( std::size_t column_count )
+        {
+            return sizeof( file_header ) + column_count * sizeof( column_descriptor );
+        }
+
+        // Reads the header and column descriptors of a table file and checks them against the schema Ts...
+        template <typename... Ts>
+        std::vector<column_descriptor> read_table_header( const file & in, file_header & header )
+        {
+            in.read_at( &header, sizeof( header ), 0 );
+            validate_header<Ts...>( in.path(), header );
+
+            std::vector<column_descriptor> columns( sizeof...( Ts ) );
+            in.read_at( columns.data(), columns.size() * sizeof( column_descriptor ), sizeof( header ) );
+            validate<Ts...>( in.path(), header, columns.data(), in.size() );
+            return columns;
+        }
+    }
+
+    // Writes every column of v to path in the columnar file format, one large write per column.
+    template <typename... Ts>
+    void save( const vector<Ts...> & v, const std::string & path )
+    {
+        file_header header{};
+        std::memcpy( header.magic, detail::file_magic, sizeof( header.magic ) );
+        header.version = detail::file_version;
+        header.endianness = detail::endianness_marker;
+        header.rows = v.size();
+        header.column_count = sizeof...( Ts );
+        header.alignment = file_alignment;
+
+        std::vector<column_descriptor> columns = detail::expected_schema<Ts...>();
+        std::uint64_t offset = detail::descriptors_end( columns.size() );
+        for ( auto & column : columns )
+        {
+            column.offset = detail::align_up( offset, file_alignment );
+            column.bytes = header.rows * column.element_size;
+            offset = column.offset + column.bytes;
+        }
+
+        detail::file out( path, O_WRONLY | O_CREAT | O_TRUNC );
+        out.write_at( &header, sizeof( header ), 0 );
+        out.write_at( columns.data(), columns.size() * sizeof( column_descriptor ), sizeof( header ) );
+        detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+            constexpr std::size_t I = decltype( column )::value;
+            out.write_at( v.template data<I>(), columns[ I ].bytes, columns[ I ].offset );
+        } );
+        if ( ::ftruncate( out.descriptor(), off_t( detail::align_up( offset, file_alignment ) ) ) != 0 )
+        {
+            detail::throw_errno( "cannot resize " + path );
+        }
+    }
+
+    // Reads a table written by save(). Throws io_error when the file does not match the schema Ts...
+    template <typename... Ts>
+    vector<Ts...> load( const std::string & path )
+    {
+        detail::file in( path, O_RDONLY );
+        file_header header{};
+        const std::vector<column_descriptor> columns = detail::read_table_header<Ts...>( in, header );
+
+        vector<Ts...> result( header.rows );
+        detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+            constexpr std::size_t I = decltype( column )::value;
+            in.read_at( result.template data<I>(), columns[ I ].bytes, columns[ I ].offset );
+        } );
+        return result;
+    }
+
+    // Read-only view of a table file mapped into memory. Nothing is copied: columns are served straight from the
+    // page cache, shared by every process mapping the same file, and paged in on first touch. Works with every
+    // algorithm that takes a container, e.g. soa::sum<1>( table ).
+    template <typename... Ts>
+    class mapped_table
+    {
+    public:
+        using size_type = std::size_t;
+        using value_type = std::tuple<Ts...>;
+
+        template <std::size_t I>
+        using column_type = typename std::tuple_element<I, value_type>::type;
+
+        static constexpr std::size_t column_count = sizeof...( Ts );
+
+        explicit mapped_table( const std::string & path )
+        {
+            detail::file in( path, O_RDONLY );
+            bytes_ = in.size();
+            if ( bytes_ < detail::descriptors_end( 0 ) )
+            {
+                throw io_error( path + ": not a soa table" );
+            }
+
+            void * base = ::mmap( nullptr, bytes_, PROT_READ, MAP_SHARED, in.descriptor(), 0 );
+            if ( base == MAP_FAILED )
+            {
+                detail::throw_errno( "cannot map " + path );
+            }
+            base_ = static_cast<const char *>( base );
+
+            try
+            {
+                const auto * header = reinterpret_cast<const file_header *>( base_ );
+                detail::validate_header<Ts...>( path, *header );
+                if ( bytes_ < detail::descriptors_end( header->column_count ) )
+                {
+                    throw io_error( path + ": truncated" );
+                }
+                const auto * columns = reinterpret_cast<const column_descriptor *>( base_ + sizeof( file_header ) );
+                detail::validate<Ts...>( path, *header, columns, bytes_ );
+
+                size_ = header->rows;
+                detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+                    constexpr std::size_t I = decltype( column )::value;
+                    std::get<I>( columns_ ) = reinterpret_cast<const column_type<I> *>( base_ + columns[ I ].offset );
+                } );
+            }
+            catch ( ... )
+            {
+                unmap();
+                throw;
+            }
+        }
+
+        mapped_table( mapped_table && other ) noexcept
+            : base_( other.base_ )
+            , bytes_( other.bytes_ )
+            , size_( other.size_ )
+            , columns_( other.columns_ )
+        {
+            other.base_ = nullptr;
+            other.bytes_ = 0;
+            other.size_ = 0;
+        }
+
+        mapped_table( const mapped_table & ) = delete;
+        mapped_table & operator=( const mapped_table & ) = delete;
+
+        ~mapped_table()
+        {
+            unmap();
+        }
+
+        size_type size() const
+        {
+            return size_;
+        }
+
+        bool empty() const
+        {
+            return size_ == 0;
+        }
+
+        template <std::size_t I>
+        const column_type<I> * data() const
+        {
+            return std::get<I>( columns_ );
+        }
+
+        template <std::size_t I>
+        span<const column_type<I>> column() const
+        {
+            return {data<I>(), size_};
+        }
+
+        template <std::size_t I>
+        const column_type<I> & get( size_type i ) const
+        {
+            assert( i < size_ );
+            return data<I>()[ i ];
+        }
+
+        // Copies the mapped table into a heap-backed vector.
+        vector<Ts...> to_vector() const
+        {
+            vector<Ts...> result( size_ );
+            detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                std::copy( data<I>(), data<I>() + size_, result.template data<I>() );
+            } );
+            return result;
+        }
+
+    private:
+        void unmap()
+        {
+            if ( base_ != nullptr )
+            {
+                ::munmap( const_cast<char *>( base_ ), bytes_ );
+                base_ = nullptr;
+            }
+        }
+
+        const char * base_ = nullptr;
+        std::size_t bytes_ = 0;
+        size_type size_ = 0;
+        std::tuple<const Ts *...> columns_{};
+    };
+
+    // Chunked log format
+    //
+    //     log_header
+    //     column_schema[ column_count ]
+    //     chunk*
+    //
+    // where every chunk is self-describing:
+    //
+    //     chunk_header
+    //     chunk_column[ column_count ]
+    //     column 0 payload, column 1 payload, ...
+    //
+    // Like the table format, fields are in the writer's byte order and checked with an endianness marker.
+
+    struct log_header
+    {
+        char magic[ 8 ];
+        std::uint32_t version;
+        std::uint32_t endianness;
+        std::uint32_t column_count;
+        std::uint32_t reserved;
+    };
+
+    struct column_schema
+    {
+        std::uint32_t type;
+        std::uint32_t element_size;
+    };
+
+    // Whether log_writer stores column payloads as is or with the smallest codec for each column of each chunk.
+    enum class compression
+    {
+        none,
+        automatic,
+    };
+
+    struct chunk_header
+    {
+        std::uint32_t magic;
+        std::uint32_t column_count;
+        std::uint64_t rows;
+    };
+
+    struct chunk_column
+    {
+        encoding codec;
+        std::uint32_t reserved;
+        std::uint64_t bytes;
+    };
+
+    namespace detail
+    {
+        constexpr char log_magic[ 8 ] = {'S', 'O', 'A', 'C', 'P', 'P', 'L', 'G'};
+        constexpr std::uint32_t log_version = 1;
+        constexpr std::uint32_t chunk_magic = 0x4b4e4843; // "CHNK"
+
+        template <typename... Ts>
+        void check_log_header( const std::string & path, const log_header & header, const column_schema * columns )
+        {
+            if ( std::memcmp( header.magic, log_magic, sizeof( log_magic ) ) != 0 )
+            {
+                throw io_error( path + ": not a soa log" );
+            }
+            if ( header.endianness != endianness_marker )
+            {
+                throw io_error( path + ": written on a machine with a different byte order" );
+            }
+            if ( header.version != log_version )
+            {
+                throw io_error( path + ": unsupported version " + std::to_string( header.version ) );
+            }
+            if ( header.column_count != sizeof...( Ts ) )
+            {
+                throw io_error( path + ": expected " + std::to_string( sizeof...( Ts ) ) + " columns, log has " +
+                                std::to_string( header.column_count ) );
+            }
+            const column_schema expected[] = {column_schema{type_code<Ts>(), std::uint32_t( sizeof( Ts ) )}...};
+            for ( std::size_t i = 0; i < sizeof...( Ts ); ++i )
+            {
+                if ( columns[ i ].type != expected[ i ].type ||
+                     columns[ i ].element_size != expected[ i ].element_size )
+                {
+                    throw io_error( path + ": column " + std::to_string( i ) + " type mismatch" );
+                }
+            }
+        }
+
+        // Checks a chunk header and its column descriptors against the schema Ts... before anything is allocated
+        // for it: row counts whose column sizes overflow, raw columns of the wrong size, unknown codecs and
+        // payloads extending past the remaining bytes of the file are rejected.
+        template <typename... Ts>
+        void check_chunk( const std::string & path,
+                          const chunk_header & header,
+                          const chunk_column * columns,
+                          std::uint64_t remaining )
+        {
+            if ( header.magic != chunk_magic || header.column_count != sizeof...( Ts ) )
+            {
+                throw io_error( path + ": corrupt chunk header" );
+            }
+            const std::uint64_t element_sizes[] = {sizeof( Ts )...};
+            std::uint64_t payload = 0;
+            for ( std::size_t i = 0; i < sizeof...( Ts ); ++i )
+            {
+                const chunk_column & column = columns[ i ];
+                if ( header.rows > SIZE_MAX / element_sizes[ i ] )
+                {
+                    throw io_error( path + ": chunk has too many rows" );
+                }
+                if ( column.codec > encoding::xor_float )
+                {
+                    throw io_error( path + ": column " + std::to_string( i ) + " has an unknown codec" );
+                }
+                if ( column.codec == encoding::raw && column.bytes != header.rows * element_sizes[ i ] )
+                {
+                    throw io_error( path + ": corrupt column " + std::to_string( i ) );
+                }
+                if ( column.bytes > remaining - payload )
+                {
+                    throw io_error( path + ": column " + std::to_string( i ) + " is truncated" );
+                }
+                payload += column.bytes;
+            }
+        }
+
+        // Reads and checks the header of an existing log, leaving the file positioned on its first chunk.
+        template <typename... Ts>
+        void read_log_header( const file & in )
+        {
+            log_header header{};
+            column_schema columns[ sizeof...( Ts ) ];
+            iovec buffers[] = {{&header, sizeof( header )}, {columns, sizeof( columns )}};
+            if ( !in.read_all( buffers, 2 ) )
+            {
+                throw io_error( in.path() + ": not a soa log" );
+            }
+            check_log_header<Ts...>( in.path(), header, columns );
+        }
+    }
+
+    // Appends batches of rows to a log file as self-describing column chunks. Each batch is written with a single
+    // gathering write, straight from the column buffers or, when compressing, from per-column encode buffers that
+    // are reused from one batch to the next; nothing is serialized row by row.
+    template <typename... Ts>
+    class log_writer
+    {
+    public:
+        // Creates path, or appends to the existing log at path when append is set.
+        explicit log_writer( const std::string & path,
+                             bool append = false,
+                             compression mode = compression::none )
+            : file_( path, O_RDWR | O_CREAT | ( append ? 0 : O_TRUNC ) )
+            , mode_( mode )
+        {
+            if ( file_.size() > 0 )
+            {
+                detail::read_log_header<Ts...>( file_ );
+                if ( ::lseek( file_.descriptor(), 0, SEEK_END ) < 0 )
+                {
+                    detail::throw_errno( "cannot seek " + path );
+                }
+                return;
+            }
+
+            log_header header{};
+            std::memcpy( header.magic, detail::log_magic, sizeof( header.magic ) );
+            header.version = detail::log_version;
+            header.endianness = detail::endianness_marker;
+            header.column_count = sizeof...( Ts );
+            column_schema columns[] = {column_schema{detail::type_code<Ts>(), std::uint32_t( sizeof( Ts ) )}...};
+            iovec buffers[] = {{&header, sizeof( header )}, {columns, sizeof( columns )}};
+            file_.write_all( buffers, 2 );
+        }
+
+        // Appends the rows of batch as one chunk. Empty batches are skipped.
+        void write( const vector<Ts...> & batch )
+        {
+            if ( batch.empty() )
+            {
+                return;
+            }
+
+            chunk_header header{detail::chunk_magic, sizeof...( Ts ), batch.size()};
+            chunk_column columns[ sizeof...( Ts ) ];
+            iovec buffers[ 2 + sizeof...( Ts ) ];
+            buffers[ 0 ] = {&header, sizeof( header )};
+            buffers[ 1 ] = {columns, sizeof( columns )};
+            detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                using T = typename vector<Ts...>::template column_type<I>;
+                if ( mode_ == compression::none )
+                {
+                    columns[ I ] = {encoding::raw, 0, batch.size() * sizeof( T )};
+                    buffers[ 2 + I ] = {const_cast<T *>( batch.template data<I>() ), columns[ I ].bytes};
+                    return;
+                }
+                std::vector<unsigned char> & encoded = encoded_[ I ];
+                columns[ I ] = {encode_best( batch.template data<I>(), batch.size(), encoded, scratch_ ), 0, 0};
+                columns[ I ].bytes = encoded.size();
+                buffers[ 2 + I ] = {encoded.data(), encoded.size()};
+            } );
+            file_.write_all( buffers, 2 + sizeof...( Ts ) );
+            rows_ += batch.size();
+        }
+
+        // Rows written by this writer.
+        std::uint64_t rows() const
+        {
+            return rows_;
+        }
+
+        // Flushes written chunks to stable storage.
+        void sync() const
+        {
+            if ( ::fdatasync( file_.descriptor() ) != 0 )
+            {
+                detail::throw_errno( "cannot sync " + file_.path() );
+            }
+        }
+
+    private:
+        detail::file file_;
+        compression mode_;
+        std::uint64_t rows_ = 0;
+        std::vector<unsigned char> encoded_[ sizeof...( Ts ) ];
+        std::vector<unsigned char> scratch_;
+    };
+
+    // Streams the chunks of a log back one batch at a time. Raw columns are read directly into the columns of a
+    // caller-provided vector and encoded ones are decoded into them from a reused staging buffer; once both cover
+    // the largest chunk, reading allocates nothing.
+    //
+    //     soa::log_reader<std::int64_t, double> reader( path );
+    //     soa::vector<std::int64_t, double> batch;
+    //     while ( reader.read( batch ) )
+    //         process( batch );
+    template <typename... Ts>
+    class log_reader
+    {
+    public:
+        explicit log_reader( const std::string & path )
+            : file_( path, O_RDONLY )
+        {
+            detail::read_log_header<Ts...>( file_ );
+        }
+
+        // Replaces the content of batch with the next chunk. Returns false at the end of the log.
+        bool read( vector<Ts...> & batch )
+        {
+            chunk_header header{};
+            chunk_column columns[ sizeof...( Ts ) ];
+            iovec headers[] = {{&header, sizeof( header )}, {columns, sizeof( columns )}};
+            if ( !file_.read_all( headers, 2 ) )
+            {
+                batch.clear();
+                return false;
+            }
+            detail::check_chunk<Ts...>( file_.path(), header, columns, file_.remaining() );
+
+            std::size_t staged = 0;
+            for ( const chunk_column & column : columns )
+            {
+                staged += column.codec == encoding::raw ? 0 : std::size_t( column.bytes );
+            }
+            try
+            {
+                if ( staging_.size() < staged )
+                {
+                    staging_.resize( staged );
+                }
+                batch.resize( std::size_t( header.rows ) );
+            }
+            catch ( const std::bad_alloc & )
+            {
+                throw io_error( file_.path() + ": chunk of " + std::to_string( header.rows ) + " rows is too large" );
+            }
+            catch ( const std::length_error & )
+            {
+                throw io_error( file_.path() + ": chunk of " + std::to_string( header.rows ) + " rows is too large" );
+            }
+            // read_all advances the iovecs on short reads, so encoded payloads are located through payloads.
+            iovec buffers[ sizeof...( Ts ) ];
+            const unsigned char * payloads[ sizeof...( Ts ) ] = {};
+            staged = 0;
+            detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                if ( columns[ I ].codec != encoding::raw )
+                {
+                    payloads[ I ] = staging_.data() + staged;
+                    buffers[ I ] = {staging_.data() + staged, columns[ I ].bytes};
+                    staged += columns[ I ].bytes;
+                    return;
+                }
+                buffers[ I ] = {batch.template data<I>(), columns[ I ].bytes};
+            } );
+            if ( !file_.read_all( buffers, sizeof...( Ts ) ) )
+            {
+                throw io_error( file_.path() + ": unexpected end of file" );
+            }
+
+            detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                if ( columns[ I ].codec == encoding::raw )
+                {
+                    return;
+                }
+                try
+                {
+                    decode( columns[ I ].codec,
+                            payloads[ I ],
+                            columns[ I ].bytes,
+                            batch.template data<I>(),
+                            batch.size() );
+                }
+                catch ( const codec_error & e )
+                {
+                    throw io_error( file_.path() + ": column " + std::to_string( I ) + ": " + e.what() );
+                }
+            } );
+            rows_ += header.rows;
+            return true;
+        }
+
+        // Rows read so far.
+        std::uint64_t rows() const
+        {
+            return rows_;
+        }
+
+    private:
+        detail::file file_;
+        std::uint64_t rows_ = 0;
+        std::vector<unsigned char> staging_;
+    };
+}
+
+#endif
@@ -0,0 +1,648 @@
+#ifndef SOA_LOADER_H
+#define SOA_LOADER_H
+
+#include "soa_io.h"
+
+#include <cstdlib>
+#include <exception>
+#include <memory>
+
+#if defined( __linux__ )
+#include <sys/syscall.h>
+#if defined( __NR_io_uring_setup ) && defined( __NR_io_uring_enter )
+#include <linux/io_uring.h>
+#define SOA_HAS_IO_URING 1
+#endif
+#endif
+
+namespace soa
+{
+    // Tuning knobs of column_loader.
+    struct loader_options
+    {
+        // Reads kept in flight at once.
+        unsigned queue_depth = 32;
+        // Columns are split into reads of at most this many bytes, a multiple of file_alignment.
+        std::size_t request_bytes = std::size_t( 1 ) << 20;
+        // Bypass the page cache with O_DIRECT where the file system supports it.
+        bool direct = true;
+        // Submit reads through io_uring where the kernel supports it; otherwise they are issued one by one with pread.
+        bool io_uring = true;
+    };
+
+    // Columns read from a table file by column_loader. Each column lives in its own buffer, aligned and padded to
+    // file_alignment as O_DIRECT requires. Works with every algorithm that takes a container.
+    template <typename... Ts>
+    class loaded_columns
+    {
+    public:
+        using size_type = std::size_t;
+        using value_type = std::tuple<Ts...>;
+
+        template <std::size_t I>
+        using column_type = typename std::tuple_element<I, value_type>::type;
+
+        static constexpr std::size_t column_count = sizeof...( Ts );
+
+        explicit loaded_columns( size_type size )
+            : size_( size )
+        {
+            try
+            {
+                detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+                    constexpr std::size_t I = decltype( column )::value;
+                    std::get<I>( columns_ ) =
+                        static_cast<column_type<I> *>( allocate( size * sizeof( column_type<I> ) ) );
+                } );
+            }
+            catch ( ... )
+            {
+                release();
+                throw;
+            }
+        }
+
+        loaded_columns( loaded_columns && other ) noexcept
+            : size_( other.size_ )
+            , columns_( other.columns_ )
+        {
+            other.size_ = 0;
+            other.columns_ = {};
+        }
+
+        loaded_columns( const loaded_columns & ) = delete;
+        loaded_columns & operator=( const loaded_columns & ) = delete;
+
+        ~loaded_columns()
+        {
+            release();
+        }
+
+        size_type size() const
+        {
+            return size_;
+        }
+
+        bool empty() const
+        {
+            return size_ == 0;
+        }
+
+        template <std::size_t I>
+        column_type<I> * data()
+        {
+            return std::get<I>( columns_ );
+        }
+
+        template <std::size_t I>
+        const column_type<I> * data() const
+        {
+            return std::get<I>( columns_ );
+        }
+
+        template <std::size_t I>
+        span<const column_type<I>> column() const
+        {
+            return {data<I>(), size_};
+        }
+
+        template <std::size_t I>
+        const column_type<I> & get( size_type i ) const
+        {
+            assert( i < size_ );
+            return data<I>()[ i ];
+        }
+
+        vector<Ts...> to_vector() const
+        {
+            vector<Ts...> result( size_ );
+            detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                std::copy( data<I>(), data<I>() + size_, result.template data<I>() );
+            } );
+            return result;
+        }
+
+    private:
+        static void * allocate( std::size_t bytes )
+        {
+            void * p = nullptr;
+            if ( ::posix_memalign( &p, file_alignment, detail::align_up( std::max<std::size_t>( bytes, 1 ),
+                                                                         file_alignment ) ) != 0 )
+            {
+                throw std::bad_alloc();
+            }
+            return p;
+        }
+
+        void release()
+        {
+            detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                std::free( std::get<I>( columns_ ) );
+                std::get<I>( columns_ ) = nullptr;
+            } );
+        }
+
+        size_type size_ = 0;
+        std::tuple<Ts *...> columns_{};
+    };
+
+    namespace detail
+    {
+        // One read of a column slice. needed is the part that must be filled; the rest is padding read only to keep
+        // O_DIRECT transfers block sized. buffered is set once the read has to go through the page cache.
+        struct column_read
+        {
+            std::size_t column;
+            std::uint64_t offset;
+            std::size_t needed;
+            iovec buffer;
+            bool buffered = false;
+        };
+
+#if defined( SOA_HAS_IO_URING )
+        // Minimal io_uring submission and completion rings over the raw system calls, for reads only.
+        class uring
+        {
+        public:
+            explicit uring( unsigned entries )
+            {
+                io_uring_params params{};
+                fd_ = int( ::syscall( __NR_io_uring_setup, entries, &params ) );
+                if ( fd_ < 0 )
+                {
+                    throw_errno( "cannot create io_uring" );
+                }
+                try
+                {
+                    sq_bytes_ = params.sq_off.array + params.sq_entries * sizeof( std::uint32_t );
+                    cq_bytes_ = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+                    sqes_bytes_ = params.sq_entries * sizeof( io_uring_sqe );
+                    sq_ = map( sq_bytes_, IORING_OFF_SQ_RING );
+                    cq_ = map( cq_bytes_, IORING_OFF_CQ_RING );
+                    sqes_ = static_cast<io_uring_sqe *>( map( sqes_bytes_, IORING_OFF_SQES ) );
+                }
+                catch ( ... )
+                {
+                    release();
+                    throw;
+                }
+
+                sq_head_ = reinterpret_cast<unsigned *>( static_cast<char *>( sq_ ) + params.sq_off.head );
+                sq_tail_ = reinterpret_cast<unsigned *>( static_cast<char *>( sq_ ) + params.sq_off.tail );
+                sq_mask_ = *reinterpret_cast<unsigned *>( static_cast<char *>( sq_ ) + params.sq_off.ring_mask );
+                sq_array_ = reinterpret_cast<unsigned *>( static_cast<char *>( sq_ ) + params.sq_off.array );
+                cq_head_ = reinterpret_cast<unsigned *>( static_cast<char *>( cq_ ) + params.cq_off.head );
+                cq_tail_ = reinterpret_cast<unsigned *>( static_cast<char *>( cq_ ) + params.cq_off.tail );
+                cq_mask_ = *reinterpret_cast<unsigned *>( static_cast<char *>( cq_ ) + params.cq_off.ring_mask );
+                cqes_ = reinterpret_cast<io_uring_cqe *>( static_cast<char *>( cq_ ) + params.cq_off.cqes );
+                entries_ = params.sq_entries;
+            }
+
+            uring( const uring & ) = delete;
+            uring & operator=( const uring & ) = delete;
+
+            ~uring()
+            {
+                release();
+            }
+
+            // Queues a read of buffer at offset. Returns false when the submission ring is full.
+            bool prepare_read( int fd, iovec * buffer, std::uint64_t offset, std::uint64_t user_data )
+            {
+                const unsigned tail = *sq_tail_;
+                if ( tail - __atomic_load_n( sq_head_, __ATOMIC_ACQUIRE ) == entries_ )
+                {
+                    return false;
+                }
+                const unsigned index = tail & sq_mask_;
+                io_uring_sqe & sqe = sqes_[ index ];
+                std::memset( &sqe, 0, sizeof( sqe ) );
+                sqe.opcode = IORING_OP_READV;
+                sqe.fd = fd;
+                sqe.addr = std::uint64_t( reinterpret_cast<std::uintptr_t>( buffer ) );
+                sqe.len = 1;
+                sqe.off = offset;
+                sqe.user_data = user_data;
+                sq_array_[ index ] = index;
+                __atomic_store_n( sq_tail_, tail + 1, __ATOMIC_RELEASE );
+                return true;
+            }
+
+            // Reads prepared but not yet handed to the kernel.
+            unsigned queued() const
+            {
+                return *sq_tail_ - __atomic_load_n( sq_head_, __ATOMIC_ACQUIRE );
+            }
+
+            // Drops the reads not yet handed to the kernel. Without SQPOLL the kernel only consumes submissions
+            // inside io_uring_enter, so they can be taken back between calls.
+            void discard_queued()
+            {
+                __atomic_store_n( sq_tail_, __atomic_load_n( sq_head_, __ATOMIC_ACQUIRE ), __ATOMIC_RELEASE );
+            }
+
+            // Submits the queued reads and waits until at least wait reads have completed. Returns how many reads
+            // the kernel consumed; the others stay queued.
+            unsigned submit( unsigned wait )
+            {
+                for ( ;; )
+                {
+                    const long result = ::syscall( __NR_io_uring_enter,
+                                                   fd_,
+                                                   queued(),
+                                                   wait,
+                                                   wait > 0 ? IORING_ENTER_GETEVENTS : 0u,
+                                                   nullptr,
+                                                   0 );
+                    if ( result >= 0 )
+                    {
+                        return unsigned( result );
+                    }
+                    if ( errno != EINTR )
+                    {
+                        throw_errno( "cannot submit to io_uring" );
+                    }
+                }
+            }
+
+            // Calls f( user_data, result ) for every completed read, where result is a byte count or -errno.
+            template <typename F>
+            void for_each_completion( F f )
+            {
+                unsigned head = *cq_head_;
+                for ( const unsigned tail = __atomic_load_n( cq_tail_, __ATOMIC_ACQUIRE ); head != tail; ++head )
+                {
+                    const io_uring_cqe & cqe = cqes_[ head & cq_mask_ ];
+                    f( cqe.user_data, cqe.res );
+                }
+                __atomic_store_n( cq_head_, head, __ATOMIC_RELEASE );
+            }
+
+        private:
+            void * map( std::size_t bytes, off_t offset ) const
+            {
+                void * p = ::mmap( nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, offset );
+                if ( p == MAP_FAILED )
+                {
+                    throw_errno( "cannot map io_uring" );
+                }
+                return p;
+            }
+
+            void release()
+            {
+                if ( sqes_ != nullptr )
+                {
+                    ::munmap( sqes_, sqes_bytes_ );
+                }
+                if ( cq_ != nullptr )
+                {
+                    ::munmap( cq_, cq_bytes_ );
+                }
+                if ( sq_ != nullptr )
+                {
+                    ::munmap( sq_, sq_bytes_ );
+                }
+                ::close( fd_ );
+            }
+
+            int fd_ = -1;
+            unsigned entries_ = 0;
+            void * sq_ = nullptr;
+            void * cq_ = nullptr;
+            io_uring_sqe * sqes_ = nullptr;
+            std::size_t sq_bytes_ = 0;
+            std::size_t cq_bytes_ = 0;
+            std::size_t sqes_bytes_ = 0;
+            unsigned * sq_head_ = nullptr;
+            unsigned * sq_tail_ = nullptr;
+            unsigned sq_mask_ = 0;
+            unsigned * sq_array_ = nullptr;
+            unsigned * cq_head_ = nullptr;
+            unsigned * cq_tail_ = nullptr;
+            unsigned cq_mask_ = 0;
+            io_uring_cqe * cqes_ = nullptr;
+        };
+#else
+        // Placeholder on platforms without io_uring; never constructed.
+        class uring
+        {
+        };
+#endif
+
+        // Tracks outstanding reads per column and reports each column once all of its reads have landed. Reads go
+        // to fd, which may have been opened with O_DIRECT, and fall back to buffered_fd when a direct read cannot
+        // continue: after a short read that leaves the offset unaligned, or when the file system rejects O_DIRECT
+        // reads with EINVAL, in which case every later read is buffered too.
+        template <typename F>
+        class read_tracker
+        {
+        public:
+            read_tracker( const std::string & path,
+                          std::vector<column_read> & reads,
+                          std::size_t columns,
+                          F & on_column,
+                          int fd,
+                          int buffered_fd )
+                : path_( path )
+                , reads_( reads )
+                , remaining_( columns, 0 )
+                , on_column_( on_column )
+                , fd_( fd )
+                , buffered_fd_( buffered_fd )
+            {
+                for ( const column_read & read : reads_ )
+                {
+                    ++remaining_[ read.column ];
+                }
+                for ( std::size_t column = 0; column < columns; ++column )
+                {
+                    if ( remaining_[ column ] == 0 )
+                    {
+                        on_column_( column );
+                    }
+                }
+            }
+
+            // Descriptor to issue reads[ index ] on.
+            int descriptor( std::size_t index )
+            {
+                column_read & read = reads_[ index ];
+                read.buffered = read.buffered || direct_rejected_;
+                return read.buffered ? buffered_fd_ : fd_;
+            }
+
+            // Accounts for result bytes read by reads[ index ] from descriptor( index ). Returns true when the read
+            // must be reissued for its remaining bytes.
+            bool complete( std::size_t index, std::int64_t result )
+            {
+                column_read & read = reads_[ index ];
+                const bool direct = !read.buffered && fd_ != buffered_fd_;
+                if ( result == -EINVAL && direct )
+                {
+                    direct_rejected_ = true;
+                    read.buffered = true;
+                    return true;
+                }
+                if ( result < 0 )
+                {
+                    throw std::system_error( int( -result ), std::generic_category(), "cannot read " + path_ );
+                }
+                const auto bytes = std::size_t( result );
+                if ( bytes < read.needed )
+                {
+                    if ( bytes == 0 )
+                    {
+                        throw io_error( path_ + ": unexpected end of file" );
+                    }
+                    if ( direct && bytes % file_alignment != 0 )
+                    {
+                        read.buffered = true;
+                    }
+                    read.offset += bytes;
+                    read.needed -= bytes;
+                    read.buffer.iov_base = static_cast<char *>( read.buffer.iov_base ) + bytes;
+                    read.buffer.iov_len -= bytes;
+                    return true;
+                }
+                if ( --remaining_[ read.column ] == 0 )
+                {
+                    on_column_( read.column );
+                }
+                return false;
+            }
+
+        private:
+            const std::string & path_;
+            std::vector<column_read> & reads_;
+            std::vector<std::size_t> remaining_;
+            F & on_column_;
+            int fd_;
+            int buffered_fd_;
+            bool direct_rejected_ = false;
+        };
+
+        template <typename F>
+        void read_with_pread( std::vector<column_read> & reads, read_tracker<F> & tracker )
+        {
+            for ( std::size_t i = 0; i < reads.size(); ++i )
+            {
+                const column_read & read = reads[ i ];
+                for ( ;; )
+                {
+                    const ssize_t result = ::pread(
+                        tracker.descriptor( i ), read.buffer.iov_base, read.buffer.iov_len, off_t( read.offset ) );
+                    if ( result < 0 && errno == EINTR )
+                    {
+                        continue;
+                    }
+                    if ( !tracker.complete( i, result < 0 ? -std::int64_t( errno ) : std::int64_t( result ) ) )
+                    {
+                        break;
+                    }
+                }
+            }
+        }
+
+#if defined( SOA_HAS_IO_URING )
+        // Keeps up to depth reads in flight. Completions are handled as they arrive, so a column can be processed
+        // while the reads of the next ones are still pending. Buffers stay in use by the kernel until their reads
+        // complete, so on error the reads not yet submitted are dropped and every read the kernel consumed is
+        // drained before the error is rethrown.
+        template <typename F>
+        void read_with_uring( uring & ring,
+                              unsigned depth,
+                              std::vector<column_read> & reads,
+                              read_tracker<F> & tracker )
+        {
+            std::vector<std::size_t> queue( reads.size() );
+            for ( std::size_t i = 0; i < reads.size(); ++i )
+            {
+                queue[ i ] = i;
+            }
+
+            std::size_t next = 0;
+            // Reads consumed by the kernel and not yet completed.
+            unsigned in_flight = 0;
+            std::exception_ptr error;
+            while ( in_flight > 0 || ring.queued() > 0 || ( next < queue.size() && !error ) )
+            {
+                for ( ; !error && next < queue.size() && in_flight + ring.queued() < depth; ++next )
+                {
+                    column_read & read = reads[ queue[ next ] ];
+                    const int fd = tracker.descriptor( queue[ next ] );
+                    if ( !ring.prepare_read( fd, &read.buffer, read.offset, queue[ next ] ) )
+                    {
+                        break;
+                    }
+                }
+                try
+                {
+                    in_flight += ring.submit( 1 );
+                }
+                catch ( ... )
+                {
+                    // Reads still queued never reach the kernel; those in flight complete regardless, so while
+                    // draining a failed wait falls back to polling the completion ring.
+                    ring.discard_queued();
+                    if ( error )
+                    {
+                        std::this_thread::yield();
+                    }
+                    else
+                    {
+                        error = std::current_exception();
+                    }
+                }
+                ring.for_each_completion( [&]( std::uint64_t index, std::int32_t result ) {
+                    --in_flight;
+                    if ( error )
+                    {
+                        return;
+                    }
+                    try
+                    {
+                        if ( tracker.complete( std::size_t( index ), result ) )
+                        {
+                            queue.push_back( std::size_t( index ) );
+                        }
+                    }
+                    catch ( ... )
+                    {
+                        error = std::current_exception();
+                    }
+                } );
+            }
+            if ( error )
+            {
+                std::rethrow_exception( error );
+            }
+        }
+#endif
+    }
+
+    // Reads selected columns of a table written by save(), leaving the other columns on disk. Column reads are
+    // split into large aligned requests and, where available, submitted asynchronously through io_uring with
+    // O_DIRECT into page-aligned buffers, so a query touching 3 of 40 columns reads only those 3.
+    //
+    //     soa::column_loader<std::int64_t, double, float /* ... */> loader( path );
+    //     auto columns = loader.load<0, 2>( []( std::size_t column ) { /* column is complete */ } );
+    //     double total = soa::sum<1>( columns );
+    template <typename... Ts>
+    class column_loader
+    {
+    public:
+        using size_type = std::size_t;
+        using value_type = std::tuple<Ts...>;
+
+        template <std::size_t I>
+        using column_type = typename std::tuple_element<I, value_type>::type;
+
+        // Opens path and checks it against the schema Ts... Falls back to buffered reads when the file system
+        // rejects O_DIRECT, at open or on the first read, and to pread when io_uring is unavailable.
+        explicit column_loader( const std::string & path, loader_options options = {} )
+            : file_( path, O_RDONLY )
+            , options_( options )
+        {
+            assert( options_.queue_depth > 0 );
+            assert( options_.request_bytes > 0 && options_.request_bytes % file_alignment == 0 );
+            columns_ = detail::read_table_header<Ts...>( file_, header_ );
+            if ( options_.direct )
+            {
+                try
+                {
+                    direct_.reset( new detail::file( path, O_RDONLY | O_DIRECT ) );
+                }
+                catch ( const std::system_error & )
+                {
+                }
+            }
+#if defined( SOA_HAS_IO_URING )
+            if ( options_.io_uring )
+            {
+                try
+                {
+                    ring_.reset( new detail::uring( options_.queue_depth ) );
+                }
+                catch ( const std::system_error & )
+                {
+                }
+            }
+#endif
+        }
+
+        size_type size() const
+        {
+            return header_.rows;
+        }
+
+        bool uses_io_uring() const
+        {
+            return ring_ != nullptr;
+        }
+
+        bool uses_direct_io() const
+        {
+            return direct_ != nullptr;
+        }
+
+        // Reads columns Is... of the file.
+        template <std::size_t... Is>
+        loaded_columns<column_type<Is>...> load()
+        {
+            return load<Is...>( []( std::size_t ) {} );
+        }
+
+        // Reads columns Is... of the file, calling on_column( position ) as soon as the column at position in Is...
+        // is complete, possibly while later columns are still being read.
+        template <std::size_t... Is, typename F>
+        loaded_columns<column_type<Is>...> load( F on_column )
+        {
+            loaded_columns<column_type<Is>...> result( size() );
+            const std::size_t sources[] = {Is...};
+            char * targets[ sizeof...( Is ) ];
+            detail::for_each_index<sizeof...( Is )>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                targets[ I ] = reinterpret_cast<char *>( result.template data<I>() );
+            } );
+
+            std::vector<detail::column_read> reads;
+            for ( std::size_t k = 0; k < sizeof...( Is ); ++k )
+            {
+                const column_descriptor & descriptor = columns_[ sources[ k ] ];
+                const std::uint64_t padded = detail::align_up( descriptor.bytes, file_alignment );
+                for ( std::uint64_t done = 0; done < descriptor.bytes; done += options_.request_bytes )
+                {
+                    const auto length = std::size_t( std::min<std::uint64_t>( options_.request_bytes, padded - done ) );
+                    const auto needed =
+                        std::size_t( std::min<std::uint64_t>( options_.request_bytes, descriptor.bytes - done ) );
+                    reads.push_back( {k, descriptor.offset + done, needed, {targets[ k ] + done, length}} );
+                }
+            }
+
+            const int fd = direct_ ? direct_->descriptor() : file_.descriptor();
+            detail::read_tracker<F> tracker( file_.path(), reads, sizeof...( Is ), on_column, fd, file_.descriptor() );
+#if defined( SOA_HAS_IO_URING )
+            if ( ring_ )
+            {
+                detail::read_with_uring( *ring_, options_.queue_depth, reads, tracker );
+                return result;
+            }
+#endif
+            detail::read_with_pread( reads, tracker );
+            return result;
+        }
+
+    private:
+        detail::file file_;
+        loader_options options_;
+        file_header header_{};
+        std::vector<column_descriptor> columns_;
+        std::unique_ptr<detail::file> direct_;
+        std::unique_ptr<detail::uring> ring_;
+    };
+}
+
+#endif
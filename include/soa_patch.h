@@ -0,0 +1,381 @@
+#ifndef SOA_PATCH_H
+#define SOA_PATCH_H
+
+#include "soa.h"
+#include "soa_codec.h"
+
+#include <new>
+#include <stdexcept>
+#include <string>
+
+namespace soa
+{
+    // Raised when a serialized patch is malformed or a patch does not fit the table it is applied to.
+    class patch_error : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    // Columnar patches
+    //
+    // A patch turns one version of a table into the next. Rows are matched by position: each column carries the
+    // ranges of rows whose values changed together with their new values, rows appended at the end are changed
+    // ranges past the old size, and rows removed from the end show as a smaller new size. Values are compared
+    // bitwise, so unchanged NaNs stay unchanged.
+    //
+    //     auto delta = soa::diff( replicated, current );
+    //     soa::write_patch( delta, wire );
+    //     // on the standby
+    //     soa::apply( soa::read_patch<Ts...>( wire.data(), wire.size() ), replica );
+
+    struct row_range
+    {
+        std::uint64_t first;
+        std::uint64_t count;
+    };
+
+    // Changed rows of one column: ascending, disjoint, non-adjacent ranges, and their values back to back.
+    template <typename T>
+    struct column_patch
+    {
+        std::vector<row_range> ranges;
+        std::vector<T> values;
+    };
+
+    template <typename... Ts>
+    class patch
+    {
+    public:
+        using size_type = std::size_t;
+        using value_type = std::tuple<Ts...>;
+
+        template <std::size_t I>
+        using column_type = typename std::tuple_element<I, value_type>::type;
+
+        static constexpr std::size_t column_count = sizeof...( Ts );
+
+        patch() = default;
+
+        patch( size_type old_size, size_type new_size )
+            : old_size_( old_size )
+            , new_size_( new_size )
+        {
+        }
+
+        // Rows of the table the patch applies to.
+        size_type old_size() const
+        {
+            return old_size_;
+        }
+
+        // Rows of the table once patched.
+        size_type new_size() const
+        {
+            return new_size_;
+        }
+
+        size_type inserted() const
+        {
+            return new_size_ > old_size_ ? new_size_ - old_size_ : 0;
+        }
+
+        size_type deleted() const
+        {
+            return old_size_ > new_size_ ? old_size_ - new_size_ : 0;
+        }
+
+        template <std::size_t I>
+        const column_patch<column_type<I>> & column() const
+        {
+            return std::get<I>( columns_ );
+        }
+
+        template <std::size_t I>
+        column_patch<column_type<I>> & column()
+        {
+            return std::get<I>( columns_ );
+        }
+
+        // Cells written by the patch, across all columns.
+        size_type changed_cells() const
+        {
+            size_type total = 0;
+            detail::for_each_index<column_count>(
+                [&]( auto column ) { total += std::get<decltype( column )::value>( columns_ ).values.size(); } );
+            return total;
+        }
+
+        bool empty() const
+        {
+            return old_size_ == new_size_ && changed_cells() == 0;
+        }
+
+    private:
+        std::tuple<column_patch<Ts>...> columns_;
+        size_type old_size_ = 0;
+        size_type new_size_ = 0;
+    };
+
+    namespace detail
+    {
+        template <typename T>
+        bool same_bits( const T & a, const T & b )
+        {
+            return std::memcmp( &a, &b, sizeof( T ) ) == 0;
+        }
+
+        // Appends rows [first, first + count) with their values, extending the last range when adjacent.
+        template <typename T>
+        void add_range( column_patch<T> & out, const T * values, std::size_t first, std::size_t count )
+        {
+            if ( !out.ranges.empty() && out.ranges.back().first + out.ranges.back().count == first )
+            {
+                out.ranges.back().count += count;
+            }
+            else
+            {
+                out.ranges.push_back( {first, count} );
+            }
+            out.values.insert( out.values.end(), values + first, values + first + count );
+        }
+
+        // Ranges of rows where before and after differ within their first common rows, then the rows of after
+        // past them. Equal 64-row blocks are skipped with one memcmp.
+        template <typename T>
+        void diff_column( const T * before,
+                          const T * after,
+                          std::size_t common,
+                          std::size_t after_size,
+                          column_patch<T> & out )
+        {
+            constexpr std::size_t block = 64;
+            std::size_t i = 0;
+            while ( i < common )
+            {
+                if ( common - i >= block && std::memcmp( before + i, after + i, block * sizeof( T ) ) == 0 )
+                {
+                    i += block;
+                    continue;
+                }
+                if ( same_bits( before[ i ], after[ i ] ) )
+                {
+                    ++i;
+                    continue;
+                }
+                const std::size_t first = i;
+                while ( i < common && !same_bits( before[ i ], after[ i ] ) )
+                {
+                    ++i;
+                }
+                add_range( out, after, first, i - first );
+            }
+            if ( after_size > common )
+            {
+                add_range( out, after, common, after_size - common );
+            }
+        }
+
+        // Ranges of the rows marked in dirty, which must all be below the table size.
+        template <typename T>
+        void dirty_column( const T * values, const dirty_bitmap & dirty, column_patch<T> & out )
+        {
+            dirty.for_each_word( [&]( std::size_t w, std::uint64_t word ) {
+                while ( word != 0 )
+                {
+                    const unsigned start = count_trailing_zeros( word );
+                    const std::uint64_t shifted = word >> start;
+                    const unsigned length = ~shifted == 0 ? 64 - start : count_trailing_zeros( ~shifted );
+                    add_range( out, values, w * 64 + start, length );
+                    word = length + start == 64 ? 0 : word & ( ~std::uint64_t( 0 ) << ( start + length ) );
+                }
+            } );
+        }
+    }
+
+    // Patch turning before into after.
+    template <typename... Ts>
+    patch<Ts...> diff( const vector<Ts...> & before, const vector<Ts...> & after )
+    {
+        patch<Ts...> result( before.size(), after.size() );
+        const std::size_t common = std::min( before.size(), after.size() );
+        detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+            constexpr std::size_t I = decltype( column )::value;
+            detail::diff_column( before.template data<I>(),
+                                 after.template data<I>(),
+                                 common,
+                                 after.size(),
+                                 result.template column<I>() );
+        } );
+        return result;
+    }
+
+    // Patch turning the table as of its last checkpoint into its current rows, read off the dirty bitmaps without
+    // comparing values. Rows rewritten with their old value are included.
+    template <typename... Ts>
+    patch<Ts...> diff( const tracked_vector<Ts...> & table )
+    {
+        patch<Ts...> result( table.checkpoint_size(), table.size() );
+        detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+            constexpr std::size_t I = decltype( column )::value;
+            detail::dirty_column(
+                table.template data<I>(), table.template dirty<I>(), result.template column<I>() );
+        } );
+        return result;
+    }
+
+    // Replays p on table, which must hold the version p was computed from. Throws patch_error, leaving table
+    // unchanged, when table.size() differs from p.old_size(), when a range of p ends past p.new_size() or when a
+    // column of p does not have one value per changed row; other differences go unnoticed.
+    template <typename... Ts>
+    void apply( const patch<Ts...> & p, vector<Ts...> & table )
+    {
+        if ( table.size() != p.old_size() )
+        {
+            throw patch_error( "patch applies to " + std::to_string( p.old_size() ) + " rows, table has " +
+                               std::to_string( table.size() ) );
+        }
+        detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+            constexpr std::size_t I = decltype( column )::value;
+            const auto & changes = p.template column<I>();
+            std::uint64_t total = 0;
+            for ( const row_range & range : changes.ranges )
+            {
+                if ( range.first > p.new_size() || range.count > p.new_size() - range.first )
+                {
+                    throw patch_error( "patch column " + std::to_string( I ) + " has a range past row " +
+                                       std::to_string( p.new_size() ) );
+                }
+                total += range.count;
+            }
+            if ( total != changes.values.size() )
+            {
+                throw patch_error( "patch column " + std::to_string( I ) + " has " +
+                                   std::to_string( changes.values.size() ) + " values for " + std::to_string( total ) +
+                                   " changed rows" );
+            }
+        } );
+
+        table.resize( p.new_size() );
+        detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+            constexpr std::size_t I = decltype( column )::value;
+            const auto & changes = p.template column<I>();
+            const auto * source = changes.values.data();
+            for ( const row_range & range : changes.ranges )
+            {
+                std::copy( source, source + range.count, table.template data<I>() + range.first );
+                source += range.count;
+            }
+        } );
+    }
+
+    // Serializes p for shipping: sizes and ranges as varints, and the changed values of each column with the
+    // smallest codec of soa_codec.h.
+    template <typename... Ts>
+    void write_patch( const patch<Ts...> & p, std::vector<unsigned char> & out )
+    {
+        out.clear();
+        detail::put_varint( out, p.old_size() );
+        detail::put_varint( out, p.new_size() );
+        detail::put_varint( out, sizeof...( Ts ) );
+
+        std::vector<unsigned char> encoded, scratch;
+        detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+            constexpr std::size_t I = decltype( column )::value;
+            const auto & changes = p.template column<I>();
+            detail::put_varint( out, sizeof( typename patch<Ts...>::template column_type<I> ) );
+            detail::put_varint( out, changes.ranges.size() );
+            std::uint64_t end = 0;
+            for ( const row_range & range : changes.ranges )
+            {
+                detail::put_varint( out, range.first - end );
+                detail::put_varint( out, range.count );
+                end = range.first + range.count;
+            }
+            const encoding codec = encode_best( changes.values.data(), changes.values.size(), encoded, scratch );
+            detail::put_varint( out, std::uint64_t( codec ) );
+            detail::put_varint( out, encoded.size() );
+            out.insert( out.end(), encoded.begin(), encoded.end() );
+        } );
+    }
+
+    // Reads a patch written by write_patch for the same column types. Throws patch_error when the bytes are
+    // malformed or were written for other column types.
+    template <typename... Ts>
+    patch<Ts...> read_patch( const unsigned char * data, std::size_t bytes )
+    {
+        try
+        {
+            detail::byte_reader in( data, bytes );
+            const std::uint64_t old_size = in.varint();
+            const std::uint64_t new_size = in.varint();
+            if ( in.varint() != sizeof...( Ts ) )
+            {
+                throw patch_error( "patch has a different number of columns" );
+            }
+
+            patch<Ts...> result( old_size, new_size );
+            detail::for_each_index<sizeof...( Ts )>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                using T = typename patch<Ts...>::template column_type<I>;
+                auto & changes = result.template column<I>();
+                if ( in.varint() != sizeof( T ) )
+                {
+                    throw patch_error( "patch column " + std::to_string( I ) + " has a different element size" );
+                }
+
+                const std::uint64_t range_count = in.varint();
+                std::uint64_t end = 0, total = 0;
+                for ( std::uint64_t r = 0; r < range_count; ++r )
+                {
+                    const std::uint64_t gap = in.varint();
+                    const std::uint64_t count = in.varint();
+                    if ( count == 0 || gap > new_size - end || count > new_size - end - gap ||
+                         ( r > 0 && gap == 0 ) )
+                    {
+                        throw patch_error( "patch column " + std::to_string( I ) + " has an invalid row range" );
+                    }
+                    changes.ranges.push_back( {end + gap, count} );
+                    end += gap + count;
+                    total += count;
+                }
+
+                const std::uint64_t codec = in.varint();
+                if ( codec > std::uint64_t( encoding::xor_float ) )
+                {
+                    throw patch_error( "patch column " + std::to_string( I ) + " has an unknown codec" );
+                }
+                const auto payload = std::size_t( in.varint() );
+                const unsigned char * values = in.take( payload );
+                // The ranges already keep total within new_size; raw values must also be in the payload, which
+                // bounds the allocation by the patch's own size.
+                if ( static_cast<encoding>( codec ) == encoding::raw && total != payload / sizeof( T ) )
+                {
+                    throw patch_error( "patch column " + std::to_string( I ) + " has " + std::to_string( payload ) +
+                                       " raw bytes for " + std::to_string( total ) + " changed rows" );
+                }
+                changes.values.resize( std::size_t( total ) );
+                decode( static_cast<encoding>( codec ), values, payload, changes.values.data(), changes.values.size() );
+            } );
+            if ( in.remaining() != 0 )
+            {
+                throw patch_error( "trailing bytes after patch" );
+            }
+            return result;
+        }
+        catch ( const codec_error & e )
+        {
+            throw patch_error( std::string( "malformed patch: " ) + e.what() );
+        }
+        catch ( const std::bad_alloc & )
+        {
+            throw patch_error( "patch changes more rows than fit in memory" );
+        }
+        catch ( const std::length_error & )
+        {
+            throw patch_error( "patch changes more rows than fit in memory" );
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,538 @@
+#ifndef SOA_SNAPSHOT_H
+#define SOA_SNAPSHOT_H
+
+#include "soa.h"
+
+#include <atomic>
+#include <limits>
+
+namespace soa
+{
+    // Copy-on-write snapshots
+    //
+    // A versioned_vector keeps each column in a reference-counted buffer. Taking a snapshot shares every buffer,
+    // which costs one reference count increment per column. The writer copies a column only when it modifies rows
+    // that a live snapshot can see, so updating two columns of a forty column table copies two columns.
+
+    namespace detail
+    {
+        // Handle to a reference-counted column buffer. A handle drops its reference with release ordering and
+        // unique() checks for sole ownership with acquire ordering, so reads made through a handle on another
+        // thread happen before writes made after unique() has seen that handle gone.
+        template <typename T>
+        class shared_column
+        {
+        public:
+            shared_column() = default;
+
+            explicit shared_column( std::size_t capacity )
+                : buffer_( new buffer( capacity ) )
+            {
+            }
+
+            shared_column( const shared_column & other ) noexcept
+                : buffer_( other.buffer_ )
+            {
+                if ( buffer_ != nullptr )
+                {
+                    buffer_->references.fetch_add( 1, std::memory_order_relaxed );
+                }
+            }
+
+            shared_column( shared_column && other ) noexcept
+                : buffer_( other.buffer_ )
+            {
+                other.buffer_ = nullptr;
+            }
+
+            shared_column & operator=( shared_column other ) noexcept
+            {
+                std::swap( buffer_, other.buffer_ );
+                return *this;
+            }
+
+            ~shared_column()
+            {
+                if ( buffer_ != nullptr && buffer_->references.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+                {
+                    delete buffer_;
+                }
+            }
+
+            T * data() const
+            {
+                return buffer_ != nullptr ? buffer_->data : nullptr;
+            }
+
+            // True when no other handle refers to the buffer.
+            bool unique() const
+            {
+                return buffer_ == nullptr || buffer_->references.load( std::memory_order_acquire ) == 1;
+            }
+
+        private:
+            struct buffer
+            {
+                explicit buffer( std::size_t capacity )
+                    : data( allocate_column<T>( capacity ) )
+                {
+                }
+
+                buffer( const buffer & ) = delete;
+                buffer & operator=( const buffer & ) = delete;
+
+                ~buffer()
+                {
+                    deallocate( data );
+                }
+
+                std::atomic<std::size_t> references{1};
+                T * const data;
+            };
+
+            buffer * buffer_ = nullptr;
+        };
+    }
+
+    // Immutable view of a versioned_vector at the time the snapshot was taken. Copies are cheap, the columns stay
+    // valid after the versioned_vector changes or is destroyed, and snapshots can be read, copied and destroyed on
+    // any thread while the writer keeps working.
+    template <typename... Ts>
+    class snapshot
+    {
+    public:
+        using size_type = std::size_t;
+        using value_type = std::tuple<Ts...>;
+        using const_reference = std::tuple<const Ts &...>;
+        using const_iterator = row_iterator<const snapshot, const_reference>;
+
+        template <std::size_t I>
+        using column_type = typename std::tuple_element<I, value_type>::type;
+
+        static constexpr std::size_t column_count = sizeof...( Ts );
+
+        snapshot() = default;
+
+        snapshot( std::tuple<detail::shared_column<Ts>...> columns, size_type size )
+            : columns_( std::move( columns ) )
+            , size_( size )
+        {
+        }
+
+        size_type size() const
+        {
+            return size_;
+        }
+
+        bool empty() const
+        {
+            return size_ == 0;
+        }
+
+        template <std::size_t I>
+        const column_type<I> * data() const
+        {
+            return std::get<I>( columns_ ).data();
+        }
+
+        template <std::size_t I>
+        span<const column_type<I>> column() const
+        {
+            return {data<I>(), size_};
+        }
+
+        template <std::size_t I>
+        column_ref<const column_type<I>> col() const
+        {
+            return {data<I>(), size_};
+        }
+
+        template <std::size_t I>
+        const column_type<I> & get( size_type i ) const
+        {
+            assert( i < size_ );
+            return data<I>()[ i ];
+        }
+
+        const_reference operator[]( size_type i ) const
+        {
+            assert( i < size_ );
+            return row( i, std::index_sequence_for<Ts...>{} );
+        }
+
+        const_iterator begin() const
+        {
+            return {this, 0};
+        }
+
+        const_iterator end() const
+        {
+            return {this, size_};
+        }
+
+        vector<Ts...> to_vector() const
+        {
+            vector<Ts...> result( size_ );
+            detail::for_each_index<column_count>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                std::copy( data<I>(), data<I>() + size_, result.template data<I>() );
+            } );
+            return result;
+        }
+
+    private:
+        template <std::size_t... Is>
+        const_reference row( size_type i, std::index_sequence<Is...> ) const
+        {
+            return const_reference( data<Is>()[ i ]... );
+        }
+
+        std::tuple<detail::shared_column<Ts>...> columns_;
+        size_type size_ = 0;
+    };
+
+    // Growable structure of arrays with copy-on-write columns, for a single writer that publishes consistent
+    // versions to readers through snapshot(). Const access never copies. Mutating access through set, push_back
+    // and resize copies a column only if a live snapshot can see the rows being written; appending past every
+    // snapshot's rows writes in place. A copy of a versioned_vector is a second writer, so while a column is shared
+    // with a copy every write to it, appends included, copies it first. The non-const data<I>(), column<I>(),
+    // col<I>() and get<I>() hand out writable memory and therefore first make column I private, and the non-const
+    // operator[] does so for every column.
+    //
+    //     soa::versioned_vector<std::uint64_t, double, double> book;
+    //     auto view = book.snapshot();   // hand to readers
+    //     book.set<1>( row, price );     // copies column 1 only if view is still alive
+    template <typename... Ts>
+    class versioned_vector
+    {
+        static_assert( sizeof...( Ts ) > 0, "soa::versioned_vector needs at least one column" );
+        static_assert( detail::all_of<std::is_trivially_copyable<Ts>::value...>::value,
+                       "soa::versioned_vector columns must be trivially copyable" );
+
+    public:
+        using size_type = std::size_t;
+        using value_type = std::tuple<Ts...>;
+        using reference = std::tuple<Ts &...>;
+        using const_reference = std::tuple<const Ts &...>;
+        using const_iterator = row_iterator<const versioned_vector, const_reference>;
+
+        template <std::size_t I>
+        using column_type = typename std::tuple_element<I, value_type>::type;
+
+        static constexpr std::size_t column_count = sizeof...( Ts );
+
+        versioned_vector() = default;
+
+        explicit versioned_vector( const vector<Ts...> & rows )
+        {
+            reserve( rows.size() );
+            size_ = rows.size();
+            detail::for_each_index<column_count>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                std::copy( rows.template data<I>(), rows.template data<I>() + size_, this->template data<I>() );
+            } );
+        }
+
+        // Copies share every column until either side writes to it. Both may append into the spare capacity of a
+        // shared buffer, so each side treats every row of it as visible to the other.
+        versioned_vector( const versioned_vector & other )
+            : columns_( other.columns_ )
+            , size_( other.size_ )
+            , capacity_( other.capacity_ )
+        {
+            other.freeze( all_rows );
+            freeze( all_rows );
+        }
+
+        versioned_vector( versioned_vector && other ) noexcept
+        {
+            swap( other );
+        }
+
+        versioned_vector & operator=( const versioned_vector & other )
+        {
+            if ( this != &other )
+            {
+                versioned_vector copy( other );
+                swap( copy );
+            }
+            return *this;
+        }
+
+        versioned_vector & operator=( versioned_vector && other ) noexcept
+        {
+            versioned_vector moved( std::move( other ) );
+            swap( moved );
+            return *this;
+        }
+
+        void swap( versioned_vector & other ) noexcept
+        {
+            std::swap( columns_, other.columns_ );
+            std::swap( visible_, other.visible_ );
+            std::swap( size_, other.size_ );
+            std::swap( capacity_, other.capacity_ );
+        }
+
+        size_type size() const
+        {
+            return size_;
+        }
+
+        size_type capacity() const
+        {
+            return capacity_;
+        }
+
+        bool empty() const
+        {
+            return size_ == 0;
+        }
+
+        // Shares the current version of every column with the returned snapshot.
+        soa::snapshot<Ts...> snapshot() const
+        {
+            freeze( size_ );
+            return soa::snapshot<Ts...>( columns_, size_ );
+        }
+
+        // True while column I is shared with a snapshot or copy, i.e. a write below its visible rows would copy it.
+        template <std::size_t I>
+        bool shared() const
+        {
+            return !std::get<I>( columns_ ).unique();
+        }
+
+        void reserve( size_type capacity )
+        {
+            if ( capacity > capacity_ )
+            {
+                reallocate( capacity );
+            }
+        }
+
+        // New rows are value-initialized.
+        void resize( size_type size )
+        {
+            if ( size > capacity_ )
+            {
+                reallocate( std::max( size, grown_capacity() ) );
+            }
+            if ( size > size_ )
+            {
+                detail::for_each_index<column_count>( [&]( auto column ) {
+                    constexpr std::size_t I = decltype( column )::value;
+                    column_type<I> * target = writable<I>( size_ );
+                    std::fill( target + size_, target + size, column_type<I>() );
+                } );
+            }
+            size_ = size;
+        }
+
+        void clear()
+        {
+            size_ = 0;
+        }
+
+        void push_back( const Ts &... values )
+        {
+            if ( size_ == capacity_ )
+            {
+                reallocate( grown_capacity() );
+            }
+            assign_row( size_, std::index_sequence_for<Ts...>{}, values... );
+            ++size_;
+        }
+
+        void push_back( const value_type & row )
+        {
+            push_back_tuple( row, std::index_sequence_for<Ts...>{} );
+        }
+
+        void pop_back()
+        {
+            assert( size_ > 0 );
+            --size_;
+        }
+
+        // Writes one value, copying column I first only if a snapshot can see row i.
+        template <std::size_t I>
+        void set( size_type i, const column_type<I> & value )
+        {
+            assert( i < size_ );
+            writable<I>( i )[ i ] = value;
+        }
+
+        template <std::size_t I>
+        const column_type<I> * data() const
+        {
+            return std::get<I>( columns_ ).data();
+        }
+
+        template <std::size_t I>
+        column_type<I> * data()
+        {
+            return writable<I>( 0 );
+        }
+
+        template <std::size_t I>
+        span<const column_type<I>> column() const
+        {
+            return {data<I>(), size_};
+        }
+
+        template <std::size_t I>
+        span<column_type<I>> column()
+        {
+            return {data<I>(), size_};
+        }
+
+        template <std::size_t I>
+        column_ref<const column_type<I>> col() const
+        {
+            return {data<I>(), size_};
+        }
+
+        template <std::size_t I>
+        column_ref<column_type<I>> col()
+        {
+            return {data<I>(), size_};
+        }
+
+        template <std::size_t I>
+        const column_type<I> & get( size_type i ) const
+        {
+            assert( i < size_ );
+            return data<I>()[ i ];
+        }
+
+        template <std::size_t I>
+        column_type<I> & get( size_type i )
+        {
+            assert( i < size_ );
+            return data<I>()[ i ];
+        }
+
+        const_reference operator[]( size_type i ) const
+        {
+            assert( i < size_ );
+            return row( i, std::index_sequence_for<Ts...>{} );
+        }
+
+        reference operator[]( size_type i )
+        {
+            assert( i < size_ );
+            return row( i, std::index_sequence_for<Ts...>{} );
+        }
+
+        const_iterator begin() const
+        {
+            return {this, 0};
+        }
+
+        const_iterator end() const
+        {
+            return {this, size_};
+        }
+
+        const_iterator cbegin() const
+        {
+            return begin();
+        }
+
+        const_iterator cend() const
+        {
+            return end();
+        }
+
+    private:
+        static constexpr size_type all_rows = std::numeric_limits<size_type>::max();
+
+        size_type grown_capacity() const
+        {
+            return std::max<size_type>( 16, capacity_ * 2 );
+        }
+
+        // Rows below rows may now be read through a snapshot or copy of every current column.
+        void freeze( size_type rows ) const
+        {
+            for ( size_type & visible : visible_ )
+            {
+                visible = std::max( visible, rows );
+            }
+        }
+
+        // Column I, made safe to write from row first on: copied into a private buffer if a snapshot or copy shares
+        // it and can see that row. Only the writer and its copies create sharers, so a buffer found unique cannot
+        // become shared behind the writer's back, and nothing can see its rows any more.
+        template <std::size_t I>
+        column_type<I> * writable( size_type first )
+        {
+            if ( first < visible_[ I ] )
+            {
+                if ( shared<I>() )
+                {
+                    std::get<I>( columns_ ) = copy_column<I>( capacity_ );
+                }
+                visible_[ I ] = 0;
+            }
+            return std::get<I>( columns_ ).data();
+        }
+
+        template <std::size_t I>
+        detail::shared_column<column_type<I>> copy_column( size_type capacity ) const
+        {
+            detail::shared_column<column_type<I>> result( capacity );
+            if ( size_ > 0 )
+            {
+                std::memcpy( result.data(), data<I>(), size_ * sizeof( column_type<I> ) );
+            }
+            return result;
+        }
+
+        // Moves every column to a private buffer of the given capacity; snapshots keep the old ones.
+        void reallocate( size_type capacity )
+        {
+            detail::for_each_index<column_count>( [&]( auto column ) {
+                constexpr std::size_t I = decltype( column )::value;
+                std::get<I>( columns_ ) = copy_column<I>( capacity );
+                visible_[ I ] = 0;
+            } );
+            capacity_ = capacity;
+        }
+
+        template <std::size_t... Is>
+        void assign_row( size_type i, std::index_sequence<Is...>, const Ts &... values )
+        {
+            using swallow = int[];
+            (void)swallow{0, ( writable<Is>( i )[ i ] = values, 0 )...};
+        }
+
+        template <std::size_t... Is>
+        void push_back_tuple( const value_type & row, std::index_sequence<Is...> )
+        {
+            push_back( std::get<Is>( row )... );
+        }
+
+        template <std::size_t... Is>
+        reference row( size_type i, std::index_sequence<Is...> )
+        {
+            return reference( writable<Is>( 0 )[ i ]... );
+        }
+
+        template <std::size_t... Is>
+        const_reference row( size_type i, std::index_sequence<Is...> ) const
+        {
+            return const_reference( data<Is>()[ i ]... );
+        }
+
+        std::tuple<detail::shared_column<Ts>...> columns_;
+        // Per column, how many rows snapshots and copies sharing its current buffer may read. Taking a snapshot
+        // raises it, hence mutable.
+        mutable size_type visible_[ sizeof...( Ts ) ] = {};
+        size_type size_ = 0;
+        size_type capacity_ = 0;
+    };
+}
+
+#endif
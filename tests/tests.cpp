@@ -1,5 +1,20 @@
 #include "catch.hpp"
 #include "soa.h"
+#include "soa_arrow.h"
+#include "soa_concurrent.h"
+#include "soa_csv.h"
+#include "soa_io.h"
+#include "soa_loader.h"
+#include "soa_patch.h"
+#include "soa_snapshot.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <thread>
 
 TEST_CASE( "test", "[tag]" )
 {
@@ -8,3 +23,2438 @@ TEST_CASE( "test", "[tag]" )
         REQUIRE( true );
     }
 }
+
+TEST_CASE( "vector", "[vector]" )
+{
+    soa::vector<int, float, double> v;
+
+    SECTION( "push_back and access" )
+    {
+        for ( int i = 0; i < 100; ++i )
+        {
+            v.push_back( i, float( i ) * 0.5f, double( i ) * 2.0 );
+        }
+
+        REQUIRE( v.size() == 100 );
+        REQUIRE( v.capacity() >= 100 );
+        REQUIRE( v.get<0>( 42 ) == 42 );
+        REQUIRE( v.get<1>( 42 ) == 21.0f );
+        REQUIRE( std::get<2>( v[ 42 ] ) == 84.0 );
+        REQUIRE( reinterpret_cast<std::uintptr_t>( v.data<1>() ) % 64 == 0 );
+
+        std::get<0>( v[ 3 ] ) = -3;
+        REQUIRE( v.column<0>()[ 3 ] == -3 );
+    }
+
+    SECTION( "iteration" )
+    {
+        v.push_back( 1, 1.0f, 1.0 );
+        v.push_back( 2, 2.0f, 2.0 );
+        v.push_back( std::make_tuple( 3, 3.0f, 3.0 ) );
+
+        int total = 0;
+        for ( auto row : v )
+        {
+            total += std::get<0>( row );
+            std::get<2>( row ) *= 10.0;
+        }
+        REQUIRE( total == 6 );
+        REQUIRE( v.get<2>( 2 ) == 30.0 );
+        REQUIRE( v.end() - v.begin() == 3 );
+    }
+
+    SECTION( "copy, move and resize" )
+    {
+        v.resize( 10 );
+        REQUIRE( v.get<0>( 9 ) == 0 );
+        v.get<0>( 9 ) = 9;
+
+        soa::vector<int, float, double> copy( v );
+        REQUIRE( copy.size() == 10 );
+        REQUIRE( copy.get<0>( 9 ) == 9 );
+
+        soa::vector<int, float, double> moved( std::move( copy ) );
+        REQUIRE( moved.get<0>( 9 ) == 9 );
+
+        moved.append( v );
+        REQUIRE( moved.size() == 20 );
+        REQUIRE( moved.get<0>( 19 ) == 9 );
+
+        moved.clear();
+        REQUIRE( moved.empty() );
+    }
+
+    SECTION( "push_back of its own row while growing" )
+    {
+        for ( int i = 0; i < 16; ++i )
+        {
+            v.push_back( i, float( i ), double( i ) );
+        }
+        REQUIRE( v.size() == v.capacity() );
+
+        v.push_back( v.get<0>( 3 ), v.get<1>( 4 ), v.get<2>( 5 ) );
+        REQUIRE( v.size() == 17 );
+        REQUIRE( v.get<0>( 16 ) == 3 );
+        REQUIRE( v.get<1>( 16 ) == 4.0f );
+        REQUIRE( v.get<2>( 16 ) == 5.0 );
+    }
+
+    SECTION( "oversized reservations throw" )
+    {
+        v.push_back( 1, 1.0f, 1.0 );
+        REQUIRE_THROWS_AS( v.reserve( std::numeric_limits<std::size_t>::max() / 2 ), std::length_error );
+        REQUIRE_THROWS_AS( v.reserve( std::numeric_limits<std::size_t>::max() - 8 ), std::length_error );
+        REQUIRE( v.size() == 1 );
+        REQUIRE( v.get<2>( 0 ) == 1.0 );
+    }
+}
+
+TEST_CASE( "reductions", "[reduce]" )
+{
+    soa::vector<float, float, int> v;
+    std::uint32_t seed = 12345;
+    for ( int i = 0; i < 100000; ++i )
+    {
+        seed = seed * 1664525u + 1013904223u;
+        const float magnitude = float( seed >> 8 ) / float( 1 << 24 );
+        const float value = ( seed & 1 ) ? magnitude * 1e6f : -magnitude * 1e-3f;
+        v.push_back( value, magnitude, int( seed % 1000 ) - 500 );
+    }
+
+    SECTION( "bit-identical across thread counts" )
+    {
+        const float sum = soa::sum<0>( v, 1 );
+        const double variance = soa::variance<0>( v, 1 );
+        const float weighted = soa::weighted_sum<0, 1>( v, 1 );
+
+        for ( unsigned threads : {2u, 3u, 4u, 7u, 16u, 64u} )
+        {
+            const float parallel_sum = soa::sum<0>( v, threads );
+            const double parallel_variance = soa::variance<0>( v, threads );
+            const float parallel_weighted = soa::weighted_sum<0, 1>( v, threads );
+
+            REQUIRE( std::memcmp( &sum, &parallel_sum, sizeof( sum ) ) == 0 );
+            REQUIRE( std::memcmp( &variance, &parallel_variance, sizeof( variance ) ) == 0 );
+            REQUIRE( std::memcmp( &weighted, &parallel_weighted, sizeof( weighted ) ) == 0 );
+        }
+    }
+
+    SECTION( "values" )
+    {
+        long long int_sum = 0;
+        int int_min = 1000;
+        int int_max = -1000;
+        double float_sum = 0.0;
+        for ( std::size_t i = 0; i < v.size(); ++i )
+        {
+            int_sum += v.get<2>( i );
+            int_min = std::min( int_min, v.get<2>( i ) );
+            int_max = std::max( int_max, v.get<2>( i ) );
+            float_sum += double( v.get<1>( i ) );
+        }
+        const double float_mean = float_sum / double( v.size() );
+        double float_m2 = 0.0;
+        for ( std::size_t i = 0; i < v.size(); ++i )
+        {
+            const double d = double( v.get<1>( i ) ) - float_mean;
+            float_m2 += d * d;
+        }
+
+        REQUIRE( soa::reduce<2>( v, 0LL, []( long long a, long long b ) { return a + b; }, 4 ) == int_sum );
+        REQUIRE_THROWS_AS(
+            soa::reduce<2>( v, 0LL, []( long long, long long ) -> long long { throw std::runtime_error( "op" ); }, 4 ),
+            std::runtime_error );
+        REQUIRE( soa::min<2>( v, 3 ) == int_min );
+        REQUIRE( soa::max<2>( v, 3 ) == int_max );
+        REQUIRE( soa::mean<1>( v, 4 ) == Approx( float_mean ) );
+        REQUIRE( soa::variance<1>( v, 4 ) == Approx( float_m2 / double( v.size() ) ) );
+    }
+
+    SECTION( "empty" )
+    {
+        soa::vector<float> empty;
+        REQUIRE( soa::sum<0>( empty, 4 ) == 0.0f );
+        REQUIRE( soa::mean<0>( empty ) == 0.0 );
+        REQUIRE( soa::variance<0>( empty ) == 0.0 );
+    }
+}
+
+TEST_CASE( "group_by", "[group_by]" )
+{
+    soa::vector<std::uint32_t, float, int> trades;
+    std::map<std::uint32_t, std::tuple<int, std::uint64_t, int, int>> expected;
+    std::uint32_t seed = 7;
+    for ( int i = 0; i < 20000; ++i )
+    {
+        seed = seed * 1664525u + 1013904223u;
+        const std::uint32_t symbol = ( seed >> 10 ) % 997;
+        const int quantity = int( seed % 100 ) - 50;
+        trades.push_back( symbol, 1.0f, quantity );
+
+        auto found = expected.find( symbol );
+        if ( found == expected.end() )
+        {
+            expected[ symbol ] = std::make_tuple( quantity, 1, quantity, quantity );
+        }
+        else
+        {
+            std::get<0>( found->second ) += quantity;
+            std::get<1>( found->second ) += 1;
+            std::get<2>( found->second ) = std::min( std::get<2>( found->second ), quantity );
+            std::get<3>( found->second ) = std::max( std::get<3>( found->second ), quantity );
+        }
+    }
+
+    const auto result =
+        soa::group_by<0>( trades ).aggregate<2>( soa::agg::sum, soa::agg::count, soa::agg::min, soa::agg::max );
+
+    REQUIRE( result.size() == expected.size() );
+    REQUIRE( result.get<0>( 0 ) == trades.get<0>( 0 ) );
+    for ( std::size_t group = 0; group < result.size(); ++group )
+    {
+        const auto & totals = expected.at( result.get<0>( group ) );
+        REQUIRE( result.get<1>( group ) == std::get<0>( totals ) );
+        REQUIRE( result.get<2>( group ) == std::get<1>( totals ) );
+        REQUIRE( result.get<3>( group ) == std::get<2>( totals ) );
+        REQUIRE( result.get<4>( group ) == std::get<3>( totals ) );
+    }
+
+    const auto counts = soa::group_by<0>( trades ).aggregate<1>( soa::agg::count );
+    REQUIRE( counts.size() == expected.size() );
+}
+
+TEST_CASE( "hash join", "[join]" )
+{
+    // orders: instrument id, quantity; instruments: id, tick size
+    soa::vector<std::uint32_t, int> orders;
+    soa::vector<std::uint32_t, float> instruments;
+    std::uint32_t seed = 99;
+    for ( int i = 0; i < 5000; ++i )
+    {
+        seed = seed * 1664525u + 1013904223u;
+        orders.push_back( ( seed >> 8 ) % 700, i );
+    }
+    for ( std::uint32_t id = 0; id < 600; ++id )
+    {
+        instruments.push_back( id, float( id ) * 0.25f );
+    }
+    instruments.push_back( 5, -1.0f ); // duplicate key on the build side
+
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> expected;
+    for ( std::uint32_t o = 0; o < orders.size(); ++o )
+    {
+        for ( std::uint32_t n = 0; n < instruments.size(); ++n )
+        {
+            if ( orders.get<0>( o ) == instruments.get<0>( n ) )
+            {
+                expected.emplace_back( o, n );
+            }
+        }
+    }
+
+    const auto sorted_pairs = []( const soa::join_pairs & pairs ) {
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> result;
+        for ( auto row : pairs )
+        {
+            result.emplace_back( std::get<0>( row ), std::get<1>( row ) );
+        }
+        std::sort( result.begin(), result.end() );
+        return result;
+    };
+
+    SECTION( "hash join" )
+    {
+        REQUIRE( sorted_pairs( soa::hash_join<0, 0>( orders, instruments ) ) == expected );
+
+        auto swapped = sorted_pairs( soa::hash_join<0, 0>( instruments, orders ) );
+        for ( auto & pair : swapped )
+        {
+            std::swap( pair.first, pair.second );
+        }
+        std::sort( swapped.begin(), swapped.end() );
+        REQUIRE( swapped == expected );
+    }
+
+    SECTION( "radix partitioned" )
+    {
+        const auto single = soa::radix_hash_join<0, 0>( orders, instruments, 1, 1024 );
+        const auto parallel = soa::radix_hash_join<0, 0>( orders, instruments, 4, 1024 );
+        REQUIRE( sorted_pairs( single ) == expected );
+        REQUIRE( single.size() == parallel.size() );
+        REQUIRE( std::equal( single.data<0>(), single.data<0>() + single.size(), parallel.data<0>() ) );
+        REQUIRE( std::equal( single.data<1>(), single.data<1>() + single.size(), parallel.data<1>() ) );
+    }
+
+    SECTION( "gather joined columns" )
+    {
+        const auto pairs = soa::hash_join<0, 0>( orders, instruments );
+        const auto quantities = soa::take<1>( orders, pairs.column<0>() );
+        const auto ticks = soa::take<0, 1>( instruments, pairs.column<1>() );
+        REQUIRE( quantities.size() == pairs.size() );
+        for ( std::size_t i = 0; i < pairs.size(); ++i )
+        {
+            REQUIRE( quantities.get<0>( i ) == orders.get<1>( pairs.get<0>( i ) ) );
+            REQUIRE( ticks.get<0>( i ) == orders.get<0>( pairs.get<0>( i ) ) );
+            REQUIRE( ticks.get<1>( i ) == instruments.get<1>( pairs.get<1>( i ) ) );
+        }
+    }
+}
+
+TEST_CASE( "merge", "[merge]" )
+{
+    using feed = soa::vector<std::int64_t, double, std::uint32_t>;
+
+    const auto make_feed = []( std::uint32_t seed, std::size_t size, std::uint32_t source ) {
+        feed result;
+        std::int64_t timestamp = 0;
+        for ( std::size_t i = 0; i < size; ++i )
+        {
+            seed = seed * 1664525u + 1013904223u;
+            timestamp += ( seed >> 16 ) % 4;
+            result.push_back( timestamp, double( seed % 1000 ), source );
+        }
+        return result;
+    };
+
+    const feed a = make_feed( 1, 50000, 0 );
+    const feed b = make_feed( 2, 30000, 1 );
+
+    std::vector<std::tuple<std::int64_t, double, std::uint32_t>> expected;
+    const auto by_timestamp = []( const auto & x, const auto & y ) { return std::get<0>( x ) < std::get<0>( y ); };
+    std::merge( a.begin(), a.end(), b.begin(), b.end(), std::back_inserter( expected ), by_timestamp );
+
+    SECTION( "stable merge carries all columns" )
+    {
+        const feed merged = soa::merge( a, b );
+        REQUIRE( merged.size() == expected.size() );
+        for ( std::size_t i = 0; i < merged.size(); ++i )
+        {
+            REQUIRE( std::tuple<std::int64_t, double, std::uint32_t>( merged[ i ] ) == expected[ i ] );
+        }
+    }
+
+    SECTION( "merge path partitioning" )
+    {
+        const feed single = soa::merge( a, b, 1 );
+        for ( unsigned threads : {2u, 3u, 5u} )
+        {
+            const feed parallel = soa::merge( a, b, threads );
+            REQUIRE( std::equal( single.data<0>(), single.data<0>() + single.size(), parallel.data<0>() ) );
+            REQUIRE( std::equal( single.data<1>(), single.data<1>() + single.size(), parallel.data<1>() ) );
+            REQUIRE( std::equal( single.data<2>(), single.data<2>() + single.size(), parallel.data<2>() ) );
+        }
+    }
+
+    SECTION( "empty inputs" )
+    {
+        REQUIRE( soa::merge( a, feed() ).size() == a.size() );
+        REQUIRE( soa::merge( feed(), b, 4 ).get<0>( 10 ) == b.get<0>( 10 ) );
+    }
+
+    SECTION( "merge join" )
+    {
+        const auto pairs = soa::merge_join<0, 0>( a, b );
+        std::size_t expected_pairs = 0;
+        for ( std::size_t i = 0, j = 0; i < a.size(); ++i )
+        {
+            while ( j < b.size() && b.get<0>( j ) < a.get<0>( i ) )
+            {
+                ++j;
+            }
+            for ( std::size_t k = j; k < b.size() && b.get<0>( k ) == a.get<0>( i ); ++k )
+            {
+                REQUIRE( pairs.get<0>( expected_pairs ) == i );
+                REQUIRE( pairs.get<1>( expected_pairs ) == k );
+                ++expected_pairs;
+            }
+        }
+        REQUIRE( pairs.size() == expected_pairs );
+    }
+}
+
+TEST_CASE( "zone map", "[zone_map]" )
+{
+    soa::vector<std::int64_t, float> ticks;
+    auto zones = soa::make_zone_map<0>( ticks, 100 );
+    REQUIRE( zones.block_count() == 0 );
+
+    std::int64_t timestamp = 1000;
+    for ( int batch = 0; batch < 10; ++batch )
+    {
+        for ( int i = 0; i < 73; ++i )
+        {
+            timestamp += i % 3;
+            ticks.push_back( timestamp, float( i ) );
+        }
+        zones.update( ticks );
+    }
+
+    REQUIRE( zones.rows() == ticks.size() );
+    REQUIRE( zones.block_count() == ( ticks.size() + 99 ) / 100 );
+    REQUIRE( zones.min( 0 ) == ticks.get<0>( 0 ) );
+    REQUIRE( zones.max( 1 ) == ticks.get<0>( 199 ) );
+
+    const auto check = [&]( std::int64_t low, std::int64_t high ) {
+        std::vector<std::uint32_t> expected;
+        for ( std::uint32_t row = 0; row < ticks.size(); ++row )
+        {
+            if ( ticks.get<0>( row ) >= low && ticks.get<0>( row ) <= high )
+            {
+                expected.push_back( row );
+            }
+        }
+        std::vector<std::uint32_t> rows;
+        zones.filter( ticks, low, high ).for_each( [&rows]( std::uint32_t row ) { rows.push_back( row ); } );
+        REQUIRE( rows == expected );
+    };
+    check( 1200, 1300 );
+    check( 0, 999 );
+    check( 0, 1 << 20 );
+    check( timestamp, timestamp );
+
+    std::size_t scanned = 0;
+    zones.for_each_candidate( 1200, 1300, [&]( std::size_t, std::size_t, bool ) { ++scanned; } );
+    REQUIRE( scanned < 3 );
+
+    ticks.get<0>( 5 ) = -1;
+    zones.rebuild( ticks );
+    REQUIRE( zones.min( 0 ) == -1 );
+    check( -1, -1 );
+}
+
+TEST_CASE( "sorted index", "[sorted_index]" )
+{
+    soa::vector<std::uint64_t, std::int32_t> orders;
+    std::uint32_t seed = 3;
+    const auto append = [&]( std::size_t count ) {
+        for ( std::size_t i = 0; i < count; ++i )
+        {
+            seed = seed * 1664525u + 1013904223u;
+            orders.push_back( orders.size(), std::int32_t( ( seed >> 8 ) % 5000 ) );
+        }
+    };
+
+    const auto expected_rows = [&]( std::int32_t low, std::int32_t high ) {
+        std::vector<std::pair<std::int32_t, std::uint32_t>> matches;
+        for ( std::uint32_t row = 0; row < orders.size(); ++row )
+        {
+            if ( orders.get<1>( row ) >= low && orders.get<1>( row ) <= high )
+            {
+                matches.emplace_back( orders.get<1>( row ), row );
+            }
+        }
+        std::sort( matches.begin(), matches.end() );
+        std::vector<std::uint32_t> rows;
+        for ( const auto & match : matches )
+        {
+            rows.push_back( match.second );
+        }
+        return rows;
+    };
+
+    const auto as_vector = []( soa::span<const std::uint32_t> rows ) {
+        return std::vector<std::uint32_t>( rows.begin(), rows.end() );
+    };
+
+    append( 40000 );
+    soa::sorted_index<1, decltype( orders )> index( orders );
+    REQUIRE( index.size() == orders.size() );
+    REQUIRE( index.memory_bytes() >= orders.size() * 8 );
+    REQUIRE( std::is_sorted( index.keys().begin(), index.keys().end() ) );
+
+    SECTION( "lookups" )
+    {
+        REQUIRE( as_vector( index.equal_range( 1234 ) ) == expected_rows( 1234, 1234 ) );
+        REQUIRE( as_vector( index.range( 100, 250 ) ) == expected_rows( 100, 250 ) );
+        REQUIRE( index.equal_range( 9999 ).empty() );
+        REQUIRE( index.range( 10, 5 ).empty() );
+        REQUIRE( index.lower_bound( 0 ) == 0 );
+        REQUIRE( index.upper_bound( 5000 ) == index.size() );
+    }
+
+    SECTION( "incremental maintenance" )
+    {
+        append( 1000 );
+        index.update( orders );
+        REQUIRE( index.size() == orders.size() );
+        REQUIRE( as_vector( index.equal_range( 42 ) ) == expected_rows( 42, 42 ) );
+        REQUIRE( as_vector( index.range( 4000, 4100 ) ) == expected_rows( 4000, 4100 ) );
+    }
+
+    SECTION( "parallel rebuild" )
+    {
+        soa::sorted_index<1, decltype( orders )> parallel( orders, 3 );
+        REQUIRE( std::equal( index.rows().begin(), index.rows().end(), parallel.rows().begin() ) );
+    }
+}
+
+TEST_CASE( "bitmap", "[bitmap]" )
+{
+    SECTION( "containers and set operations" )
+    {
+        soa::bitmap sparse;
+        soa::bitmap dense;
+        std::vector<std::uint32_t> sparse_rows;
+        std::vector<std::uint32_t> dense_rows;
+        for ( std::uint32_t row = 0; row < 200000; ++row )
+        {
+            if ( row % 97 == 0 )
+            {
+                sparse.add( row );
+                sparse_rows.push_back( row );
+            }
+            if ( row % 3 != 0 )
+            {
+                dense.add( row );
+                dense_rows.push_back( row );
+            }
+        }
+        sparse.add( 5 );
+        sparse.add( 0 );
+        sparse_rows.insert( sparse_rows.begin() + 1, 5 );
+
+        REQUIRE( sparse.rows() == sparse_rows );
+        REQUIRE( dense.rows() == dense_rows );
+        REQUIRE( dense.cardinality() == dense_rows.size() );
+        REQUIRE( dense.contains( 199999 ) );
+        REQUIRE_FALSE( dense.contains( 199998 ) );
+        REQUIRE( dense.memory_bytes() < dense_rows.size() * sizeof( std::uint32_t ) );
+
+        std::vector<std::uint32_t> expected;
+        std::set_intersection( sparse_rows.begin(),
+                              sparse_rows.end(),
+                              dense_rows.begin(),
+                              dense_rows.end(),
+                              std::back_inserter( expected ) );
+        REQUIRE( ( sparse & dense ).rows() == expected );
+
+        expected.clear();
+        std::set_union( sparse_rows.begin(),
+                         sparse_rows.end(),
+                         dense_rows.begin(),
+                         dense_rows.end(),
+                         std::back_inserter( expected ) );
+        REQUIRE( ( sparse | dense ).rows() == expected );
+
+        const auto not_dense = dense.complement( 200000 );
+        REQUIRE( not_dense.cardinality() == 200000 - dense_rows.size() );
+        REQUIRE( not_dense.contains( 3 ) );
+        REQUIRE_FALSE( not_dense.contains( 4 ) );
+        REQUIRE( ( not_dense | dense ).cardinality() == 200000 );
+        REQUIRE( ( not_dense & dense ).empty() );
+    }
+
+    SECTION( "multi-predicate filter" )
+    {
+        // status, side, venue, price
+        soa::vector<std::uint8_t, std::uint8_t, std::uint16_t, double> orders;
+        std::uint32_t seed = 11;
+        for ( int i = 0; i < 100000; ++i )
+        {
+            seed = seed * 1664525u + 1013904223u;
+            orders.push_back(
+                std::uint8_t( seed >> 28 ), std::uint8_t( ( seed >> 8 ) & 1 ), std::uint16_t( seed % 7 ), double( i ) );
+        }
+
+        soa::bitmap_index<0, decltype( orders )> status( orders );
+        soa::bitmap_index<1, decltype( orders )> side( orders );
+        soa::bitmap_index<2, decltype( orders )> venue( orders );
+        REQUIRE( status.distinct_count() == 16 );
+        REQUIRE( venue.distinct_count() == 7 );
+        REQUIRE( venue.equal( 100 ).empty() );
+
+        const auto selected =
+            ( ( status.equal( 3 ) | status.equal( 4 ) ) & side.equal( 1 ) & venue.equal( 2 ).complement( 100000 ) )
+                .rows();
+
+        std::vector<std::uint32_t> expected;
+        for ( std::uint32_t row = 0; row < orders.size(); ++row )
+        {
+            const auto s = orders.get<0>( row );
+            if ( ( s == 3 || s == 4 ) && orders.get<1>( row ) == 1 && orders.get<2>( row ) != 2 )
+            {
+                expected.push_back( row );
+            }
+        }
+        REQUIRE( selected == expected );
+
+        const auto prices = soa::take<3>( orders, selected );
+        REQUIRE( prices.size() == expected.size() );
+        REQUIRE( prices.get<0>( 0 ) == double( expected[ 0 ] ) );
+
+        orders.push_back( 3, 1, 5, -1.0 );
+        status.update( orders );
+        REQUIRE( status.rows() == orders.size() );
+        REQUIRE( status.equal( 3 ).contains( std::uint32_t( orders.size() - 1 ) ) );
+    }
+}
+
+TEST_CASE( "selection", "[selection]" )
+{
+    // symbol, side, price, quantity
+    soa::vector<std::uint32_t, int, double, int> orders;
+    for ( int i = 0; i < 10000; ++i )
+    {
+        orders.push_back( std::uint32_t( i % 37 ), i % 2, double( i % 1000 ), i );
+    }
+
+    const auto rows_of = []( const soa::selection & selected ) {
+        std::vector<std::uint32_t> rows;
+        selected.for_each( [&rows]( std::uint32_t row ) { rows.push_back( row ); } );
+        return rows;
+    };
+
+    const auto expected = [&]( auto pred ) {
+        std::vector<std::uint32_t> rows;
+        for ( std::uint32_t row = 0; row < orders.size(); ++row )
+        {
+            if ( pred( row ) )
+            {
+                rows.push_back( row );
+            }
+        }
+        return rows;
+    };
+
+    SECTION( "representation follows selectivity" )
+    {
+        const auto dense = soa::filter<1>( orders, []( int side ) { return side == 1; } );
+        REQUIRE( dense.is_mask() );
+        REQUIRE( dense.size() == 5000 );
+
+        const auto sparse = soa::filter<2>( orders, []( double price ) { return price < 10.0; } );
+        REQUIRE_FALSE( sparse.is_mask() );
+        REQUIRE( sparse.size() == 100 );
+
+        REQUIRE( soa::selection::all( 100 ).size() == 100 );
+        REQUIRE( soa::selection::all( 100 ).contains( 99 ) );
+        REQUIRE_FALSE( soa::selection::all( 100 ).contains( 100 ) );
+    }
+
+    SECTION( "filter pipeline with late materialization" )
+    {
+        auto selected = soa::filter<1>( orders, []( int side ) { return side == 0; } );
+        selected = soa::filter<2>( orders, selected, []( double price ) { return price >= 500.0; } );
+        REQUIRE( selected.is_mask() );
+        selected = soa::filter<0>( orders, selected, []( std::uint32_t symbol ) { return symbol == 5; } );
+        REQUIRE_FALSE( selected.is_mask() );
+
+        const auto rows = expected( [&]( std::uint32_t row ) {
+            return orders.get<1>( row ) == 0 && orders.get<2>( row ) >= 500.0 && orders.get<0>( row ) == 5;
+        } );
+        REQUIRE( rows_of( selected ) == rows );
+
+        const auto result = soa::take<3, 2>( orders, selected );
+        REQUIRE( result.size() == rows.size() );
+        for ( std::size_t i = 0; i < rows.size(); ++i )
+        {
+            REQUIRE( result.get<0>( i ) == orders.get<3>( rows[ i ] ) );
+            REQUIRE( result.get<1>( i ) == orders.get<2>( rows[ i ] ) );
+        }
+
+        const auto dense = soa::take<3>( orders, soa::filter<1>( orders, []( int side ) { return side == 1; } ) );
+        REQUIRE( dense.size() == 5000 );
+        REQUIRE( dense.get<0>( 10 ) == 21 );
+    }
+
+    SECTION( "set operations" )
+    {
+        const auto odd = soa::filter<1>( orders, []( int side ) { return side == 1; } );
+        const auto cheap = soa::filter<2>( orders, []( double price ) { return price < 10.0; } );
+        const auto symbol = soa::filter<0>( orders, []( std::uint32_t s ) { return s == 3; } );
+
+        REQUIRE( rows_of( odd & cheap ) ==
+                 expected( [&]( std::uint32_t row ) { return row % 2 == 1 && orders.get<2>( row ) < 10.0; } ) );
+        REQUIRE( rows_of( cheap | symbol ) ==
+                 expected( [&]( std::uint32_t row ) { return orders.get<2>( row ) < 10.0 || row % 37 == 3; } ) );
+        REQUIRE( rows_of( odd | cheap ) ==
+                 expected( [&]( std::uint32_t row ) { return row % 2 == 1 || orders.get<2>( row ) < 10.0; } ) );
+
+        soa::bitmap bits;
+        bits.add( 7 );
+        bits.add( 9000 );
+        REQUIRE( rows_of( bits.to_selection( orders.size() ) & odd ) == std::vector<std::uint32_t>{7} );
+    }
+}
+
+TEST_CASE( "column expressions", "[expression]" )
+{
+    soa::vector<float, float, float, double> v;
+    for ( int i = 0; i < 1000; ++i )
+    {
+        v.push_back( float( i ), float( i % 7 ), 0.0f, double( i ) * 0.5 );
+    }
+
+    SECTION( "fused assignment" )
+    {
+        v.col<2>() = v.col<0>() * 2.0f + v.col<1>();
+        for ( std::size_t i = 0; i < v.size(); ++i )
+        {
+            REQUIRE( v.get<2>( i ) == v.get<0>( i ) * 2.0f + v.get<1>( i ) );
+        }
+
+        v.col<2>() = -( v.col<0>() - 1.0f ) / ( v.col<1>() + 1.0f ) - 3.0f * v.col<1>();
+        for ( std::size_t i = 0; i < v.size(); ++i )
+        {
+            REQUIRE( v.get<2>( i ) == -( v.get<0>( i ) - 1.0f ) / ( v.get<1>( i ) + 1.0f ) - 3.0f * v.get<1>( i ) );
+        }
+    }
+
+    SECTION( "mixed types and compound assignment" )
+    {
+        v.col<3>() = v.col<0>() * v.col<3>();
+        REQUIRE( v.get<3>( 10 ) == 50.0 );
+
+        v.col<2>() = v.col<1>();
+        v.col<2>() += v.col<0>();
+        v.col<2>() *= 2.0f;
+        REQUIRE( v.get<2>( 9 ) == ( 9.0f + 2.0f ) * 2.0f );
+
+        v.col<2>() = 1.5f;
+        REQUIRE( v.get<2>( 999 ) == 1.5f );
+    }
+
+    SECTION( "const columns are readable" )
+    {
+        const auto & cv = v;
+        v.col<2>() = cv.col<0>() + cv.col<1>();
+        REQUIRE( v.get<2>( 8 ) == 9.0f );
+    }
+}
+
+TEST_CASE( "columnar files", "[io]" )
+{
+    using table = soa::vector<std::int8_t,
+                              std::uint8_t,
+                              std::int16_t,
+                              std::uint16_t,
+                              std::int32_t,
+                              std::uint32_t,
+                              std::int64_t,
+                              std::uint64_t,
+                              float,
+                              double,
+                              bool,
+                              char>;
+    const std::string path = "soacpp_test_table.bin";
+
+    table v;
+    for ( int i = 0; i < 3000; ++i )
+    {
+        v.push_back( std::int8_t( -i ),
+                     std::uint8_t( i ),
+                     std::int16_t( -i * 7 ),
+                     std::uint16_t( i * 7 ),
+                     -i * 100003,
+                     std::uint32_t( i ) * 4000037u,
+                     -( std::int64_t( i ) << 40 ),
+                     std::uint64_t( i ) << 40,
+                     float( i ) * 0.25f,
+                     double( i ) / 3.0,
+                     i % 3 == 0,
+                     char( 'a' + i % 26 ) );
+    }
+    soa::save( v, path );
+
+    const auto same_table = [&]( const auto & other ) {
+        bool same = other.size() == v.size();
+        soa::detail::for_each_index<table::column_count>( [&]( auto column ) {
+            constexpr std::size_t I = decltype( column )::value;
+            same = same && std::equal( v.data<I>(), v.data<I>() + v.size(), other.template data<I>() );
+        } );
+        return same;
+    };
+
+    SECTION( "round trip every column type" )
+    {
+        const table loaded = soa::load<std::int8_t,
+                                       std::uint8_t,
+                                       std::int16_t,
+                                       std::uint16_t,
+                                       std::int32_t,
+                                       std::uint32_t,
+                                       std::int64_t,
+                                       std::uint64_t,
+                                       float,
+                                       double,
+                                       bool,
+                                       char>( path );
+        REQUIRE( same_table( loaded ) );
+    }
+
+    SECTION( "zero-copy mapping" )
+    {
+        const soa::mapped_table<std::int8_t,
+                                std::uint8_t,
+                                std::int16_t,
+                                std::uint16_t,
+                                std::int32_t,
+                                std::uint32_t,
+                                std::int64_t,
+                                std::uint64_t,
+                                float,
+                                double,
+                                bool,
+                                char>
+            mapped( path );
+        REQUIRE( same_table( mapped ) );
+        REQUIRE( reinterpret_cast<std::uintptr_t>( mapped.data<9>() ) % soa::file_alignment == 0 );
+        REQUIRE( soa::sum<8>( mapped ) == soa::sum<8>( v ) );
+        REQUIRE( mapped.column<11>()[ 27 ] == 'b' );
+        REQUIRE( same_table( mapped.to_vector() ) );
+    }
+
+    SECTION( "empty table" )
+    {
+        soa::save( soa::vector<double>(), path );
+        REQUIRE( soa::load<double>( path ).empty() );
+        REQUIRE( soa::mapped_table<double>( path ).empty() );
+    }
+
+    SECTION( "schema, version and endianness checks" )
+    {
+        REQUIRE_THROWS_AS( soa::load<std::int8_t>( path ), soa::io_error );
+        REQUIRE_THROWS_AS( soa::mapped_table<double>( path ), soa::io_error );
+
+        const auto patch = [&]( std::size_t offset, std::uint32_t value ) {
+            std::FILE * f = std::fopen( path.c_str(), "r+b" );
+            REQUIRE( f != nullptr );
+            std::fseek( f, long( offset ), SEEK_SET );
+            std::fwrite( &value, sizeof( value ), 1, f );
+            std::fclose( f );
+        };
+
+        patch( offsetof( soa::file_header, endianness ), 0x04030201 );
+        REQUIRE_THROWS_WITH( soa::mapped_table<double>( path ), Catch::Contains( "byte order" ) );
+
+        patch( offsetof( soa::file_header, endianness ), 0x01020304 );
+        patch( offsetof( soa::file_header, version ), 99 );
+        REQUIRE_THROWS_WITH( soa::load<double>( path ), Catch::Contains( "version" ) );
+
+        REQUIRE_THROWS_AS( soa::load<double>( "soacpp_test_missing.bin" ), std::system_error );
+    }
+
+    SECTION( "truncated and corrupt descriptors" )
+    {
+        using mapped = soa::mapped_table<std::int8_t,
+                                         std::uint8_t,
+                                         std::int16_t,
+                                         std::uint16_t,
+                                         std::int32_t,
+                                         std::uint32_t,
+                                         std::int64_t,
+                                         std::uint64_t,
+                                         float,
+                                         double,
+                                         bool,
+                                         char>;
+        const auto overwrite = [&]( std::size_t offset, std::uint64_t value ) {
+            std::FILE * f = std::fopen( path.c_str(), "r+b" );
+            REQUIRE( f != nullptr );
+            std::fseek( f, long( offset ), SEEK_SET );
+            std::fwrite( &value, sizeof( value ), 1, f );
+            std::fclose( f );
+        };
+        const std::size_t column_2 = sizeof( soa::file_header ) + 2 * sizeof( soa::column_descriptor );
+
+        overwrite( column_2 + offsetof( soa::column_descriptor, offset ), 3 * soa::file_alignment + 1 );
+        REQUIRE_THROWS_WITH( mapped( path ), Catch::Contains( "misaligned" ) );
+
+        // offset + bytes wraps around to a small value.
+        overwrite( column_2 + offsetof( soa::column_descriptor, offset ), ~std::uint64_t( 0 ) - 4095 );
+        REQUIRE_THROWS_WITH( mapped( path ), Catch::Contains( "misplaced" ) );
+
+        soa::save( soa::vector<double>( 10 ), path );
+        REQUIRE( ::truncate( path.c_str(), off_t( sizeof( soa::file_header ) + 8 ) ) == 0 );
+        REQUIRE_THROWS_WITH( soa::mapped_table<double>( path ), Catch::Contains( "truncated" ) );
+        REQUIRE_THROWS_AS( soa::load<double>( path ), soa::io_error );
+    }
+
+    std::remove( path.c_str() );
+}
+
+TEST_CASE( "arrow c data interface", "[arrow]" )
+{
+    static_assert( sizeof( ArrowSchema ) == 9 * sizeof( void * ), "ArrowSchema layout" );
+    static_assert( sizeof( ArrowArray ) == 10 * sizeof( void * ), "ArrowArray layout" );
+    static_assert( offsetof( ArrowArray, buffers ) == 5 * sizeof( std::int64_t ), "ArrowArray layout" );
+
+    soa::vector<std::int64_t, double, std::uint8_t, std::int32_t> v;
+    for ( int i = 0; i < 1000; ++i )
+    {
+        v.push_back( std::int64_t( i ) * 1000, double( i ) * 0.5, std::uint8_t( i % 2 ), -i );
+    }
+
+    SECTION( "export layout" )
+    {
+        ArrowArray array;
+        ArrowSchema schema;
+        soa::export_arrow( v, &array, &schema );
+
+        REQUIRE( std::string( schema.format ) == "+s" );
+        REQUIRE( schema.n_children == 4 );
+        REQUIRE( std::string( schema.children[ 0 ]->format ) == "l" );
+        REQUIRE( std::string( schema.children[ 1 ]->format ) == "g" );
+        REQUIRE( std::string( schema.children[ 2 ]->format ) == "C" );
+        REQUIRE( std::string( schema.children[ 3 ]->format ) == "i" );
+        REQUIRE( std::string( schema.children[ 3 ]->name ) == "3" );
+
+        REQUIRE( array.length == 1000 );
+        REQUIRE( array.null_count == 0 );
+        REQUIRE( array.n_buffers == 1 );
+        REQUIRE( array.buffers[ 0 ] == nullptr );
+        REQUIRE( array.n_children == 4 );
+        REQUIRE( array.children[ 1 ]->n_buffers == 2 );
+        REQUIRE( array.children[ 1 ]->buffers[ 0 ] == nullptr );
+        REQUIRE( array.children[ 1 ]->buffers[ 1 ] == v.data<1>() );
+
+        array.release( &array );
+        schema.release( &schema );
+        REQUIRE( array.release == nullptr );
+        REQUIRE( schema.release == nullptr );
+    }
+
+    SECTION( "named schema" )
+    {
+        ArrowSchema schema;
+        soa::export_arrow_schema<std::int64_t, double>( &schema, {"timestamp", "price"} );
+        REQUIRE( std::string( schema.children[ 1 ]->name ) == "price" );
+        schema.release( &schema );
+    }
+
+    SECTION( "zero-copy round trip" )
+    {
+        const double * prices = v.data<1>();
+        ArrowArray array;
+        ArrowSchema schema;
+        soa::export_arrow( std::move( v ), &array, &schema );
+
+        soa::arrow_table<std::int64_t, double, std::uint8_t, std::int32_t> imported( &array, schema );
+        REQUIRE( array.release == nullptr );
+        REQUIRE( imported.size() == 1000 );
+        REQUIRE( imported.data<1>() == prices );
+        REQUIRE( imported.get<0>( 999 ) == 999000 );
+        REQUIRE( imported.get<3>( 5 ) == -5 );
+        REQUIRE( soa::sum<3>( imported ) == -499500 );
+        REQUIRE( imported.to_vector().get<2>( 3 ) == 1 );
+
+        schema.release( &schema );
+    }
+
+    SECTION( "moved-out child outlives its parent" )
+    {
+        ArrowArray array;
+        soa::export_arrow( soa::vector<std::int32_t>( v.column<3>().size() ), &array );
+
+        ArrowArray child = *array.children[ 0 ];
+        array.children[ 0 ]->release = nullptr;
+        array.release( &array );
+
+        REQUIRE( static_cast<const std::int32_t *>( child.buffers[ 1 ] )[ 999 ] == 0 );
+        child.release( &child );
+    }
+
+    SECTION( "schema mismatch" )
+    {
+        ArrowArray array;
+        ArrowSchema schema;
+        soa::export_arrow( v, &array, &schema );
+
+        using wrong = soa::arrow_table<std::int64_t, float, std::uint8_t, std::int32_t>;
+        REQUIRE_THROWS_AS( wrong( &array, schema ), soa::arrow_error );
+        using short_table = soa::arrow_table<std::int64_t>;
+        REQUIRE_THROWS_AS( short_table( &array, schema ), soa::arrow_error );
+        REQUIRE( array.release != nullptr );
+
+        array.release( &array );
+        schema.release( &schema );
+    }
+}
+
+TEST_CASE( "chunked log", "[io]" )
+{
+    using batch_type = soa::vector<std::int64_t, double, std::uint32_t>;
+    const std::string path = "soacpp_test_log.bin";
+
+    std::vector<std::size_t> sizes = {100, 1, 4000, 0, 2500, 4000};
+    std::int64_t next = 0;
+    const auto make_batch = [&]( std::size_t size ) {
+        batch_type batch;
+        for ( std::size_t i = 0; i < size; ++i, ++next )
+        {
+            batch.push_back( next, double( next ) * 0.5, std::uint32_t( next % 17 ) );
+        }
+        return batch;
+    };
+
+    {
+        soa::log_writer<std::int64_t, double, std::uint32_t> writer( path );
+        for ( std::size_t i = 0; i < 4; ++i )
+        {
+            writer.write( make_batch( sizes[ i ] ) );
+        }
+        REQUIRE( writer.rows() == 4101 );
+    }
+    {
+        soa::log_writer<std::int64_t, double, std::uint32_t> writer( path, true );
+        writer.write( make_batch( sizes[ 4 ] ) );
+        writer.write( make_batch( sizes[ 5 ] ) );
+        writer.sync();
+    }
+
+    SECTION( "stream batches into a reused buffer" )
+    {
+        soa::log_reader<std::int64_t, double, std::uint32_t> reader( path );
+        batch_type batch;
+        std::vector<std::size_t> read_sizes;
+        std::int64_t expected = 0;
+        const double * buffer = nullptr;
+        bool reallocated_after_largest = false;
+        while ( reader.read( batch ) )
+        {
+            read_sizes.push_back( batch.size() );
+            for ( std::size_t i = 0; i < batch.size(); ++i, ++expected )
+            {
+                REQUIRE( batch.get<0>( i ) == expected );
+                REQUIRE( batch.get<1>( i ) == double( expected ) * 0.5 );
+                REQUIRE( batch.get<2>( i ) == std::uint32_t( expected % 17 ) );
+            }
+            if ( buffer != nullptr && batch.capacity() >= 4000 && batch.data<1>() != buffer )
+            {
+                reallocated_after_largest = true;
+            }
+            buffer = batch.capacity() >= 4000 ? batch.data<1>() : nullptr;
+        }
+        REQUIRE( read_sizes == std::vector<std::size_t>{100, 1, 4000, 2500, 4000} );
+        REQUIRE( reader.rows() == 10601 );
+        REQUIRE_FALSE( reallocated_after_largest );
+        REQUIRE( batch.empty() );
+    }
+
+    SECTION( "schema mismatch and truncation" )
+    {
+        REQUIRE_THROWS_AS( ( soa::log_reader<std::int64_t, float, std::uint32_t>( path ) ), soa::io_error );
+        REQUIRE_THROWS_AS( ( soa::log_writer<std::int64_t>( path, true ) ), soa::io_error );
+
+        REQUIRE( ::truncate( path.c_str(), 200 ) == 0 );
+        soa::log_reader<std::int64_t, double, std::uint32_t> reader( path );
+        batch_type batch;
+        REQUIRE_THROWS_AS( reader.read( batch ), soa::io_error );
+    }
+
+    SECTION( "crafted chunk headers" )
+    {
+        // Rewrite the last chunk, of 4000 raw rows, and check the reader rejects it before allocating.
+        const std::size_t chunk = std::size_t( std::ifstream( path, std::ios::binary | std::ios::ate ).tellg() ) -
+                                  sizeof( soa::chunk_header ) - 3 * sizeof( soa::chunk_column ) - 4000 * 20;
+        const auto expect_rejected = [&]( std::size_t offset, const void * value, std::size_t bytes ) {
+            std::vector<char> original( bytes );
+            std::FILE * f = std::fopen( path.c_str(), "r+b" );
+            REQUIRE( f != nullptr );
+            std::fseek( f, long( chunk + offset ), SEEK_SET );
+            REQUIRE( std::fread( original.data(), 1, bytes, f ) == bytes );
+            std::fseek( f, long( chunk + offset ), SEEK_SET );
+            std::fwrite( value, bytes, 1, f );
+            std::fflush( f );
+
+            soa::log_reader<std::int64_t, double, std::uint32_t> reader( path );
+            batch_type batch;
+            for ( int i = 0; i < 4; ++i )
+            {
+                REQUIRE( reader.read( batch ) );
+            }
+            REQUIRE_THROWS_AS( reader.read( batch ), soa::io_error );
+
+            std::fseek( f, long( chunk + offset ), SEEK_SET );
+            std::fwrite( original.data(), 1, bytes, f );
+            std::fclose( f );
+        };
+        const auto column = []( std::size_t i, std::size_t field ) {
+            return sizeof( soa::chunk_header ) + i * sizeof( soa::chunk_column ) + field;
+        };
+
+        // rows * sizeof( double ) wraps around to 8.
+        const std::uint64_t rows = ( std::uint64_t( 1 ) << 61 ) + 1;
+        expect_rejected( offsetof( soa::chunk_header, rows ), &rows, sizeof( rows ) );
+        const soa::chunk_column short_raw{soa::encoding::raw, 0, 8};
+        expect_rejected( column( 1, 0 ), &short_raw, sizeof( short_raw ) );
+        const std::uint32_t unknown = 77;
+        expect_rejected( column( 2, offsetof( soa::chunk_column, codec ) ), &unknown, sizeof( unknown ) );
+        const soa::chunk_column past_end{soa::encoding::run_length, 0, std::uint64_t( 1 ) << 62};
+        expect_rejected( column( 1, 0 ), &past_end, sizeof( past_end ) );
+        const soa::chunk_column just_past_end{soa::encoding::run_length, 0, 4000 * 8 + 4000 * 4 + 1};
+        expect_rejected( column( 1, 0 ), &just_past_end, sizeof( just_past_end ) );
+
+        soa::log_reader<std::int64_t, double, std::uint32_t> reader( path );
+        batch_type batch;
+        std::size_t chunks = 0;
+        while ( reader.read( batch ) )
+        {
+            ++chunks;
+        }
+        REQUIRE( chunks == 5 );
+    }
+
+    std::remove( path.c_str() );
+}
+
+TEST_CASE( "column codecs", "[codec]" )
+{
+    std::vector<unsigned char> encoded;
+    std::vector<unsigned char> scratch;
+
+    const auto round_trip = [&]( const auto & values, soa::encoding codec ) {
+        using T = typename std::decay<decltype( values )>::type::value_type;
+        soa::encode( codec, values.data(), values.size(), encoded );
+        std::vector<T> decoded( values.size() );
+        soa::decode( codec, encoded.data(), encoded.size(), decoded.data(), decoded.size() );
+        REQUIRE( std::equal( values.begin(), values.end(), decoded.begin(), []( const T & a, const T & b ) {
+            return std::memcmp( &a, &b, sizeof( T ) ) == 0;
+        } ) );
+        return encoded.size();
+    };
+
+    SECTION( "integer codecs round trip extreme values" )
+    {
+        const std::vector<std::int64_t> wide = {0,
+                                                -1,
+                                                std::numeric_limits<std::int64_t>::max(),
+                                                std::numeric_limits<std::int64_t>::min(),
+                                                42,
+                                                -42};
+        const std::vector<std::uint16_t> narrow = {65535, 0, 1, 65534, 7, 7, 7};
+        for ( const soa::encoding codec : {soa::encoding::raw,
+                                           soa::encoding::delta,
+                                           soa::encoding::delta_of_delta,
+                                           soa::encoding::run_length,
+                                           soa::encoding::frame_of_reference} )
+        {
+            round_trip( wide, codec );
+            round_trip( narrow, codec );
+            round_trip( std::vector<std::int32_t>(), codec );
+        }
+    }
+
+    SECTION( "each codec wins on the data it targets" )
+    {
+        std::vector<std::int64_t> counter, timestamps, states, ticks;
+        std::vector<double> series;
+        for ( std::int64_t i = 0; i < 10000; ++i )
+        {
+            counter.push_back( i * 3 + ( i % 7 ) * 11 );
+            timestamps.push_back( 1700000000000 + i * 250 );
+            states.push_back( i / 1000 );
+            ticks.push_back( 5000000 + std::int64_t( ( std::uint64_t( i ) * 0x9e3779b97f4a7c15u ) >> 54 ) );
+            series.push_back( 100.0 + double( i / 8 ) * 0.25 );
+        }
+
+        REQUIRE( soa::encode_best( counter.data(), counter.size(), encoded, scratch ) == soa::encoding::delta );
+        REQUIRE( soa::encode_best( timestamps.data(), timestamps.size(), encoded, scratch ) ==
+                 soa::encoding::delta_of_delta );
+        REQUIRE( soa::encode_best( states.data(), states.size(), encoded, scratch ) == soa::encoding::run_length );
+        REQUIRE( soa::encode_best( ticks.data(), ticks.size(), encoded, scratch ) ==
+                 soa::encoding::frame_of_reference );
+        REQUIRE( encoded.size() < ticks.size() * 2 );
+        REQUIRE( soa::encode_best( series.data(), series.size(), encoded, scratch ) == soa::encoding::xor_float );
+
+        REQUIRE( round_trip( timestamps, soa::encoding::delta_of_delta ) < timestamps.size() * 2 );
+        REQUIRE( round_trip( states, soa::encoding::run_length ) == 10 * ( sizeof( std::int64_t ) + 2 ) );
+        REQUIRE( round_trip( series, soa::encoding::xor_float ) < series.size() * sizeof( double ) / 4 );
+    }
+
+    SECTION( "xor float keeps every bit pattern" )
+    {
+        std::vector<float> values = {1.0f, 1.0f, -0.0f, 0.0f, std::numeric_limits<float>::infinity(), 3.5f};
+        values.push_back( std::numeric_limits<float>::quiet_NaN() );
+        values.push_back( std::numeric_limits<float>::denorm_min() );
+        values.push_back( std::numeric_limits<float>::max() );
+        round_trip( values, soa::encoding::xor_float );
+        round_trip( std::vector<double>{0.1, 0.2, 0.30000000000000004, -1e300, 1e-300}, soa::encoding::xor_float );
+    }
+
+    SECTION( "incompressible data stays raw" )
+    {
+        std::vector<double> noise;
+        std::uint64_t state = 1;
+        for ( std::size_t i = 0; i < 1000; ++i )
+        {
+            state = state * 6364136223846793005u + 1442695040888963407u;
+            double value;
+            std::memcpy( &value, &state, sizeof( value ) );
+            noise.push_back( value );
+        }
+        REQUIRE( soa::encode_best( noise.data(), noise.size(), encoded, scratch ) == soa::encoding::raw );
+        REQUIRE( encoded.size() == noise.size() * sizeof( double ) );
+    }
+
+    SECTION( "corrupt payloads are rejected" )
+    {
+        const std::vector<std::int32_t> values = {1, 2, 3, 4, 100};
+        std::vector<std::int32_t> decoded( values.size() );
+        soa::encode( soa::encoding::delta, values.data(), values.size(), encoded );
+        REQUIRE_THROWS_AS( soa::decode( soa::encoding::delta, encoded.data(), 2, decoded.data(), decoded.size() ),
+                           soa::codec_error );
+        REQUIRE_THROWS_AS( soa::decode( soa::encoding::xor_float,
+                                        encoded.data(),
+                                        encoded.size(),
+                                        decoded.data(),
+                                        decoded.size() ),
+                           soa::codec_error );
+    }
+
+    SECTION( "compressed log chunks decode into the batch" )
+    {
+        using batch_type = soa::vector<std::int64_t, double, std::uint8_t>;
+        const std::string path = "soacpp_test_compressed_log.bin";
+        batch_type batch;
+        for ( std::int64_t i = 0; i < 5000; ++i )
+        {
+            batch.push_back( 1700000000000 + i * 1000, 20.0 + double( i / 16 ) * 0.5, std::uint8_t( i / 500 ) );
+        }
+        {
+            soa::log_writer<std::int64_t, double, std::uint8_t> writer( path, false, soa::compression::automatic );
+            writer.write( batch );
+            writer.write( batch );
+        }
+        {
+            soa::log_writer<std::int64_t, double, std::uint8_t> writer( path, true );
+            writer.write( batch );
+        }
+
+        soa::log_reader<std::int64_t, double, std::uint8_t> reader( path );
+        batch_type read;
+        for ( int chunk = 0; chunk < 3; ++chunk )
+        {
+            REQUIRE( reader.read( read ) );
+            REQUIRE( read.size() == batch.size() );
+            REQUIRE( std::equal( batch.begin(), batch.end(), read.begin() ) );
+        }
+        REQUIRE_FALSE( reader.read( read ) );
+
+        // A pipe fed in small pieces returns short reads, which must not move where encoded columns decode from.
+        const std::string fifo = "soacpp_test_log.fifo";
+        std::remove( fifo.c_str() );
+        REQUIRE( ::mkfifo( fifo.c_str(), 0600 ) == 0 );
+        std::thread feeder( [&] {
+            std::FILE * in = std::fopen( path.c_str(), "rb" );
+            const int out = ::open( fifo.c_str(), O_WRONLY );
+            char piece[ 1000 ];
+            std::size_t bytes;
+            while ( ( bytes = std::fread( piece, 1, sizeof( piece ), in ) ) > 0 &&
+                    ::write( out, piece, bytes ) == ssize_t( bytes ) )
+            {
+                std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+            }
+            ::close( out );
+            std::fclose( in );
+        } );
+        {
+            soa::log_reader<std::int64_t, double, std::uint8_t> piped( fifo );
+            for ( int chunk = 0; chunk < 3; ++chunk )
+            {
+                REQUIRE( piped.read( read ) );
+                REQUIRE( std::equal( batch.begin(), batch.end(), read.begin() ) );
+            }
+            REQUIRE_FALSE( piped.read( read ) );
+        }
+        feeder.join();
+        std::remove( fifo.c_str() );
+
+        struct stat info;
+        REQUIRE( ::stat( path.c_str(), &info ) == 0 );
+        REQUIRE( std::size_t( info.st_size ) < batch.size() * 17 * 3 / 2 );
+        std::remove( path.c_str() );
+    }
+}
+
+TEST_CASE( "column loader", "[io]" )
+{
+    using table_type = soa::vector<std::int64_t, double, std::uint8_t, float, std::int32_t>;
+    const std::string path = "soacpp_test_loader.bin";
+    table_type table;
+    for ( std::int32_t i = 0; i < 100003; ++i )
+    {
+        table.push_back( std::int64_t( i ) * 3, double( i ) * 0.5, std::uint8_t( i ), float( i ) * 0.25f, -i );
+    }
+    soa::save( table, path );
+
+    std::vector<soa::loader_options> configurations( 4 );
+    configurations[ 1 ].io_uring = false;
+    configurations[ 2 ].direct = false;
+    configurations[ 3 ].queue_depth = 3;
+    configurations[ 3 ].request_bytes = 3 * soa::file_alignment;
+
+    for ( const soa::loader_options & options : configurations )
+    {
+        soa::column_loader<std::int64_t, double, std::uint8_t, float, std::int32_t> loader( path, options );
+        REQUIRE( loader.size() == table.size() );
+        REQUIRE( ( options.io_uring || !loader.uses_io_uring() ) );
+        REQUIRE( ( options.direct || !loader.uses_direct_io() ) );
+
+        std::vector<std::size_t> ready;
+        auto columns = loader.load<4, 0, 2>( [&]( std::size_t column ) { ready.push_back( column ); } );
+        std::sort( ready.begin(), ready.end() );
+        REQUIRE( ready == std::vector<std::size_t>{0, 1, 2} );
+        REQUIRE( columns.size() == table.size() );
+        REQUIRE( reinterpret_cast<std::uintptr_t>( columns.data<1>() ) % soa::file_alignment == 0 );
+        REQUIRE( std::equal( columns.data<0>(), columns.data<0>() + columns.size(), table.data<4>() ) );
+        REQUIRE( std::equal( columns.data<1>(), columns.data<1>() + columns.size(), table.data<0>() ) );
+        REQUIRE( std::equal( columns.data<2>(), columns.data<2>() + columns.size(), table.data<2>() ) );
+        REQUIRE( soa::sum<1>( columns ) == soa::sum<0>( table ) );
+
+        const auto single = loader.load<3>();
+        REQUIRE( single.get<0>( 100002 ) == 25000.5f );
+    }
+
+    SECTION( "empty tables and schema mismatch" )
+    {
+        soa::save( table_type(), path );
+        soa::column_loader<std::int64_t, double, std::uint8_t, float, std::int32_t> loader( path );
+        std::size_t ready = 0;
+        const auto columns = loader.load<1, 3>( [&]( std::size_t ) { ++ready; } );
+        REQUIRE( columns.empty() );
+        REQUIRE( ready == 2 );
+        REQUIRE_THROWS_AS( ( soa::column_loader<std::int64_t, float>( path ) ), soa::io_error );
+    }
+
+    SECTION( "direct reads fall back to buffered ones" )
+    {
+        const int direct = 10, buffered = 11;
+        char buffer[ 4 * soa::file_alignment ];
+        std::vector<soa::detail::column_read> reads = {
+            {0, 0, 3 * soa::file_alignment + 100, {buffer, sizeof( buffer )}},
+            {1, 0, 100, {buffer, soa::file_alignment}}};
+        std::vector<std::size_t> ready;
+        auto on_column = [&]( std::size_t column ) { ready.push_back( column ); };
+        soa::detail::read_tracker<decltype( on_column )> tracker( path, reads, 2, on_column, direct, buffered );
+
+        // An aligned short read continues with O_DIRECT, an unaligned one through the page cache.
+        REQUIRE( tracker.descriptor( 0 ) == direct );
+        REQUIRE( tracker.complete( 0, std::int64_t( soa::file_alignment ) ) );
+        REQUIRE( tracker.descriptor( 0 ) == direct );
+        REQUIRE( reads[ 0 ].offset == soa::file_alignment );
+        REQUIRE( tracker.complete( 0, 1000 ) );
+        REQUIRE( tracker.descriptor( 0 ) == buffered );
+        REQUIRE( reads[ 0 ].offset == soa::file_alignment + 1000 );
+        REQUIRE_FALSE( tracker.complete( 0, std::int64_t( reads[ 0 ].needed ) ) );
+
+        // EINVAL on a direct read retries it buffered, and so does every later read.
+        REQUIRE( tracker.descriptor( 1 ) == direct );
+        REQUIRE( tracker.complete( 1, -EINVAL ) );
+        REQUIRE( tracker.descriptor( 1 ) == buffered );
+        REQUIRE_THROWS_AS( tracker.complete( 1, -EINVAL ), std::system_error );
+        REQUIRE( ready == std::vector<std::size_t>{0} );
+    }
+
+    std::remove( path.c_str() );
+}
+
+TEST_CASE( "csv ingest", "[csv]" )
+{
+    SECTION( "vector classification matches the scalar one" )
+    {
+        std::string block( 64, 'x' );
+        std::uint64_t state = 7;
+        for ( int round = 0; round < 100; ++round )
+        {
+            for ( char & c : block )
+            {
+                state = state * 6364136223846793005u + 1442695040888963407u;
+                const char alphabet[] = {'"', ';', '\n', '1', ' ', '\r'};
+                c = alphabet[ ( state >> 33 ) % sizeof( alphabet ) ];
+            }
+            const auto simd = soa::detail::classify( block.data(), ';' );
+            const auto scalar = soa::detail::classify_scalar( block.data(), ';' );
+            REQUIRE( simd.quotes == scalar.quotes );
+            REQUIRE( simd.delimiters == scalar.delimiters );
+            REQUIRE( simd.newlines == scalar.newlines );
+        }
+    }
+
+    SECTION( "fields parse into typed columns" )
+    {
+        const std::string text = "\"id\",\"price, usd\",\"flag\",\"multi\nline\"\r\n"
+                                 "1,2.5,true,-7\r\n"
+                                 "\n"
+                                 "\"2\",1e-3,0,-128\n"
+                                 "18446744073709551615,-0.1,false,127";
+        const auto table = soa::parse_csv<std::uint64_t, double, bool, std::int8_t>( text.data(), text.size() );
+        REQUIRE( table.size() == 3 );
+        REQUIRE( table.get<0>( 1 ) == 2 );
+        REQUIRE( table.get<0>( 2 ) == std::numeric_limits<std::uint64_t>::max() );
+        REQUIRE( table.get<1>( 0 ) == 2.5 );
+        REQUIRE( table.get<1>( 1 ) == 1e-3 );
+        REQUIRE( table.get<1>( 2 ) == -0.1 );
+        REQUIRE( table.get<2>( 0 ) );
+        REQUIRE_FALSE( table.get<2>( 2 ) );
+        REQUIRE( table.get<3>( 1 ) == -128 );
+
+        soa::csv_options options;
+        options.header = false;
+        options.delimiter = '\t';
+        const std::string tabs = "1\t2\n3\t4\n";
+        const auto pairs = soa::parse_csv<int, float>( tabs.data(), tabs.size(), options );
+        REQUIRE( pairs.size() == 2 );
+        REQUIRE( pairs.get<1>( 1 ) == 4.0f );
+    }
+
+    SECTION( "floating point values round trip exactly" )
+    {
+        std::string text = "x\n";
+        std::vector<double> values;
+        std::uint64_t state = 3;
+        for ( int i = 0; i < 10000; ++i )
+        {
+            state = state * 6364136223846793005u + 1442695040888963407u;
+            double value;
+            const std::uint64_t exponent = 1023u + ( state >> 52 ) % 64 - 32;
+            const std::uint64_t bits = ( state & 0x800fffffffffffffu ) | ( exponent << 52 );
+            std::memcpy( &value, &bits, sizeof( value ) );
+            values.push_back( i % 2 == 0 ? value : double( i ) / 100 );
+            char buffer[ 32 ];
+            std::snprintf( buffer, sizeof( buffer ), i % 2 == 0 ? "%.17g\n" : "%.2f\n", values.back() );
+            text += buffer;
+        }
+        const auto table = soa::parse_csv<double>( text.data(), text.size() );
+        REQUIRE( std::equal( values.begin(), values.end(), table.data<0>() ) );
+    }
+
+    SECTION( "malformed input is reported with its offset" )
+    {
+        const auto parse = []( const std::string & text ) {
+            return soa::parse_csv<int, int>( text.data(), text.size() );
+        };
+        REQUIRE_THROWS_WITH( parse( "a,b\n1,2\n3\n" ), "csv byte 9: expected 2 fields" );
+        REQUIRE_THROWS_WITH( parse( "a,b\n1,x2\n" ), "csv byte 6: cannot parse 'x2' in column 1" );
+        REQUIRE_THROWS_AS( parse( "a,b\n1,2,3\n" ), soa::csv_error );
+        REQUIRE_THROWS_AS( parse( "a,b\n1,\n" ), soa::csv_error );
+        REQUIRE_THROWS_AS( parse( "a,b\n1,99999999999\n" ), soa::csv_error );
+        REQUIRE_THROWS_AS( parse( "a,b\n\"1,2\n" ), soa::csv_error );
+    }
+
+    SECTION( "parallel parsing splits at line boundaries outside quotes" )
+    {
+        const std::string path = "soacpp_test_ingest.csv";
+        std::string text = "\"ts\",\"value\nwith newline\",\"qty\"\n";
+        for ( std::int64_t i = 0; text.size() < ( std::size_t( 13 ) << 20 ); ++i )
+        {
+            text += std::to_string( 1700000000000 + i ) + ",\"" + std::to_string( double( i ) * 0.25 ) + "\"," +
+                    std::to_string( i % 1000 ) + "\n";
+        }
+        {
+            std::FILE * out = std::fopen( path.c_str(), "wb" );
+            REQUIRE( out != nullptr );
+            REQUIRE( std::fwrite( text.data(), 1, text.size(), out ) == text.size() );
+            std::fclose( out );
+        }
+
+        soa::csv_options options;
+        const auto serial = soa::read_csv<std::int64_t, double, std::int32_t>( path, options );
+        options.threads = 4;
+        const auto parallel = soa::read_csv<std::int64_t, double, std::int32_t>( path, options );
+        REQUIRE( serial.size() > 300000 );
+        REQUIRE( parallel.size() == serial.size() );
+        REQUIRE( std::equal( serial.begin(), serial.end(), parallel.begin() ) );
+        REQUIRE( serial.get<2>( serial.size() - 1 ) == std::int32_t( ( serial.size() - 1 ) % 1000 ) );
+        std::remove( path.c_str() );
+    }
+}
+
+namespace
+{
+    struct point3
+    {
+        float x, y, z;
+    };
+
+    struct lanes8
+    {
+        std::int32_t a, b, c, d, e, f, g, h;
+    };
+
+    struct quad
+    {
+        float a, b, c, d;
+    };
+
+    struct mixed
+    {
+        std::uint8_t tag;
+        double value;
+        std::int32_t count;
+    };
+}
+
+TEST_CASE( "aos transposition", "[aos]" )
+{
+    SECTION( "three floats" )
+    {
+        std::vector<point3> points;
+        for ( int i = 0; i < 103; ++i )
+        {
+            points.push_back( {float( i ), float( i ) + 0.5f, -float( i )} );
+        }
+        const auto columns = soa::from_aos( points, &point3::x, &point3::y, &point3::z );
+        REQUIRE( columns.size() == points.size() );
+        for ( std::size_t i = 0; i < points.size(); ++i )
+        {
+            REQUIRE( columns[ i ] == std::make_tuple( points[ i ].x, points[ i ].y, points[ i ].z ) );
+        }
+
+        std::vector<point3> back( points.size() );
+        soa::to_aos( columns, back, &point3::x, &point3::y, &point3::z );
+        REQUIRE( std::memcmp( back.data(), points.data(), points.size() * sizeof( point3 ) ) == 0 );
+
+        soa::vector<float, float> swapped( 1000 );
+        soa::from_aos( points, swapped, &point3::z, &point3::x );
+        REQUIRE( swapped.size() == points.size() );
+        REQUIRE( swapped.get<0>( 7 ) == -7.0f );
+        REQUIRE( swapped.get<1>( 7 ) == 7.0f );
+    }
+
+    SECTION( "four and eight lanes" )
+    {
+        std::vector<quad> quads;
+        for ( int i = 0; i < 21; ++i )
+        {
+            quads.push_back( {float( i ), float( i ) * 2, float( i ) * 3, float( i ) * 4} );
+        }
+        const auto four = soa::from_aos( quads, &quad::a, &quad::b, &quad::c, &quad::d );
+        REQUIRE( four.get<3>( 20 ) == 80.0f );
+        REQUIRE( four.get<1>( 19 ) == 38.0f );
+        std::vector<quad> quads_back( quads.size() );
+        soa::to_aos( four, quads_back, &quad::a, &quad::b, &quad::c, &quad::d );
+        REQUIRE( std::memcmp( quads_back.data(), quads.data(), quads.size() * sizeof( quad ) ) == 0 );
+
+        std::vector<lanes8> rows;
+        for ( std::int32_t i = 0; i < 37; ++i )
+        {
+            rows.push_back( {i * 8, i * 8 + 1, i * 8 + 2, i * 8 + 3, i * 8 + 4, i * 8 + 5, i * 8 + 6, i * 8 + 7} );
+        }
+        const auto eight = soa::from_aos(
+            rows, &lanes8::a, &lanes8::b, &lanes8::c, &lanes8::d, &lanes8::e, &lanes8::f, &lanes8::g, &lanes8::h );
+        for ( std::int32_t i = 0; i < 37; ++i )
+        {
+            REQUIRE( eight.get<0>( std::size_t( i ) ) == i * 8 );
+            REQUIRE( eight.get<5>( std::size_t( i ) ) == i * 8 + 5 );
+            REQUIRE( eight.get<7>( std::size_t( i ) ) == i * 8 + 7 );
+        }
+        std::vector<lanes8> rows_back( rows.size() );
+        soa::to_aos( eight,
+                     rows_back,
+                     &lanes8::a,
+                     &lanes8::b,
+                     &lanes8::c,
+                     &lanes8::d,
+                     &lanes8::e,
+                     &lanes8::f,
+                     &lanes8::g,
+                     &lanes8::h );
+        REQUIRE( std::memcmp( rows_back.data(), rows.data(), rows.size() * sizeof( lanes8 ) ) == 0 );
+    }
+
+    SECTION( "padded structs take the strided path" )
+    {
+        std::vector<mixed> rows;
+        for ( int i = 0; i < 10; ++i )
+        {
+            rows.push_back( {std::uint8_t( i ), double( i ) / 4, -i} );
+        }
+        const auto columns = soa::from_aos( rows, &mixed::count, &mixed::tag, &mixed::value );
+        REQUIRE( columns.get<0>( 9 ) == -9 );
+        REQUIRE( columns.get<1>( 9 ) == 9 );
+        REQUIRE( columns.get<2>( 9 ) == 2.25 );
+
+        std::vector<mixed> back( rows.size(), mixed{0, 0.0, 0} );
+        soa::to_aos( columns, back, &mixed::count, &mixed::tag, &mixed::value );
+        for ( std::size_t i = 0; i < rows.size(); ++i )
+        {
+            REQUIRE( back[ i ].tag == rows[ i ].tag );
+            REQUIRE( back[ i ].value == rows[ i ].value );
+            REQUIRE( back[ i ].count == rows[ i ].count );
+        }
+    }
+}
+
+TEST_CASE( "gather and scatter", "[gather]" )
+{
+    using table_type = soa::vector<std::int32_t, double, std::uint8_t, float>;
+    table_type table;
+    for ( std::int32_t i = 0; i < 10000; ++i )
+    {
+        table.push_back( i, double( i ) * 1.5, std::uint8_t( i % 251 ), float( -i ) );
+    }
+    std::vector<std::uint32_t> indices;
+    std::uint64_t state = 11;
+    for ( std::size_t i = 0; i < 5003; ++i )
+    {
+        state = state * 6364136223846793005u + 1442695040888963407u;
+        indices.push_back( std::uint32_t( ( state >> 33 ) % table.size() ) );
+    }
+
+    SECTION( "gather every column" )
+    {
+        table_type gathered( 3 );
+        soa::gather( table, indices, gathered );
+        REQUIRE( gathered.size() == indices.size() );
+        for ( std::size_t i = 0; i < indices.size(); ++i )
+        {
+            REQUIRE( gathered[ i ] == table[ indices[ i ] ] );
+        }
+    }
+
+    SECTION( "gather selected columns" )
+    {
+        soa::vector<float, std::int32_t> gathered;
+        soa::gather<3, 0>( table, indices, gathered );
+        for ( std::size_t i = 0; i < indices.size(); ++i )
+        {
+            REQUIRE( gathered.get<0>( i ) == -float( indices[ i ] ) );
+            REQUIRE( gathered.get<1>( i ) == std::int32_t( indices[ i ] ) );
+        }
+        REQUIRE( soa::take<3, 0>( table, indices ).get<1>( 42 ) == gathered.get<1>( 42 ) );
+    }
+
+    SECTION( "scatter inverts a permutation gather" )
+    {
+        std::vector<std::uint32_t> permutation( table.size() );
+        for ( std::uint32_t i = 0; i < permutation.size(); ++i )
+        {
+            permutation[ i ] = ( i * 7919 ) % std::uint32_t( table.size() );
+        }
+        table_type shuffled;
+        soa::gather( table, permutation, shuffled );
+        table_type restored( table.size() );
+        soa::scatter( shuffled, permutation, restored );
+        REQUIRE( std::equal( table.begin(), table.end(), restored.begin() ) );
+
+        soa::vector<double> doubled( permutation.size() );
+        for ( std::size_t i = 0; i < doubled.size(); ++i )
+        {
+            doubled.get<0>( i ) = shuffled.get<1>( i ) * 2;
+        }
+        soa::scatter<1>( doubled, permutation, restored );
+        REQUIRE( restored.get<1>( 100 ) == 300.0 );
+        REQUIRE( restored.get<0>( 100 ) == 100 );
+    }
+}
+
+TEST_CASE( "static vector", "[static_vector]" )
+{
+    using fills_type = soa::static_vector<64, std::uint8_t, double, std::uint32_t>;
+    static_assert( std::is_trivially_copyable<fills_type>::value, "inline tables copy bytewise" );
+    static_assert( sizeof( fills_type ) <= sizeof( std::size_t ) + 64 * ( 1 + 8 + 4 ) + 8, "no hidden storage" );
+
+    fills_type fills;
+    REQUIRE( fills.empty() );
+    REQUIRE( fills_type::capacity() == 64 );
+    for ( std::uint32_t i = 0; i < 64; ++i )
+    {
+        fills.push_back( std::uint8_t( i % 3 ), double( i ) * 0.5, 100 - i );
+    }
+    REQUIRE( fills.full() );
+    REQUIRE( reinterpret_cast<std::uintptr_t>( fills.data<1>() ) % alignof( double ) == 0 );
+    REQUIRE( reinterpret_cast<const unsigned char *>( fills.data<2>() ) >=
+             reinterpret_cast<const unsigned char *>( fills.data<1>() + 64 ) );
+
+    SECTION( "rows, columns and algorithms" )
+    {
+        REQUIRE( fills[ 10 ] == std::make_tuple( std::uint8_t( 1 ), 5.0, std::uint32_t( 90 ) ) );
+        std::get<1>( fills[ 10 ] ) = -1.0;
+        REQUIRE( fills.get<1>( 10 ) == -1.0 );
+        REQUIRE( fills.column<2>().size() == 64 );
+        REQUIRE( soa::sum<2>( fills ) == 64 * 100 - 63 * 64 / 2 );
+
+        std::size_t rows = 0;
+        for ( const auto & row : fills )
+        {
+            rows += std::get<0>( row ) == 2;
+        }
+        REQUIRE( rows == 21 );
+
+        auto found = std::find_if( fills.begin(), fills.end(), []( const fills_type::value_type & row ) {
+            return std::get<2>( row ) == 37;
+        } );
+        REQUIRE( found - fills.begin() == 63 );
+        REQUIRE( std::get<1>( *found ) == 31.5 );
+    }
+
+    SECTION( "copies are independent and embeddable" )
+    {
+        struct connection
+        {
+            int fd;
+            soa::static_vector<8, std::uint64_t, float> pending;
+        };
+        connection a{3, {}};
+        a.pending.push_back( 1, 2.0f );
+        connection b = a;
+        b.pending.get<1>( 0 ) = 5.0f;
+        b.pending.push_back( 2, 3.0f );
+        REQUIRE( a.pending.size() == 1 );
+        REQUIRE( a.pending.get<1>( 0 ) == 2.0f );
+        REQUIRE( b.pending.size() == 2 );
+
+        fills_type copy = fills;
+        copy.resize( 2 );
+        copy.pop_back();
+        REQUIRE( copy.size() == 1 );
+        REQUIRE( fills.size() == 64 );
+        copy.resize( 3 );
+        REQUIRE( copy.get<1>( 2 ) == 0.0 );
+    }
+}
+
+TEST_CASE( "small vector", "[small_vector]" )
+{
+    using batch_type = soa::small_vector<4, std::uint16_t, double>;
+
+    batch_type batch;
+    REQUIRE( batch.is_inline() );
+    REQUIRE( batch.capacity() == 4 );
+    for ( std::uint16_t i = 0; i < 4; ++i )
+    {
+        batch.push_back( i, i * 1.5 );
+    }
+    REQUIRE( batch.is_inline() );
+    REQUIRE( reinterpret_cast<std::uintptr_t>( batch.data<1>() ) % alignof( double ) == 0 );
+
+    SECTION( "spills to the heap and back" )
+    {
+        for ( std::uint16_t i = 4; i < 100; ++i )
+        {
+            batch.push_back( std::make_tuple( i, i * 1.5 ) );
+        }
+        REQUIRE_FALSE( batch.is_inline() );
+        REQUIRE( reinterpret_cast<std::uintptr_t>( batch.data<1>() ) % soa::detail::column_alignment == 0 );
+        REQUIRE( batch.size() == 100 );
+        REQUIRE( soa::sum<1>( batch ) == 1.5 * 99 * 100 / 2 );
+
+        batch.resize( 3 );
+        batch.shrink_to_fit();
+        REQUIRE( batch.is_inline() );
+        REQUIRE( batch[ 2 ] == std::make_tuple( std::uint16_t( 2 ), 3.0 ) );
+
+        batch.reserve( 5 );
+        REQUIRE_FALSE( batch.is_inline() );
+        batch.clear();
+        REQUIRE_FALSE( batch.is_inline() );
+    }
+
+    SECTION( "copies and moves, inline and spilled" )
+    {
+        batch_type large( 50 );
+        large.get<0>( 49 ) = 7;
+
+        batch_type copy = batch;
+        batch_type moved = std::move( copy );
+        REQUIRE( copy.empty() );
+        REQUIRE( moved.is_inline() );
+        REQUIRE( moved.get<1>( 3 ) == 4.5 );
+
+        const std::uint16_t * spilled = large.data<0>();
+        batch_type stolen = std::move( large );
+        REQUIRE( stolen.data<0>() == spilled );
+        REQUIRE( large.empty() );
+        REQUIRE( large.is_inline() );
+
+        moved = stolen;
+        REQUIRE( moved.size() == 50 );
+        REQUIRE( moved.get<0>( 49 ) == 7 );
+        REQUIRE( moved.data<0>() != spilled );
+
+        stolen = std::move( batch );
+        REQUIRE( stolen.is_inline() );
+        REQUIRE( stolen.size() == 4 );
+
+        stolen.append( moved );
+        REQUIRE( stolen.size() == 54 );
+        REQUIRE( stolen.get<0>( 53 ) == 7 );
+        REQUIRE( std::get<1>( *std::next( stolen.begin(), 3 ) ) == 4.5 );
+    }
+
+    SECTION( "push_back of its own row while spilling" )
+    {
+        batch.push_back( batch.get<0>( 2 ), batch.get<1>( 3 ) );
+        REQUIRE_FALSE( batch.is_inline() );
+        REQUIRE( batch[ 4 ] == std::make_tuple( std::uint16_t( 2 ), 4.5 ) );
+
+        while ( batch.size() < batch.capacity() )
+        {
+            batch.push_back( 0, 0.0 );
+        }
+        batch.push_back( batch.get<0>( 1 ), batch.get<1>( 4 ) );
+        REQUIRE( batch.get<0>( batch.size() - 1 ) == 1 );
+        REQUIRE( batch.get<1>( batch.size() - 1 ) == 4.5 );
+    }
+}
+
+TEST_CASE( "ring", "[ring]" )
+{
+    soa::ring<double, std::uint32_t> window( 6 );
+    REQUIRE( window.capacity() == 8 );
+    REQUIRE( window.empty() );
+    REQUIRE( window.segments<0>().size() == 0 );
+
+    for ( std::uint32_t i = 0; i < 20; ++i )
+    {
+        window.push_back_overwrite( i * 0.5, i );
+    }
+    REQUIRE( window.full() );
+    REQUIRE( window.front() == std::make_tuple( 6.0, std::uint32_t( 12 ) ) );
+    REQUIRE( window.get<1>( 7 ) == 19 );
+
+    // Rows 12..19 wrapped around the end of the allocation.
+    const auto volumes = window.segments<1>();
+    REQUIRE( volumes.first.size() == 4 );
+    REQUIRE( volumes.second.size() == 4 );
+    REQUIRE( volumes.first[ 0 ] == 12 );
+    REQUIRE( volumes.second[ 3 ] == 19 );
+
+    SECTION( "both ends" )
+    {
+        window.pop_front( 3 );
+        window.pop_back();
+        window.push_front( -1.0, 100 );
+        REQUIRE( window.size() == 5 );
+        std::vector<std::uint32_t> seen;
+        for ( const auto & row : window )
+        {
+            seen.push_back( std::get<1>( row ) );
+        }
+        REQUIRE( seen == std::vector<std::uint32_t>{100, 15, 16, 17, 18} );
+        std::get<0>( window.back() ) = 42.0;
+        REQUIRE( window.get<0>( 4 ) == 42.0 );
+
+        while ( !window.empty() )
+        {
+            window.pop_back();
+        }
+        window.push_front( 1.0, 1 );
+        window.push_back( 2.0, 2 );
+        REQUIRE( window[ 0 ] == std::make_tuple( 1.0, std::uint32_t( 1 ) ) );
+        REQUIRE( window[ 1 ] == std::make_tuple( 2.0, std::uint32_t( 2 ) ) );
+    }
+
+    SECTION( "copies keep the window" )
+    {
+        const soa::ring<double, std::uint32_t> copy = window;
+        window.clear();
+        const auto prices = copy.segments<0>();
+        double total = 0.0;
+        for ( const double price : prices.first )
+        {
+            total += price;
+        }
+        for ( const double price : prices.second )
+        {
+            total += price;
+        }
+        REQUIRE( total == 0.5 * ( 12 + 13 + 14 + 15 + 16 + 17 + 18 + 19 ) );
+
+        soa::ring<double, std::uint32_t> moved = std::move( window );
+        REQUIRE( moved.empty() );
+        REQUIRE( moved.capacity() == 8 );
+
+        const soa::ring<double, std::uint32_t> unallocated;
+        const soa::ring<double, std::uint32_t> unallocated_copy = unallocated;
+        REQUIRE( unallocated_copy.capacity() == 0 );
+        REQUIRE( copy.capacity() == 8 );
+    }
+}
+
+TEST_CASE( "spsc queue", "[spsc_queue]" )
+{
+    SECTION( "batches wrap around the slots" )
+    {
+        soa::spsc_queue<std::uint32_t, double> queue( 5 );
+        REQUIRE( queue.capacity() == 8 );
+
+        soa::vector<std::uint32_t, double> rows;
+        for ( std::uint32_t i = 0; i < 12; ++i )
+        {
+            rows.push_back( i, i * 0.5 );
+        }
+        REQUIRE( queue.push( rows ) == 8 );
+        REQUIRE( queue.push( rows, 8 ) == 0 );
+        REQUIRE_FALSE( queue.try_push( 99, 0.0 ) );
+
+        soa::vector<std::uint32_t, double> out;
+        REQUIRE( queue.pop( out, 6 ) == 6 );
+        REQUIRE( queue.push( rows, 8 ) == 4 );
+        REQUIRE( queue.size() == 6 );
+
+        std::uint32_t id = 0;
+        double price = 0.0;
+        REQUIRE( queue.try_pop( id, price ) );
+        REQUIRE( id == 6 );
+        REQUIRE( queue.pop( out, 100 ) == 5 );
+        REQUIRE( queue.pop( out, 100 ) == 0 );
+        REQUIRE_FALSE( queue.try_pop( id, price ) );
+
+        REQUIRE( out.size() == 11 );
+        REQUIRE( out.get<0>( 5 ) == 5 );
+        REQUIRE( out.get<0>( 6 ) == 7 );
+        REQUIRE( out.get<1>( 10 ) == 5.5 );
+    }
+
+    SECTION( "one producer and one consumer thread" )
+    {
+        constexpr std::uint64_t rows = 200000;
+        soa::spsc_queue<std::uint64_t, std::uint32_t> queue( 256 );
+
+        std::thread producer( [&]() {
+            std::vector<std::uint64_t> ids( 100 );
+            std::vector<std::uint32_t> checks( 100 );
+            std::uint64_t next = 0;
+            while ( next < rows )
+            {
+                const std::size_t batch = std::min<std::size_t>( 1 + next % 97, rows - next );
+                for ( std::size_t i = 0; i < batch; ++i )
+                {
+                    ids[ i ] = next + i;
+                    checks[ i ] = std::uint32_t( ( next + i ) * 2654435761u );
+                }
+                std::size_t pushed = 0;
+                while ( pushed < batch )
+                {
+                    const std::size_t count = queue.push( batch - pushed, ids.data() + pushed, checks.data() + pushed );
+                    if ( count == 0 )
+                    {
+                        std::this_thread::yield();
+                    }
+                    pushed += count;
+                }
+                next += batch;
+            }
+        } );
+
+        std::uint64_t expected = 0;
+        bool in_order = true;
+        std::uint64_t ids[ 64 ];
+        std::uint32_t checks[ 64 ];
+        while ( expected < rows )
+        {
+            const std::size_t count = queue.pop( 1 + expected % 64, ids, checks );
+            if ( count == 0 )
+            {
+                std::this_thread::yield();
+            }
+            for ( std::size_t i = 0; i < count; ++i, ++expected )
+            {
+                in_order = in_order && ids[ i ] == expected &&
+                           checks[ i ] == std::uint32_t( expected * 2654435761u );
+            }
+        }
+        producer.join();
+
+        REQUIRE( in_order );
+        REQUIRE( queue.size() == 0 );
+    }
+
+    SECTION( "a failed column allocation frees the columns before it" )
+    {
+        // Too large for 2^24 rows to fit in the address space; the char column before it is allocated first and
+        // must not leak.
+        struct huge_row
+        {
+            unsigned char bytes[ std::size_t( 1 ) << 40 ];
+        };
+        using queue_type = soa::spsc_queue<char, huge_row>;
+        REQUIRE_THROWS_AS( queue_type( std::size_t( 1 ) << 24 ), std::length_error );
+    }
+}
+
+TEST_CASE( "concurrent appender", "[concurrent_appender]" )
+{
+    SECTION( "a failed segment allocation frees the columns before it" )
+    {
+        struct huge_row
+        {
+            unsigned char bytes[ std::size_t( 1 ) << 40 ];
+        };
+        soa::concurrent_appender<char, huge_row> table( std::size_t( 1 ) << 24 );
+        REQUIRE_THROWS_AS( table.reserve( 1 ), std::length_error );
+        REQUIRE( table.empty() );
+    }
+
+    SECTION( "segments grow without moving rows" )
+    {
+        soa::concurrent_appender<std::uint32_t, float> table( 3 );
+        REQUIRE( table.empty() );
+
+        soa::vector<std::uint32_t, float> rows;
+        for ( std::uint32_t i = 0; i < 10; ++i )
+        {
+            rows.push_back( i, float( i ) * 0.5f );
+        }
+        REQUIRE( table.append( rows ) == 0 );
+        const std::uint32_t * first_row = &table.get<0>( 0 );
+
+        const std::size_t first = table.reserve( 30 );
+        REQUIRE( first == 10 );
+        REQUIRE( table.reserved() == 40 );
+        REQUIRE( table.size() == 10 );
+        for ( std::uint32_t i = 0; i < 30; ++i )
+        {
+            table.write_row( first + i, 10 + i, float( 10 + i ) * 0.5f );
+        }
+        table.publish( first, 30 );
+
+        REQUIRE( table.size() == 40 );
+        REQUIRE( &table.get<0>( 0 ) == first_row );
+        REQUIRE( table[ 39 ] == std::make_tuple( std::uint32_t( 39 ), 19.5f ) );
+
+        // Segments of 4, 8, 16 and 32 rows.
+        std::vector<std::size_t> spans;
+        float total = 0.0f;
+        table.for_each_span<1>( [&]( soa::span<const float> prices ) {
+            spans.push_back( prices.size() );
+            for ( const float price : prices )
+            {
+                total += price;
+            }
+        } );
+        REQUIRE( spans == std::vector<std::size_t>{4, 8, 16, 12} );
+        REQUIRE( total == 0.5f * 39 * 40 / 2 );
+
+        const auto copy = table.to_vector();
+        REQUIRE( copy.size() == 40 );
+        REQUIRE( std::equal( copy.begin(), copy.end(), table.begin() ) );
+    }
+
+    SECTION( "writers append while a reader scans the published prefix" )
+    {
+        constexpr std::uint32_t writers = 4;
+        constexpr std::uint32_t batches = 200;
+        soa::concurrent_appender<std::uint32_t, std::uint32_t> table( 16 );
+
+        std::atomic<std::uint32_t> finished{0};
+        std::vector<std::thread> threads;
+        for ( std::uint32_t w = 0; w < writers; ++w )
+        {
+            threads.emplace_back( [&table, &finished, w]() {
+                soa::vector<std::uint32_t, std::uint32_t> batch;
+                for ( std::uint32_t b = 0; b < batches; ++b )
+                {
+                    batch.clear();
+                    for ( std::uint32_t i = 0; i < 1 + ( b * 7 + w ) % 50; ++i )
+                    {
+                        batch.push_back( w, b * 1000 + i );
+                    }
+                    table.append( batch );
+                }
+                ++finished;
+            } );
+        }
+
+        bool consistent = true;
+        std::size_t seen = 0;
+        while ( finished < writers || seen < table.size() )
+        {
+            const std::size_t size = table.size();
+            for ( std::size_t row = seen; row < size; ++row )
+            {
+                consistent = consistent && table.get<0>( row ) < writers && table.get<1>( row ) % 1000 < 50;
+            }
+            seen = size;
+            std::this_thread::yield();
+        }
+        for ( std::thread & t : threads )
+        {
+            t.join();
+        }
+        REQUIRE( consistent );
+
+        // Rows of one writer appear in order, and none is lost.
+        std::vector<std::uint32_t> last( writers, 0 );
+        bool ordered = true;
+        std::size_t rows = 0;
+        for ( const auto & row : table )
+        {
+            const std::uint32_t w = std::get<0>( row );
+            ordered = ordered && std::get<1>( row ) >= last[ w ];
+            last[ w ] = std::get<1>( row );
+            ++rows;
+        }
+        REQUIRE( ordered );
+        std::size_t expected = 0;
+        for ( std::uint32_t w = 0; w < writers; ++w )
+        {
+            for ( std::uint32_t b = 0; b < batches; ++b )
+            {
+                expected += 1 + ( b * 7 + w ) % 50;
+            }
+        }
+        REQUIRE( rows == expected );
+        REQUIRE( table.size() == expected );
+    }
+}
+
+TEST_CASE( "copy-on-write snapshots", "[snapshot]" )
+{
+    soa::vector<std::uint32_t, double, float> rows;
+    for ( std::uint32_t i = 0; i < 100; ++i )
+    {
+        rows.push_back( i, i * 0.5, float( i ) );
+    }
+    soa::versioned_vector<std::uint32_t, double, float> table( rows );
+    REQUIRE_FALSE( table.shared<0>() );
+
+    const auto before = table.snapshot();
+    const double * prices = before.data<1>();
+    REQUIRE( table.shared<0>() );
+    REQUIRE( prices == static_cast<const decltype( table ) &>( table ).data<1>() );
+
+    SECTION( "writes copy only the touched columns" )
+    {
+        table.set<1>( 10, -1.0 );
+        table.get<2>( 20 ) = -2.0f;
+
+        REQUIRE( table.shared<0>() );
+        REQUIRE_FALSE( table.shared<1>() );
+        REQUIRE_FALSE( table.shared<2>() );
+        REQUIRE( before.data<0>() == static_cast<const decltype( table ) &>( table ).data<0>() );
+
+        REQUIRE( before.get<1>( 10 ) == 5.0 );
+        REQUIRE( before.get<2>( 20 ) == 20.0f );
+        REQUIRE( before.data<1>() == prices );
+        REQUIRE( table.get<1>( 10 ) == -1.0 );
+        REQUIRE( soa::sum<1>( before ) == 0.5 * 99 * 100 / 2 );
+
+        // Once private, a column is written in place until the next snapshot.
+        const double * own = static_cast<const decltype( table ) &>( table ).data<1>();
+        table.set<1>( 11, -1.0 );
+        REQUIRE( static_cast<const decltype( table ) &>( table ).data<1>() == own );
+    }
+
+    SECTION( "appends past the snapshot's rows write in place" )
+    {
+        table.reserve( 200 );
+        const auto reserved = table.snapshot();
+        table.push_back( 100, 50.0, 100.0f );
+        REQUIRE( table.shared<0>() );
+        REQUIRE( table.shared<1>() );
+        REQUIRE( reserved.size() == 100 );
+        REQUIRE( table.size() == 101 );
+
+        // Rewriting a row the snapshot sees copies.
+        table.pop_back();
+        table.pop_back();
+        table.push_back( 7, 7.0, 7.0f );
+        REQUIRE_FALSE( table.shared<0>() );
+        REQUIRE( reserved.get<0>( 99 ) == 99 );
+        REQUIRE( table.get<0>( 99 ) == 7 );
+    }
+
+    SECTION( "snapshots outlive the table and copies fork" )
+    {
+        soa::snapshot<std::uint32_t, double, float> later;
+        {
+            soa::versioned_vector<std::uint32_t, double, float> fork = table;
+            fork[ 0 ] = std::make_tuple( 1000u, 1000.0, 1000.0f );
+            fork.resize( 150 );
+            later = fork.snapshot();
+            REQUIRE( table.get<0>( 0 ) == 0 );
+        }
+        REQUIRE( later.size() == 150 );
+        REQUIRE( later[ 0 ] == std::make_tuple( 1000u, 1000.0, 1000.0f ) );
+        REQUIRE( later.get<1>( 149 ) == 0.0 );
+        REQUIRE( later.to_vector().get<2>( 99 ) == 99.0f );
+        REQUIRE( std::equal( before.begin(), before.end(), rows.begin() ) );
+    }
+
+    SECTION( "forks append within the shared capacity" )
+    {
+        table.reserve( 200 );
+        soa::versioned_vector<std::uint32_t, double, float> fork = table;
+        fork.push_back( 111, 111.0, 111.0f );
+        table.push_back( 222, 222.0, 222.0f );
+        REQUIRE( fork.get<0>( 100 ) == 111 );
+        REQUIRE( table.get<0>( 100 ) == 222 );
+        REQUIRE( fork.get<2>( 100 ) == 111.0f );
+        REQUIRE_FALSE( fork.shared<1>() );
+
+        // The fork holds its own columns now, so the table writes back in place.
+        const std::uint32_t * ids = static_cast<const decltype( table ) &>( table ).data<0>();
+        table.push_back( 223, 223.0, 223.0f );
+        REQUIRE( static_cast<const decltype( table ) &>( table ).data<0>() == ids );
+    }
+
+    SECTION( "moves leave an empty table" )
+    {
+        soa::versioned_vector<std::uint32_t, double, float> moved = std::move( table );
+        REQUIRE( moved.size() == 100 );
+        REQUIRE( table.empty() );
+        REQUIRE( table.capacity() == 0 );
+        table.push_back( 1, 1.0, 1.0f );
+        REQUIRE( table.get<0>( 0 ) == 1 );
+
+        table = std::move( moved );
+        REQUIRE( table.size() == 100 );
+        REQUIRE( moved.empty() );
+        moved.push_back( 2, 2.0, 2.0f );
+        REQUIRE( moved.size() == 1 );
+        REQUIRE( before.get<0>( 0 ) == 0 );
+    }
+
+    SECTION( "snapshots released on another thread" )
+    {
+        // The writer waits for the reader to drop its snapshot, then writes in place; the reader's reads must
+        // happen before that write.
+        soa::versioned_vector<std::uint32_t, double, float> own( rows );
+        auto view = own.snapshot();
+        std::thread reader( [view]() mutable {
+            volatile double total = soa::sum<1>( view );
+            static_cast<void>( total );
+            view = {};
+        } );
+        view = {};
+        while ( own.shared<1>() )
+        {
+            std::this_thread::yield();
+        }
+        const double * in_place = static_cast<const decltype( own ) &>( own ).data<1>();
+        own.set<1>( 10, -1.0 );
+        REQUIRE( static_cast<const decltype( own ) &>( own ).data<1>() == in_place );
+        reader.join();
+    }
+}
+
+TEST_CASE( "dirty tracking", "[tracked_vector]" )
+{
+    SECTION( "dirty bitmap" )
+    {
+        soa::dirty_bitmap dirty;
+        REQUIRE( dirty.empty() );
+        dirty.mark( 5 );
+        dirty.mark( 60, 130 );
+        dirty.mark( 10000 );
+        REQUIRE( dirty.count() == 72 );
+        REQUIRE( dirty.contains( 129 ) );
+        REQUIRE_FALSE( dirty.contains( 130 ) );
+        REQUIRE_FALSE( dirty.contains( 1 << 20 ) );
+
+        std::vector<std::size_t> words;
+        dirty.for_each_word( [&]( std::size_t w, std::uint64_t ) { words.push_back( w ); } );
+        REQUIRE( words == std::vector<std::size_t>{0, 1, 2, 156} );
+
+        const soa::selection selected = dirty.to_selection( 100 );
+        REQUIRE( selected.size() == 41 );
+        REQUIRE( selected.contains( 99 ) );
+
+        dirty.truncate( 64 );
+        REQUIRE( dirty.count() == 5 );
+        dirty.clear();
+        REQUIRE( dirty.empty() );
+        REQUIRE( dirty.count() == 0 );
+
+        // Truncating inside a word that ends up empty leaves no word to visit.
+        dirty.mark( 70 );
+        dirty.truncate( 65 );
+        REQUIRE( dirty.empty() );
+        std::size_t visited = 0;
+        dirty.for_each_word( [&]( std::size_t, std::uint64_t ) { ++visited; } );
+        REQUIRE( visited == 0 );
+        dirty.mark( 64 );
+        dirty.mark( 70 );
+        dirty.truncate( 65 );
+        REQUIRE( dirty.count() == 1 );
+        REQUIRE_FALSE( dirty.empty() );
+    }
+
+    SECTION( "tracked vector" )
+    {
+        soa::vector<std::uint32_t, double, float> initial;
+        for ( std::uint32_t i = 0; i < 1000; ++i )
+        {
+            initial.push_back( i, i * 0.5, 0.0f );
+        }
+        soa::tracked_vector<std::uint32_t, double, float> table( std::move( initial ) );
+        REQUIRE( table.dirty_rows().empty() );
+        REQUIRE( table.checkpoint_size() == 1000 );
+
+        table.set<1>( 7, -1.0 );
+        table.set<1>( 700, -1.0 );
+        table.set_row( 300, 1u, 2.0, 3.0f );
+        for ( float & value : table.write<2>( 500, 10 ) )
+        {
+            value = 1.0f;
+        }
+        table.push_back( 1000, 0.0, 0.0f );
+
+        REQUIRE( table.dirty<0>().count() == 2 );
+        REQUIRE( table.dirty<1>().count() == 4 );
+        REQUIRE( table.dirty<2>().count() == 12 );
+        REQUIRE( table.dirty_rows().count() == 14 );
+        REQUIRE( table.get<2>( 509 ) == 1.0f );
+        REQUIRE( table[ 300 ] == std::make_tuple( 1u, 2.0, 3.0f ) );
+
+        // Shipping the changed prices.
+        std::map<std::size_t, double> shipped;
+        table.dirty<1>().for_each( [&]( std::size_t row ) { shipped[ row ] = table.get<1>( row ); } );
+        REQUIRE( shipped == std::map<std::size_t, double>{{7, -1.0}, {300, 2.0}, {700, -1.0}, {1000, 0.0}} );
+
+        const auto changed = soa::take<0, 2>( table.rows(), table.dirty_rows().to_selection( table.size() ) );
+        REQUIRE( changed.size() == 14 );
+
+        table.checkpoint();
+        REQUIRE( table.dirty_rows().empty() );
+        REQUIRE( table.checkpoint_size() == 1001 );
+
+        table.resize( 990 );
+        table.push_back( 1, 1.0, 1.0f );
+        REQUIRE( table.dirty_rows().count() == 1 );
+        REQUIRE( table.dirty<0>().contains( 990 ) );
+        REQUIRE( table.size() < table.checkpoint_size() );
+
+        // Undoing an append inside a bitmap word leaves nothing dirty.
+        table.resize( 65 );
+        table.checkpoint();
+        table.push_back( 2, 2.0, 2.0f );
+        table.pop_back();
+        REQUIRE( table.dirty_rows().empty() );
+        REQUIRE( table.dirty<1>().empty() );
+    }
+}
+
+TEST_CASE( "columnar patches", "[patch]" )
+{
+    using table = soa::vector<std::uint32_t, double, std::int64_t>;
+    table before;
+    for ( std::uint32_t i = 0; i < 1000; ++i )
+    {
+        before.push_back( i, i * 0.25, std::int64_t( i ) - 500 );
+    }
+    before.get<1>( 3 ) = std::numeric_limits<double>::quiet_NaN();
+
+    auto replicate = []( const soa::patch<std::uint32_t, double, std::int64_t> & delta, table replica ) {
+        std::vector<unsigned char> wire;
+        soa::write_patch( delta, wire );
+        soa::apply( soa::read_patch<std::uint32_t, double, std::int64_t>( wire.data(), wire.size() ), replica );
+        return replica;
+    };
+
+    SECTION( "changed ranges per column" )
+    {
+        table after = before;
+        after.get<1>( 10 ) = -1.0;
+        after.get<1>( 11 ) = -1.0;
+        after.get<1>( 12 ) = -1.0;
+        after.get<1>( 500 ) = -2.0;
+        after.get<2>( 999 ) = 0;
+        after.push_back( 1000, 0.0, 0 );
+        after.push_back( 1001, 0.0, 0 );
+
+        const auto delta = soa::diff( before, after );
+        REQUIRE( delta.old_size() == 1000 );
+        REQUIRE( delta.inserted() == 2 );
+        REQUIRE( delta.column<0>().ranges.size() == 1 );
+        REQUIRE( delta.column<0>().ranges[ 0 ].first == 1000 );
+
+        const auto & prices = delta.column<1>();
+        REQUIRE( prices.ranges.size() == 3 );
+        REQUIRE( prices.ranges[ 0 ].first == 10 );
+        REQUIRE( prices.ranges[ 0 ].count == 3 );
+        REQUIRE( prices.values.size() == 6 );
+
+        // The change at 999 and the inserted rows merge into one range.
+        REQUIRE( delta.column<2>().ranges.size() == 1 );
+        REQUIRE( delta.column<2>().ranges[ 0 ].count == 3 );
+        REQUIRE( delta.changed_cells() == 11 );
+
+        table replica = before;
+        soa::apply( delta, replica );
+        REQUIRE( std::equal( replica.begin(), replica.end(), after.begin(), after.end(), []( auto a, auto b ) {
+            return std::memcmp( &std::get<1>( a ), &std::get<1>( b ), sizeof( double ) ) == 0 &&
+                   std::get<0>( a ) == std::get<0>( b ) && std::get<2>( a ) == std::get<2>( b );
+        } ) );
+        REQUIRE( replicate( delta, before ).get<1>( 500 ) == -2.0 );
+    }
+
+    SECTION( "deletes, empty patches and mismatches" )
+    {
+        REQUIRE( soa::diff( before, before ).empty() );
+
+        table shorter = before;
+        shorter.resize( 900 );
+        const auto delta = soa::diff( before, shorter );
+        REQUIRE( delta.deleted() == 100 );
+        REQUIRE( delta.changed_cells() == 0 );
+        REQUIRE( replicate( delta, before ).size() == 900 );
+
+        REQUIRE_THROWS_AS( soa::apply( delta, shorter ), soa::patch_error );
+
+        std::vector<unsigned char> wire;
+        soa::write_patch( delta, wire );
+        REQUIRE_THROWS_AS( ( soa::read_patch<std::uint32_t, double>( wire.data(), wire.size() ) ), soa::patch_error );
+        REQUIRE_THROWS_AS( ( soa::read_patch<std::uint32_t, double, std::int64_t>( wire.data(), wire.size() - 1 ) ),
+                           soa::patch_error );
+    }
+
+    SECTION( "crafted patches" )
+    {
+        // One std::uint32_t column whose single range covers rows [0, count) of a table growing from 0 to count
+        // rows, followed by the given codec and payload.
+        auto craft = []( std::uint64_t count, std::uint64_t codec, std::size_t payload ) {
+            std::vector<unsigned char> wire;
+            for ( const std::uint64_t value : {std::uint64_t( 0 ), count, std::uint64_t( 1 ), std::uint64_t( 4 ),
+                                               std::uint64_t( 1 ), std::uint64_t( 0 ), count, codec} )
+            {
+                soa::detail::put_varint( wire, value );
+            }
+            soa::detail::put_varint( wire, payload );
+            wire.resize( wire.size() + payload );
+            return wire;
+        };
+        auto read = []( const std::vector<unsigned char> & wire ) {
+            return soa::read_patch<std::uint32_t>( wire.data(), wire.size() );
+        };
+
+        REQUIRE( read( craft( 2, 0, 8 ) ).column<0>().values.size() == 2 );
+        REQUIRE_THROWS_AS( read( craft( 2, 6, 8 ) ), soa::patch_error );
+        // Would read as raw if the codec were truncated to 32 bits.
+        REQUIRE_THROWS_AS( read( craft( 2, std::uint64_t( 1 ) << 32, 8 ) ), soa::patch_error );
+        // Raw values must all be in the payload, checked before allocating for them.
+        REQUIRE_THROWS_AS( read( craft( std::uint64_t( 1 ) << 40, 0, 8 ) ), soa::patch_error );
+        // Encoded values are bounded by the row count only; one that cannot be allocated is malformed too.
+        REQUIRE_THROWS_AS( read( craft( std::uint64_t( 1 ) << 62, 3, 8 ) ), soa::patch_error );
+
+        soa::patch<std::uint32_t, double, std::int64_t> past_end( 1000, 1000 );
+        past_end.column<0>().ranges.push_back( {990, 20} );
+        past_end.column<0>().values.resize( 20 );
+        table replica = before;
+        REQUIRE_THROWS_AS( soa::apply( past_end, replica ), soa::patch_error );
+
+        soa::patch<std::uint32_t, double, std::int64_t> short_values( 1000, 1001 );
+        short_values.column<1>().ranges.push_back( {0, 2} );
+        short_values.column<1>().values.resize( 1 );
+        REQUIRE_THROWS_AS( soa::apply( short_values, replica ), soa::patch_error );
+        REQUIRE( replica.size() == 1000 );
+        REQUIRE( replica.get<0>( 999 ) == 999 );
+    }
+
+    SECTION( "patches from dirty bitmaps" )
+    {
+        soa::tracked_vector<std::uint32_t, double, std::int64_t> tracked( before );
+        for ( std::uint32_t row = 0; row < 1000; row += 7 )
+        {
+            tracked.set<2>( row, -1 );
+        }
+        for ( double & value : tracked.write<1>( 60, 70 ) )
+        {
+            value = 42.0;
+        }
+        tracked.push_back( 1000, 1.0, 1 );
+
+        const auto delta = soa::diff( tracked );
+        REQUIRE( delta.column<1>().ranges.size() == 2 );
+        REQUIRE( delta.column<1>().ranges[ 0 ].first == 60 );
+        REQUIRE( delta.column<1>().ranges[ 0 ].count == 70 );
+        REQUIRE( delta.column<2>().ranges.size() == 143 + 1 );
+
+        const table replica = replicate( delta, before );
+        const auto expected = soa::diff( replica, tracked.rows() );
+        REQUIRE( expected.empty() );
+    }
+}